@@ -0,0 +1,161 @@
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <vector>
+
+#include "../include/server.h"
+#include "../include/enums/loop_enum.h"
+#include "../tests/kv_client.h"
+
+/**
+ * connection storm: 50K clients connect in bursts, as a restarting fleet
+ * would, and each sends a PING as soon as it is connected. reports the
+ * rate the server took them in at and the time from the start of a
+ * burst to the first reply of each of its clients
+ *
+ * the open files limit is raised to fit the clients and the server, the
+ * count is cut down to what fits if the hard limit can't be raised. the
+ * clients bind to 127.0.0.1 to .4 so the local ports don't run out
+ */
+
+static const int k_addrs = 4;
+
+/**
+ * @return how many connections fit in the open files limit, raised
+ * toward want if possible
+ */
+static int raise_nofile(int want)
+{
+    struct rlimit rl;
+    CHECK(getrlimit(RLIMIT_NOFILE, &rl) == 0);
+    rlim_t need = (rlim_t)want + 256;
+    if (rl.rlim_max < need)
+    {
+        struct rlimit up = {need, need};
+        if (setrlimit(RLIMIT_NOFILE, &up) == 0)
+        {
+            return want;
+        }
+    }
+    rl.rlim_cur = rl.rlim_max;
+    CHECK(setrlimit(RLIMIT_NOFILE, &rl) == 0);
+    return (rl.rlim_cur >= need) ? want : (int)rl.rlim_cur - 256;
+}
+
+static int connect_from(int i)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    CHECK(fd >= 0);
+    int yes = 1;
+    setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &yes, sizeof(yes));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK + (uint32_t)(i % k_addrs));
+    CHECK(bind(fd, (const sockaddr *)&addr, sizeof(addr)) == 0);
+
+    addr.sin_port = htons(1234);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int rv = connect(fd, (const sockaddr *)&addr, sizeof(addr));
+    CHECK(rv == 0 || errno == EINPROGRESS);
+    return fd;
+}
+
+/**
+ * @brief opens n connections in bursts of burst, each burst waits for
+ * every PING of the one before to be answered
+ */
+static void storm(int n, int burst)
+{
+    int ep = epoll_create1(0);
+    CHECK(ep >= 0);
+    std::vector<int> fds;
+    std::vector<float> ttfr_ms; // time to first reply
+    const std::string ping = "*1\r\n$4\r\nPING\r\n";
+    double start = now_sec();
+
+    for (int base = 0; base < n; base += burst)
+    {
+        int cnt = std::min(burst, n - base);
+        double t0 = now_sec();
+        for (int i = 0; i < cnt; i++)
+        {
+            int fd = connect_from(base + i);
+            struct epoll_event ev = {};
+            ev.events = EPOLLOUT | EPOLLIN;
+            ev.data.fd = fd;
+            CHECK(epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev) == 0);
+            fds.push_back(fd);
+        }
+
+        // a writable socket is connected, it sends its PING and waits
+        // for the reply
+        int left = cnt;
+        struct epoll_event evs[256];
+        while (left > 0)
+        {
+            int nev = epoll_wait(ep, evs, 256, 10 * 1000);
+            CHECK(nev > 0);
+            for (int e = 0; e < nev; e++)
+            {
+                int fd = evs[e].data.fd;
+                CHECK(!(evs[e].events & (EPOLLERR | EPOLLHUP)));
+                if (evs[e].events & EPOLLIN)
+                {
+                    char buf[16];
+                    CHECK(read(fd, buf, sizeof(buf)) == 7 && !memcmp(buf, "+PONG\r\n", 7));
+                    ttfr_ms.push_back((float)((now_sec() - t0) * 1e3));
+                    CHECK(epoll_ctl(ep, EPOLL_CTL_DEL, fd, NULL) == 0);
+                    left--;
+                    continue;
+                }
+                CHECK(write(fd, ping.data(), ping.size()) == (ssize_t)ping.size());
+                struct epoll_event ev = {};
+                ev.events = EPOLLIN;
+                ev.data.fd = fd;
+                CHECK(epoll_ctl(ep, EPOLL_CTL_MOD, fd, &ev) == 0);
+            }
+        }
+    }
+    double took = now_sec() - start;
+
+    std::sort(ttfr_ms.begin(), ttfr_ms.end());
+    auto pct = [&ttfr_ms](double p)
+    {
+        return ttfr_ms[std::min(ttfr_ms.size() - 1, (size_t)(p * (double)ttfr_ms.size()))];
+    };
+    printf("%8d %6d %10.2f %10.0f %8.2f %8.2f %8.2f\n", n, burst, took, (double)n / took,
+           pct(0.5), pct(0.99), ttfr_ms.back());
+
+    // reset, the local ports don't linger in TIME_WAIT for the next run
+    for (int fd : fds)
+    {
+        struct linger lg = {1, 0};
+        setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+        close(fd);
+    }
+    close(ep);
+}
+
+int main(int argc, char **argv)
+{
+    int want = (argc > 1) ? atoi(argv[1]) : 50000;
+    // the server runs in a child process, it gets the same limit
+    int n = raise_nofile(want);
+    if (n < want)
+    {
+        printf("open files limit too low for %d connections, using %d\n", want, n);
+    }
+
+    printf("%8s %6s %10s %10s %8s %8s %8s\n", "conns", "burst", "secs", "accepts/s",
+           "p50 ms", "p99 ms", "max ms");
+    for (int burst : {500, 2000, 10000})
+    {
+        pid_t pid = spawn_server([]()
+                                 {
+                                     Server server(LOOP_EPOLL);
+                                     server.run_server(server.init()); });
+        close(kv_connect()); // listening
+        storm(n, burst);
+        stop_server(pid);
+    }
+    return 0;
+}
@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../include/cmap.h"
+#include "../include/epoch.h"
+#include "../include/hash.h"
+#include "../include/hashtable.h"
+
+/**
+ * throughput of the CMap the web frontend shares between its threads,
+ * next to one mutex around an HMap, by thread count
+ *
+ * 1M possible keys, half of them present. a read is a lookup, a write
+ * pops the key or inserts it when missing, so the size holds. mixes of
+ * 95/5 and 50/50 reads/writes, 1 to 32 threads, the seconds per point are
+ * the argument
+ */
+
+struct BenchCEntry
+{
+    CNode node;
+    uint64_t key = 0;
+    uint64_t val = 0;
+};
+
+struct BenchHEntry
+{
+    HNode node;
+    uint64_t key = 0;
+    uint64_t val = 0;
+};
+
+static const uint64_t k_keys = 1 << 20;
+
+static CMap g_cmap;
+static HMap g_hmap;
+static std::mutex g_mu;
+
+static bool centry_eq(CNode *a, CNode *b)
+{
+    return ((BenchCEntry *)a)->key == ((BenchCEntry *)b)->key;
+}
+
+static bool hentry_eq(HNode *a, HNode *b)
+{
+    return ((BenchHEntry *)a)->key == ((BenchHEntry *)b)->key;
+}
+
+static void centry_free(void *p)
+{
+    delete (BenchCEntry *)p;
+}
+
+static uint64_t key_hash(uint64_t key)
+{
+    return str_hash((const uint8_t *)&key, 8);
+}
+
+static uint64_t cmap_op(uint64_t k, bool write)
+{
+    EpochGuard guard;
+    BenchCEntry key;
+    key.key = k;
+    key.node.hcode = key_hash(k);
+    if (!write)
+    {
+        CNode *node = cm_lookup(&g_cmap, &key.node, centry_eq);
+        return node ? ((BenchCEntry *)node)->val : 0;
+    }
+    CNode *node = cm_pop(&g_cmap, &key.node, centry_eq);
+    if (node)
+    {
+        epoch_retire(node, centry_free);
+        return 0;
+    }
+    BenchCEntry *e = new BenchCEntry();
+    e->key = k;
+    e->node.hcode = key.node.hcode;
+    if (cm_insert(&g_cmap, &e->node, centry_eq))
+    {
+        delete e;
+    }
+    return 0;
+}
+
+static uint64_t hmap_op(uint64_t k, bool write)
+{
+    BenchHEntry key;
+    key.key = k;
+    key.node.hcode = key_hash(k);
+    std::lock_guard<std::mutex> lock(g_mu);
+    if (!write)
+    {
+        HNode *node = hm_lookup(&g_hmap, &key.node, hentry_eq);
+        return node ? ((BenchHEntry *)node)->val : 0;
+    }
+    HNode *node = hm_pop(&g_hmap, &key.node, hentry_eq);
+    if (node)
+    {
+        delete (BenchHEntry *)node;
+        return 0;
+    }
+    hm_insert(&g_hmap, &(new BenchHEntry(key))->node);
+    return 0;
+}
+
+/**
+ * @return million ops per second of n_threads running op for secs
+ */
+static double run(uint64_t (*op)(uint64_t, bool), int write_pct, int n_threads, double secs)
+{
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> total{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < n_threads; t++)
+    {
+        threads.emplace_back([&, t]()
+                             {
+                                 std::mt19937_64 rng(t + 99);
+                                 uint64_t n = 0;
+                                 uint64_t sink = 0;
+                                 while (!stop.load(std::memory_order_relaxed))
+                                 {
+                                     for (int i = 0; i < 64; i++, n++)
+                                     {
+                                         uint64_t x = rng();
+                                         sink += op(x % k_keys, (x >> 40) % 100 < (uint64_t)write_pct);
+                                     }
+                                 }
+                                 total += n + (sink == 1); });
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(secs));
+    stop = true;
+    for (std::thread &th : threads)
+    {
+        th.join();
+    }
+    return (double)total / secs / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    double secs = (argc > 1) ? atof(argv[1]) : 1;
+    for (uint64_t k = 0; k < k_keys; k += 2)
+    {
+        cmap_op(k, true);
+        hmap_op(k, true);
+    }
+    while (hm_rehash(&g_hmap, 1000))
+    {
+    }
+
+    const int threads[] = {1, 2, 4, 8, 16, 32};
+    printf("%-6s %-11s", "mix", "map");
+    for (int n : threads)
+    {
+        printf(" %6s%-2d", "T", n);
+    }
+    printf("  Mops/s\n");
+    for (int write_pct : {5, 50})
+    {
+        for (int m = 0; m < 2; m++)
+        {
+            printf("%2d/%-3d %-11s", 100 - write_pct, write_pct, m ? "mutex+HMap" : "CMap");
+            for (int n : threads)
+            {
+                printf(" %8.2f", run(m ? hmap_op : cmap_op, write_pct, n, secs));
+                fflush(stdout);
+            }
+            printf("\n");
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "../include/hash.h"
+#include "../tests/kv_client.h"
+
+/**
+ * str_hash() throughput in both modes by key length, next to the 32-bit
+ * FNV-1a it replaced
+ */
+
+static uint64_t fnv_hash(const uint8_t *data, size_t len)
+{
+    uint32_t h = 0x811C9DC5;
+    for (size_t i = 0; i < len; i++)
+    {
+        h = (h + data[i]) * 0x01000193;
+    }
+    return h;
+}
+
+/**
+ * @return ns per hash, a byte of the key changes every time so nothing
+ * is hoisted out of the loop
+ */
+static double run(uint64_t (*fn)(const uint8_t *, size_t), size_t len, double secs)
+{
+    std::vector<uint8_t> buf(len, 7);
+    uint64_t acc = 0;
+    size_t n = 0;
+    double start = now_sec();
+    double took = 0;
+    while ((took = now_sec() - start) < secs)
+    {
+        for (size_t i = 0; i < 100000; i++, n++)
+        {
+            buf[n % len] ^= (uint8_t)acc;
+            acc += fn(buf.data(), len);
+        }
+    }
+    if (acc == 42)
+    {
+        printf(" "); // keeps acc alive
+    }
+    return took / n * 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    double secs = (argc > 1) ? atof(argv[1]) : 0.3;
+    printf("%6s %10s %10s %10s %10s %10s %10s\n",
+           "len", "fast ns", "fast GB/s", "sip ns", "sip GB/s", "fnv ns", "fnv GB/s");
+    for (size_t len : {8, 16, 32, 64, 256, 4096})
+    {
+        hash_set_mode(HASH_FAST);
+        double fast = run(str_hash, len, secs);
+        hash_set_mode(HASH_SIP);
+        double sip = run(str_hash, len, secs);
+        double fnv = run(fnv_hash, len, secs);
+        printf("%6zu %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+               len, fast, len / fast, sip, len / sip, fnv, len / fnv);
+    }
+    return 0;
+}
@@ -0,0 +1,115 @@
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../include/hash.h"
+#include "../include/hashtable.h"
+#include "../tests/kv_client.h"
+
+/**
+ * HMap insert and lookup times and its memory per key, for "key:N" keys
+ * hashed with str_hash()
+ *
+ * hot lookups cycle over 1000 keys that stay in cache, random ones go all
+ * over the table, half of both miss. the table bytes are the heap growth
+ * of the inserts, the nodes were allocated before
+ *
+ * the sizes are the arguments, 1M and 10M by default
+ */
+
+struct BenchEntry
+{
+    HNode node;
+    std::string key;
+};
+
+static bool entry_eq(HNode *a, HNode *b)
+{
+    return ((BenchEntry *)a)->key == ((BenchEntry *)b)->key;
+}
+
+static size_t heap_bytes()
+{
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+}
+
+static void entry_init(BenchEntry *e, size_t n)
+{
+    e->key = "key:" + std::to_string(n);
+    e->node.hcode = str_hash((const uint8_t *)e->key.data(), e->key.size());
+}
+
+/**
+ * @return ns per lookup of keys
+ */
+static double lookups(HMap *hmap, std::vector<BenchEntry> &keys, size_t count, size_t *hits)
+{
+    double start = now_sec();
+    for (size_t i = 0; i < count; i++)
+    {
+        BenchEntry &k = keys[(i * 7919) % keys.size()];
+        *hits += hm_lookup(hmap, &k.node, entry_eq) != NULL;
+    }
+    return (now_sec() - start) / count * 1e9;
+}
+
+static void run(size_t n)
+{
+    std::vector<BenchEntry> entries(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        entry_init(&entries[i], i);
+    }
+
+    HMap hmap;
+    size_t before = heap_bytes();
+    double start = now_sec();
+    for (size_t i = 0; i < n; i++)
+    {
+        hm_insert(&hmap, &entries[i].node);
+    }
+    while (hm_rehash(&hmap, 1000))
+    {
+    }
+    double insert_ns = (now_sec() - start) / n * 1e9;
+    size_t table = heap_bytes() - before;
+
+    std::mt19937_64 rng(1);
+    const size_t count = 4000000;
+    std::vector<BenchEntry> hot(1000);
+    std::vector<BenchEntry> cold(count / 4);
+    for (BenchEntry &e : hot)
+    {
+        entry_init(&e, rng() % (2 * n));
+    }
+    for (BenchEntry &e : cold)
+    {
+        entry_init(&e, rng() % (2 * n));
+    }
+
+    size_t hits = 0;
+    double hot_ns = lookups(&hmap, hot, count, &hits);
+    double cold_ns = lookups(&hmap, cold, cold.size(), &hits);
+    printf("%10zu %10.1f %10.1f %10.1f %10.1f %10zu\n",
+           n, insert_ns, hot_ns, cold_ns, (double)table / n, hits);
+    hm_destroy(&hmap);
+}
+
+int main(int argc, char **argv)
+{
+    printf("%10s %10s %10s %10s %10s %10s\n", "keys", "insert ns", "hot ns", "random ns", "B/key", "hits");
+    if (argc < 2)
+    {
+        run(1000000);
+        run(10000000);
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        run((size_t)atoll(argv[i]));
+    }
+    return 0;
+}
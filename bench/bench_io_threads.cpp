@@ -0,0 +1,46 @@
+#include <vector>
+
+#include "../include/server.h"
+#include "../include/enums/loop_enum.h"
+#include "../tests/kv_client.h"
+
+/**
+ * requests per second of the single reactor doing its socket I/O inline,
+ * next to the same reactor handing reads and writes to n I/O threads. the
+ * clients keep depth SETs and as many GETs of size byte values in flight
+ */
+
+int main(int argc, char **argv)
+{
+    double secs = (argc > 1) ? atof(argv[1]) : 2;
+    printf("%10s %6s %6s %6s %12s %8s %8s\n", "io threads", "conns", "depth", "value", "req/s", "p50 us", "p99 us");
+    for (uint32_t n : {1u, 2u, 4u, 8u})
+    {
+        // one thread is the reactor alone, set_io_threads() starts none
+        pid_t pid = spawn_server([n]()
+                                 {
+                                     Server server(LOOP_EPOLL);
+                                     server.set_io_threads(n);
+                                     server.run_server(server.init()); });
+        for (int depth : {1, 32})
+        {
+            for (size_t size : {(size_t)16, (size_t)4096})
+            {
+                std::string value(size, 'v');
+                LoadStats st = run_clients(32, secs, [depth, &value](int c, std::string &batch)
+                                           {
+                                               for (int i = 0; i < depth; i++)
+                                               {
+                                                   std::string key = "key:" + std::to_string(c * depth + i);
+                                                   resp_cmd(batch, {"SET", key, value});
+                                                   resp_cmd(batch, {"GET", key});
+                                               }
+                                               return 2 * depth; });
+                printf("%10s %6d %6d %6zu %12.0f %8.1f %8.1f\n", n > 1 ? std::to_string(n).c_str() : "inline",
+                       32, depth, size, st.rps(), st.pct(0.5), st.pct(0.99));
+            }
+        }
+        stop_server(pid);
+    }
+    return 0;
+}
@@ -0,0 +1,60 @@
+#include <vector>
+
+#include "../include/server.h"
+#include "../include/enums/loop_enum.h"
+#include "../tests/kv_client.h"
+
+/**
+ * every event loop backend with n_conns clients each keeping depth GETs
+ * and SETs in flight: requests per second, p50 and p99 latency, and the
+ * syscalls the server made per request, from the syscalls of its INFO
+ */
+
+static const char *k_loop_names[] = {"epoll", "poll", "uring"};
+
+// depth requests of client c, every other one a SET
+static int get_set_batch(int c, int depth, std::string &batch)
+{
+    for (int i = 0; i < depth; i++)
+    {
+        std::string key = "k" + std::to_string(c * depth + i);
+        if (i % 2)
+        {
+            resp_cmd(batch, {"SET", key, "value"});
+        }
+        else
+        {
+            resp_cmd(batch, {"GET", key});
+        }
+    }
+    return depth;
+}
+
+int main(int argc, char **argv)
+{
+    double secs = (argc > 1) ? atof(argv[1]) : 2;
+    const int shapes[][2] = {{1, 1}, {16, 1}, {16, 32}};
+
+    printf("%-6s %6s %6s %12s %8s %8s %9s\n",
+           "loop", "conns", "depth", "req/s", "p50 us", "p99 us", "sys/req");
+    for (uint32_t loop_type : {LOOP_EPOLL, LOOP_POLL, LOOP_URING})
+    {
+        pid_t pid = spawn_server([loop_type]()
+                                 {
+                                     Server server(loop_type);
+                                     server.run_server(server.init()); });
+        for (const int *shape : shapes)
+        {
+            int depth = shape[1];
+            long long sys = kv_info("syscalls");
+            LoadStats st = run_clients(shape[0], secs, [depth](int c, std::string &batch)
+                                       { return get_set_batch(c, depth, batch); });
+            sys = kv_info("syscalls") - sys;
+            printf("%-6s %6d %6d %12.0f %8.1f %8.1f %9.2f\n", k_loop_names[loop_type],
+                   shape[0], depth, st.rps(), st.pct(0.5), st.pct(0.99),
+                   (double)sys / (double)st.reqs);
+        }
+        stop_server(pid);
+    }
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include <thread>
+#include <vector>
+
+#include "../include/server.h"
+#include "../include/enums/loop_enum.h"
+#include "../tests/kv_client.h"
+
+/**
+ * tail latency of light clients next to bulk loaders, with the per-turn
+ * budget of the connections and without it
+ *
+ * 2 loaders pipeline 4096 SETs of 256 byte values at a time, 8 light clients
+ * send one GET of a small value at a time. the p99 of the light clients
+ * is the figure, the budget should keep it flat while the loaders run
+ */
+
+static LoadStats g_bulk;
+
+static void run_bulk(double secs)
+{
+    std::string value(256, 'b');
+    g_bulk = run_clients(2, secs, [&value](int c, std::string &batch)
+                         {
+                             for (int i = 0; i < 4096; i++)
+                             {
+                                 resp_cmd(batch, {"SET", "bulk" + std::to_string(c * 4096 + i), value});
+                             }
+                             return 4096; });
+}
+
+static LoadStats run_light(double secs)
+{
+    return run_clients(8, secs, [](int c, std::string &batch)
+                       {
+                           resp_cmd(batch, {"GET", "light" + std::to_string(c)});
+                           return 1; });
+}
+
+int main(int argc, char **argv)
+{
+    double secs = (argc > 1) ? atof(argv[1]) : 3;
+    printf("%-10s %-8s %12s %8s %8s %12s\n", "budget", "loaders", "light req/s", "p50 us", "p99 us", "bulk req/s");
+    for (bool budget : {true, false})
+    {
+        pid_t pid = spawn_server([budget]()
+                                 {
+                                     Server server(LOOP_EPOLL);
+                                     if (!budget)
+                                     {
+                                         server.set_turn_budget(0, 0);
+                                     }
+                                     server.run_server(server.init()); });
+        for (bool loaders : {false, true})
+        {
+            g_bulk = LoadStats();
+            std::thread bulk;
+            if (loaders)
+            {
+                bulk = std::thread(run_bulk, secs);
+                usleep(100 * 1000); // let them fill their sockets first
+            }
+            LoadStats st = run_light(secs);
+            if (loaders)
+            {
+                bulk.join();
+            }
+            printf("%-10s %-8s %12.0f %8.1f %8.1f %12.0f\n", budget ? "per turn" : "none",
+                   loaders ? "2" : "0", st.rps(), st.pct(0.5), st.pct(0.99),
+                   loaders ? g_bulk.rps() : 0.0);
+        }
+        stop_server(pid);
+    }
+    return 0;
+}
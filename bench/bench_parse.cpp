@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#include "../include/conn.h"
+#include "../include/server.h"
+#include "../tests/kv_client.h"
+
+/**
+ * Conn::parse_request() over a read-buffer of pipelined SETs, RESP next
+ * to the binary protocol, by value size from 1 B to 4 KB
+ *
+ * no socket is involved: the batch is put in rbuf once and parsed again
+ * and again, so the figures are the parsers alone, parse_resp() and the
+ * length-prefixed one of the binary protocol
+ */
+
+static std::string make_batch(bool bin, size_t val_len, size_t bytes)
+{
+    std::string buf;
+    std::string val(val_len, 'v');
+    for (int i = 0; buf.size() < bytes; i++)
+    {
+        std::string key = "key:" + std::to_string(i);
+        if (bin)
+        {
+            bin_cmd(buf, {"SET", key, val});
+        }
+        else
+        {
+            resp_cmd(buf, {"SET", key, val});
+        }
+    }
+    return buf;
+}
+
+/**
+ * @brief parses the batch over and over for secs
+ *
+ * @return ns per request
+ */
+static double run(const std::string &batch, double secs, double *gbps)
+{
+    Conn *conn = conn_new(-1);
+    conn->rbuf.append(batch.data(), batch.size());
+    uint64_t reqs = 0;
+    uint64_t bytes = 0;
+    double start = now_sec();
+    double took = 0;
+    while ((took = now_sec() - start) < secs)
+    {
+        conn->rbuf_head = 0;
+        conn->ncmds = 0;
+        while (conn->parse_request())
+        {
+        }
+        CHECK(conn->state == STATE_REQ && conn->rbuf_head == batch.size());
+        reqs += conn->ncmds;
+        bytes += batch.size();
+    }
+    conn->ncmds = 0;
+    delete conn;
+    *gbps = (double)bytes / took / 1e9;
+    return took * 1e9 / (double)reqs;
+}
+
+int main(int argc, char **argv)
+{
+    double secs = (argc > 1) ? atof(argv[1]) : 1;
+    printf("%8s %12s %8s %12s %8s\n", "value", "resp ns/req", "GB/s", "bin ns/req", "GB/s");
+    for (size_t len : {1, 16, 64, 256, 1024, 4096})
+    {
+        double resp_gbps = 0, bin_gbps = 0;
+        double resp_ns = run(make_batch(false, len, 1 << 20), secs, &resp_gbps);
+        double bin_ns = run(make_batch(true, len, 1 << 20), secs, &bin_gbps);
+        printf("%8zu %12.1f %8.2f %12.1f %8.2f\n", len, resp_ns, resp_gbps, bin_ns, bin_gbps);
+    }
+    return 0;
+}
@@ -0,0 +1,50 @@
+#include <vector>
+
+#include "../include/server.h"
+#include "../include/enums/loop_enum.h"
+#include "../tests/kv_client.h"
+
+/**
+ * pipelining depth sweep of the single reactor: 1 and 16 clients keeping
+ * 1, 16, 128 and 1024 requests in flight, half GETs and half SETs. with
+ * the responses of a pass flushed together, the syscalls per request
+ * should fall with the depth, the latency of a batch grows with it
+ */
+
+int main(int argc, char **argv)
+{
+    double secs = (argc > 1) ? atof(argv[1]) : 2;
+    pid_t pid = spawn_server([]()
+                             {
+                                 Server server(LOOP_EPOLL);
+                                 server.run_server(server.init()); });
+
+    printf("%6s %6s %12s %8s %8s %9s\n", "conns", "depth", "req/s", "p50 us", "p99 us", "sys/req");
+    for (int conns : {1, 16})
+    {
+        for (int depth : {1, 16, 128, 1024})
+        {
+            long long sys = kv_info("syscalls");
+            LoadStats st = run_clients(conns, secs, [depth](int c, std::string &batch)
+                                       {
+                                           for (int i = 0; i < depth; i++)
+                                           {
+                                               std::string key = "p" + std::to_string(c * depth + i / 2);
+                                               if (i % 2)
+                                               {
+                                                   resp_cmd(batch, {"SET", key, "value"});
+                                               }
+                                               else
+                                               {
+                                                   resp_cmd(batch, {"GET", key});
+                                               }
+                                           }
+                                           return depth; });
+            sys = kv_info("syscalls") - sys;
+            printf("%6d %6d %12.0f %8.1f %8.1f %9.3f\n", conns, depth, st.rps(),
+                   st.pct(0.5), st.pct(0.99), (double)sys / (double)st.reqs);
+        }
+    }
+    stop_server(pid);
+    return 0;
+}
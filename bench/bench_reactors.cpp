@@ -0,0 +1,36 @@
+#include <vector>
+
+#include "../include/server.h"
+#include "../include/enums/loop_enum.h"
+#include "../tests/kv_client.h"
+
+/**
+ * requests per second as the reactors are added, the clients keep depth
+ * SETs and as many GETs in flight each
+ */
+
+int main(int argc, char **argv)
+{
+    double secs = (argc > 1) ? atof(argv[1]) : 2;
+    printf("%8s %6s %6s %12s %8s %8s\n", "reactors", "conns", "depth", "req/s", "p50 us", "p99 us");
+    for (uint32_t n : {1u, 2u, 4u})
+    {
+        pid_t pid = spawn_server([n]()
+                                 { Server::run_reactors(n, LOOP_EPOLL); });
+        for (int depth : {1, 32})
+        {
+            LoadStats st = run_clients(32, secs, [depth](int c, std::string &batch)
+                                       {
+                                           for (int i = 0; i < depth; i++)
+                                           {
+                                               std::string key = "key:" + std::to_string(c * depth + i);
+                                               resp_cmd(batch, {"SET", key, "value"});
+                                               resp_cmd(batch, {"GET", key});
+                                           }
+                                           return 2 * depth; });
+            printf("%8u %6d %6d %12.0f %8.1f %8.1f\n", n, 32, depth, st.rps(), st.pct(0.5), st.pct(0.99));
+        }
+        stop_server(pid);
+    }
+    return 0;
+}
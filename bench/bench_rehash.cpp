@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "../include/constants.h"
+#include "../include/hash.h"
+#include "../include/hashtable.h"
+#include "../tests/kv_client.h"
+
+/**
+ * lookup and insert latency while an HMap grows, with hm_rehash() run
+ * every k_rehash_active_ms for k_rehash_budget_us like the server cron
+ * does, and the time each of those calls took
+ *
+ * the table is filled until a grow starts, then lookups of random keys
+ * with an insert every 1000 of them are timed until the grow is done.
+ * the sizes are the arguments, 1M and 4M keys by default
+ */
+
+struct BenchEntry
+{
+    HNode node;
+    std::string key;
+};
+
+static bool entry_eq(HNode *a, HNode *b)
+{
+    return ((BenchEntry *)a)->key == ((BenchEntry *)b)->key;
+}
+
+static void entry_init(BenchEntry *e, size_t n)
+{
+    e->key = "key:" + std::to_string(n);
+    e->node.hcode = str_hash((const uint8_t *)e->key.data(), e->key.size());
+}
+
+static double pct(std::vector<double> &lat, double p)
+{
+    if (lat.empty())
+    {
+        return 0;
+    }
+    std::sort(lat.begin(), lat.end());
+    return lat[std::min(lat.size() - 1, (size_t)(p * lat.size()))] * 1e6;
+}
+
+static void print(const char *what, size_t n, std::vector<double> &lat)
+{
+    printf("%10zu %-8s %8zu %8.2f %8.2f %8.2f %8.1f\n", n, what, lat.size(),
+           pct(lat, 0.5), pct(lat, 0.99), pct(lat, 0.999), pct(lat, 1));
+}
+
+static void run(size_t n)
+{
+    std::vector<BenchEntry *> entries;
+    HMap hmap;
+    auto add = [&]()
+    {
+        BenchEntry *e = new BenchEntry();
+        entry_init(e, entries.size());
+        entries.push_back(e);
+        hm_insert(&hmap, &e->node);
+    };
+    while (entries.size() < n)
+    {
+        add();
+    }
+    while (hm_rehash(&hmap, 1000))
+    {
+    }
+    uint64_t resizes = hm_stats(&hmap).resizes;
+    while (hm_stats(&hmap).resizes == resizes)
+    {
+        add();
+    }
+
+    std::vector<double> lookups, inserts, crons;
+    BenchEntry key;
+    double last_cron = now_sec();
+    for (size_t q = 0; hm_stats(&hmap).resizing; q++)
+    {
+        BenchEntry *e = entries[(q * 2654435761u) % entries.size()];
+        key.key = e->key;
+        double start = now_sec();
+        key.node.hcode = str_hash((const uint8_t *)key.key.data(), key.key.size());
+        CHECK(hm_lookup(&hmap, &key.node, entry_eq) == &e->node);
+        double end = now_sec();
+        lookups.push_back(end - start);
+
+        if (q % 1000 == 0)
+        {
+            add();
+            inserts.push_back(now_sec() - end);
+        }
+        if (end - last_cron >= k_rehash_active_ms / 1e3)
+        {
+            last_cron = now_sec();
+            hm_rehash(&hmap, k_rehash_budget_us);
+            crons.push_back(now_sec() - last_cron);
+        }
+    }
+
+    print("lookup", entries.size(), lookups);
+    print("insert", entries.size(), inserts);
+    print("cron", entries.size(), crons);
+    hm_destroy(&hmap);
+    for (BenchEntry *e : entries)
+    {
+        delete e;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    printf("%10s %-8s %8s %8s %8s %8s %8s\n", "keys", "op", "count", "p50 us", "p99 us", "p99.9 us", "max us");
+    if (argc < 2)
+    {
+        run(1000000);
+        run(4000000);
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        run((size_t)atoll(argv[i]));
+    }
+    return 0;
+}
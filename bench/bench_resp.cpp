@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#include "../include/args.h"
+#include "../include/constants.h"
+#include "../include/resp.h"
+#include "../tests/kv_client.h"
+
+/**
+ * RESP parser throughput over a read-buffer of pipelined small commands,
+ * the way parse_resp() walks it, one request after the other
+ *
+ * mixes: GETs only, 60/35/5 GET/SET/DEL with 16 to 128 byte values, and
+ * the same with 1 KB values
+ */
+
+static std::string make_batch(int get_pct, int set_pct, size_t val_max, size_t bytes)
+{
+    std::string buf;
+    srand(1);
+    while (buf.size() < bytes)
+    {
+        int r = rand() % 100;
+        std::string key = "user:" + std::to_string(rand() % 1000000);
+        if (r < get_pct)
+        {
+            resp_cmd(buf, {"GET", key});
+        }
+        else if (r < get_pct + set_pct)
+        {
+            size_t n = 16 + (size_t)rand() % (val_max - 15);
+            resp_cmd(buf, {"SET", key, std::string(n, 'v')});
+        }
+        else
+        {
+            resp_cmd(buf, {"DEL", key, key + ":a", key + ":b"});
+        }
+    }
+    return buf;
+}
+
+static void run(const char *name, const std::string &buf, double secs)
+{
+    const uint8_t *data = (const uint8_t *)buf.data();
+    Args args;
+    uint64_t reqs = 0;
+    uint64_t bytes = 0;
+    double start = now_sec();
+    double took = 0;
+    while ((took = now_sec() - start) < secs)
+    {
+        size_t off = 0;
+        while (off < buf.size())
+        {
+            args.clear();
+            size_t need = 0;
+            int64_t n = resp_parse(data + off, buf.size() - off, k_max_client_buf, args, &need);
+            CHECK(n > 0 && !args.empty());
+            off += (size_t)n;
+            reqs++;
+        }
+        bytes += buf.size();
+    }
+    printf("%-14s %8.2f %10.2f\n", name, (double)bytes / took / 1e9, (double)reqs / took / 1e6);
+}
+
+int main(int argc, char **argv)
+{
+    double secs = (argc > 1) ? atof(argv[1]) : 2;
+    const size_t bytes = 4 << 20;
+    printf("%-14s %8s %10s\n", "mix", "GB/s", "Mreq/s");
+    run("get", make_batch(100, 0, 16, bytes), secs);
+    run("get/set/del", make_batch(60, 35, 128, bytes), secs);
+    run("get/set1k/del", make_batch(60, 35, 1024, bytes), secs);
+    return 0;
+}
@@ -0,0 +1,54 @@
+#include <vector>
+
+#include "../include/server.h"
+#include "../include/enums/loop_enum.h"
+#include "../include/enums/res_enum.h"
+#include "../tests/kv_client.h"
+
+/**
+ * throughput of large values over the binary protocol, the SETs are
+ * streamed into the value as they arrive and the GETs sent by reference
+ */
+
+int main(int argc, char **argv)
+{
+    double secs = (argc > 1) ? atof(argv[1]) : 2;
+    pid_t pid = spawn_server([]()
+                             {
+                                 Server server(LOOP_EPOLL);
+                                 server.run_server(server.init()); });
+    int fd = kv_connect();
+    KvReader rd(fd);
+
+    printf("%-6s %-4s %8s %10s\n", "value", "cmd", "ops", "MB/s");
+    for (size_t mb : {1, 64})
+    {
+        std::string val(mb << 20, 'x');
+        std::string set;
+        bin_cmd(set, {"set", "big", val});
+        std::string get;
+        bin_cmd(get, {"get", "big"});
+
+        for (int is_get = 0; is_get < 2; is_get++)
+        {
+            uint64_t ops = 0;
+            double start = now_sec();
+            while (ops == 0 || now_sec() - start < secs)
+            {
+                uint32_t rescode = 0;
+                kv_send(fd, is_get ? get : set);
+                std::string v = rd.bin_reply(&rescode);
+                CHECK(rescode == RES_OK);
+                CHECK(!is_get || v.size() == val.size());
+                ops++;
+            }
+            double took = now_sec() - start;
+            printf("%4zuMB  %-4s %8llu %10.0f\n", mb, is_get ? "get" : "set",
+                   (unsigned long long)ops, (double)(ops * mb) / took);
+        }
+    }
+
+    close(fd);
+    stop_server(pid);
+    return 0;
+}
@@ -0,0 +1,180 @@
+#include <sys/un.h>
+#include <thread>
+#include <vector>
+
+#include "../include/server.h"
+#include "../include/shm_client.h"
+#include "../include/enums/loop_enum.h"
+#include "../include/enums/res_enum.h"
+#include "../tests/kv_client.h"
+
+/**
+ * the same GET/SET load over TCP, a Unix domain socket and the shared
+ * memory rings of one server, in the binary protocol the rings use
+ *
+ * every client keeps depth requests in flight, half SETs and half GETs of
+ * 16 byte values, and waits for all of them before the next batch
+ */
+
+static const char *k_unix_path = "/tmp/kv-bench.sock";
+static const char *k_shm_path = "/tmp/kv-bench-shm.sock";
+
+enum
+{
+    TR_TCP,
+    TR_UNIX,
+    TR_SHM,
+};
+
+static const char *k_tr_names[] = {"tcp", "unix", "shm"};
+
+static int unix_connect()
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    CHECK(fd >= 0);
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, k_unix_path);
+    CHECK(connect(fd, (const sockaddr *)&addr, sizeof(addr)) == 0);
+    return fd;
+}
+
+// the requests of a batch of client c
+static std::vector<std::vector<std::string>> make_cmds(int c, int depth)
+{
+    std::vector<std::vector<std::string>> cmds;
+    for (int i = 0; i < depth; i++)
+    {
+        std::string key = "t" + std::to_string(c * depth + i / 2);
+        if (i % 2)
+        {
+            cmds.push_back({"get", key});
+        }
+        else
+        {
+            cmds.push_back({"set", key, std::string(16, 'v')});
+        }
+    }
+    return cmds;
+}
+
+static void client_run(int tr, int c, int depth, double until, LoadStats *st)
+{
+    std::vector<std::vector<std::string>> cmds = make_cmds(c, depth);
+    ShmClient shm;
+    int fd = -1;
+    std::string batch;
+    if (tr == TR_SHM)
+    {
+        CHECK(shm.connect(k_shm_path) == 0);
+    }
+    else
+    {
+        fd = (tr == TR_TCP) ? kv_connect() : unix_connect();
+        for (const std::vector<std::string> &cmd : cmds)
+        {
+            if (cmd.size() == 2)
+            {
+                bin_cmd(batch, {cmd[0], cmd[1]});
+            }
+            else
+            {
+                bin_cmd(batch, {cmd[0], cmd[1], cmd[2]});
+            }
+        }
+    }
+    KvReader rd(fd);
+    std::string res;
+
+    while (now_sec() < until)
+    {
+        double sent = now_sec();
+        if (tr == TR_SHM)
+        {
+            for (const std::vector<std::string> &cmd : cmds)
+            {
+                shm.send(cmd);
+            }
+        }
+        else
+        {
+            kv_send(fd, batch);
+        }
+        for (int i = 0; i < depth; i++)
+        {
+            uint32_t rescode = 0;
+            if (tr == TR_SHM)
+            {
+                rescode = shm.recv(res);
+            }
+            else
+            {
+                rd.bin_reply(&rescode);
+            }
+            CHECK(rescode == RES_OK || rescode == RES_NX);
+            st->lat_us.push_back((float)((now_sec() - sent) * 1e6));
+        }
+        st->reqs += depth;
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+static LoadStats run(int tr, int n_conns, int depth, double secs)
+{
+    std::vector<LoadStats> stats(n_conns);
+    std::vector<std::thread> threads;
+    double start = now_sec();
+    for (int c = 0; c < n_conns; c++)
+    {
+        threads.emplace_back(client_run, tr, c, depth, start + secs, &stats[c]);
+    }
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+
+    LoadStats total;
+    total.secs = now_sec() - start;
+    for (LoadStats &st : stats)
+    {
+        total.reqs += st.reqs;
+        total.lat_us.insert(total.lat_us.end(), st.lat_us.begin(), st.lat_us.end());
+    }
+    return total;
+}
+
+int main(int argc, char **argv)
+{
+    double secs = (argc > 1) ? atof(argv[1]) : 2;
+    unlink(k_unix_path);
+    unlink(k_shm_path);
+    pid_t pid = spawn_server([]()
+                             {
+                                 Server server(LOOP_EPOLL);
+                                 int fd = server.init();
+                                 server.init_unix(k_unix_path);
+                                 server.init_shm(k_shm_path);
+                                 server.run_server(fd); });
+    close(kv_connect());
+
+    printf("%-5s %6s %6s %12s %8s %8s\n", "", "conns", "depth", "req/s", "p50 us", "p99 us");
+    for (int conns : {1, 4})
+    {
+        for (int depth : {1, 32})
+        {
+            for (int tr : {TR_TCP, TR_UNIX, TR_SHM})
+            {
+                LoadStats st = run(tr, conns, depth, secs);
+                printf("%-5s %6d %6d %12.0f %8.1f %8.1f\n", k_tr_names[tr], conns, depth,
+                       st.rps(), st.pct(0.5), st.pct(0.99));
+            }
+        }
+    }
+    stop_server(pid);
+    unlink(k_unix_path);
+    unlink(k_shm_path);
+    return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <deque>
+
+#include "buffer.h"
+
+/**
+ * bump allocator of a connection
+ *
+ * the blocks never move once handed out, everything is let go at once by
+ * reset(), which keeps the first block for the next round
+ */
+struct Arena
+{
+    std::deque<Buffer> blocks;
+
+    char *alloc(size_t n);
+    void reset();
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef ARGS_H
+#define ARGS_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * the args of one request, as views
+ *
+ * they point into the read-buffer of the conn, into its arena once the
+ * read-buffer has to move, or into own for the requests that were built
+ * apart, streamed ones and the ones sent to other shards
+ */
+struct Args
+{
+    std::vector<std::string_view> v;
+    std::vector<std::string> own;
+
+    size_t size() const { return v.size(); }
+    bool empty() const { return v.empty(); }
+    std::string_view operator[](size_t i) const { return v[i]; }
+    void push_back(std::string_view s) { v.push_back(s); }
+
+    void clear()
+    {
+        v.clear();
+        own.clear();
+    }
+
+    void swap(Args &other)
+    {
+        v.swap(other.v);
+        own.swap(other.own);
+    }
+
+    /**
+     * @brief takes the strings of strs as the args, strs gets the old ones
+     */
+    void adopt(std::vector<std::string> &strs)
+    {
+        own.swap(strs);
+        v.assign(own.begin(), own.end());
+    }
+
+    /**
+     * @return arg i as a string, moved out if it is owned
+     */
+    std::string take(size_t i)
+    {
+        if (!own.empty())
+        {
+            return std::move(own[i]);
+        }
+        return std::string(v[i]);
+    }
+};
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * growable byte buffer, appended to at the end
+ *
+ * the memory comes from a pool of power-of-2 size classes, so a buffer
+ * can start small, grow on demand and be handed back with release()
+ * when its connection goes idle
+ */
+struct Buffer
+{
+    uint8_t *data = NULL;
+    size_t size = 0;
+    size_t cap = 0;
+
+    Buffer() {}
+    Buffer(const Buffer &) = delete;
+    Buffer &operator=(const Buffer &) = delete;
+    ~Buffer();
+
+    void reserve(size_t n);
+    void append(const void *src, size_t n);
+    void clear();
+    void release();
+};
+
+#endif
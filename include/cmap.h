@@ -0,0 +1,52 @@
+#ifndef CMAP_H
+#define CMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+#include "constants.h"
+#include "./enums/bucket_enum.h"
+
+struct CNode
+{
+    std::atomic<uintptr_t> next{0}; // low bit set once the node is deleted
+    uint64_t hcode = 0;
+    uint64_t skey = 0; // position in the list, see cm_skey()
+};
+
+// a bucket is its dummy node, linked into the list on first use
+struct CBucket
+{
+    CNode dummy;
+    std::atomic<uint32_t> state{BUCKET_EMPTY};
+};
+
+/**
+ * hash map shared between threads, lookups take no lock
+ *
+ * every node sits in one list sorted by the bit-reversed hash (split
+ * ordering), a bucket is a dummy node in that list. doubling the buckets
+ * moves no node: a new bucket is linked in the middle of the list of its
+ * parent, the first time it is used
+ *
+ * inserts and pops link and unlink with CAS. every call must run between
+ * epoch_enter() and epoch_exit(), a popped node is the caller's and must
+ * go through epoch_retire()
+ */
+struct CMap
+{
+    CNode head; // dummy of bucket 0
+    std::atomic<size_t> buckets{k_cmap_min_buckets};
+    std::atomic<size_t> size{0};
+    // segment i > 0 holds buckets [2^(i-1), 2^i), allocated on first use
+    std::atomic<CBucket *> segs[64] = {};
+};
+
+CNode *cm_lookup(CMap *cmap, CNode *key, bool (*eq)(CNode *, CNode *));
+CNode *cm_insert(CMap *cmap, CNode *node, bool (*eq)(CNode *, CNode *));
+CNode *cm_pop(CMap *cmap, CNode *key, bool (*eq)(CNode *, CNode *));
+size_t cm_size(CMap *cmap);
+void cm_destroy(CMap *cmap);
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef CMD_TABLE_H
+#define CMD_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <strings.h>
+
+#include "./enums/cmd_enum.h"
+#include "./enums/cmd_flag_enum.h"
+#include "./enums/combine_enum.h"
+#include "./utils/string_utils.h"
+
+/**
+ * one command of the table
+ *
+ * the arity counts the name, max_args is 0 when there is no upper bound.
+ * the handlers are bound by each frontend, in an array indexed by id. a
+ * multi-key command has a handler per key instead, run wherever its key
+ * lives, and the results are merged by its combiner
+ */
+struct CmdSpec
+{
+    const char *name;
+    uint32_t id;
+    uint32_t min_args;
+    uint32_t max_args;
+    uint32_t flags;
+    uint32_t combine; // see combine_enum, COMBINE_NONE unless CMD_MULTIKEY
+};
+
+inline constexpr CmdSpec k_cmds[] = {
+    {"get", CMD_GET, 2, 2, 0, COMBINE_NONE},
+    {"set", CMD_SET, 3, 3, CMD_WRITE, COMBINE_NONE},
+    {"del", CMD_DEL, 2, 0, CMD_WRITE | CMD_MULTIKEY, COMBINE_SUM},
+    {"ping", CMD_PING, 1, 2, CMD_PROTO, COMBINE_NONE},
+    {"hello", CMD_HELLO, 1, 0, CMD_PROTO, COMBINE_NONE},
+    {"info", CMD_INFO, 1, 2, CMD_NOKEY, COMBINE_NONE},
+    {"exists", CMD_EXISTS, 2, 0, CMD_MULTIKEY, COMBINE_SUM},
+    {"mget", CMD_MGET, 2, 0, CMD_MULTIKEY, COMBINE_ARRAY},
+};
+
+constexpr bool cmd_ids_ok()
+{
+    for (size_t i = 0; i < sizeof(k_cmds) / sizeof(k_cmds[0]); i++)
+    {
+        if (k_cmds[i].id != i ||
+            ((k_cmds[i].flags & CMD_MULTIKEY) != 0) != (k_cmds[i].combine != COMBINE_NONE))
+        {
+            return false;
+        }
+    }
+    return sizeof(k_cmds) / sizeof(k_cmds[0]) == CMD_COUNT;
+}
+
+static_assert(cmd_ids_ok(), "k_cmds needs one entry per command, in cmd_enum order, "
+                            "and a combiner for the multi-key ones only");
+
+// at least twice the commands, so a collision-free seed is found quickly
+inline constexpr size_t k_cmd_slots = [] {
+    size_t n = 1;
+    while (n < 2 * CMD_COUNT)
+    {
+        n <<= 1;
+    }
+    return n;
+}();
+
+/**
+ * @brief FNV-1a over the case-folded name, mixed with its length
+ *
+ * the folding also maps a few non-letters together, the name is compared
+ * after the lookup anyway
+ */
+constexpr uint32_t cmd_hash(const char *s, size_t n, uint32_t seed)
+{
+    uint32_t h = seed ^ (uint32_t)n;
+    for (size_t i = 0; i < n; i++)
+    {
+        h = (h ^ (uint8_t)(s[i] | 0x20)) * 0x01000193;
+    }
+    return h ^ (h >> 15);
+}
+
+constexpr size_t cmd_name_len(const char *s)
+{
+    size_t n = 0;
+    while (s[n])
+    {
+        n++;
+    }
+    return n;
+}
+
+// perfect hash of the names, slot[] holds the command id + 1, 0 if empty
+struct CmdHash
+{
+    uint32_t seed = 0;
+    size_t max_len = 0;
+    uint8_t slot[k_cmd_slots] = {};
+};
+
+/**
+ * @brief searches a seed for which no two names share a slot, runs at
+ * compile time
+ */
+constexpr CmdHash cmd_hash_build()
+{
+    for (uint32_t seed = 1;; seed++)
+    {
+        CmdHash ph;
+        ph.seed = seed;
+        bool ok = true;
+        for (size_t i = 0; i < CMD_COUNT && ok; i++)
+        {
+            size_t len = cmd_name_len(k_cmds[i].name);
+            uint32_t s = cmd_hash(k_cmds[i].name, len, seed) & (k_cmd_slots - 1);
+            ok = ph.slot[s] == 0;
+            ph.slot[s] = (uint8_t)(i + 1);
+            ph.max_len = (len > ph.max_len) ? len : ph.max_len;
+        }
+        if (ok)
+        {
+            return ph;
+        }
+    }
+}
+
+inline constexpr CmdHash k_cmd_hash = cmd_hash_build();
+
+/**
+ * @brief finds a command by name, case-insensitive, in constant time
+ *
+ * @return its entry, NULL if the command is not recognized
+ */
+inline const CmdSpec *cmd_find(std::string_view name)
+{
+    if (name.size() > k_cmd_hash.max_len)
+    {
+        return NULL;
+    }
+    uint32_t h = cmd_hash(name.data(), name.size(), k_cmd_hash.seed);
+    uint8_t i = k_cmd_hash.slot[h & (k_cmd_slots - 1)];
+    if (i == 0 || !cmd_is(name, k_cmds[i - 1].name))
+    {
+        return NULL;
+    }
+    return &k_cmds[i - 1];
+}
+
+/**
+ * @param argc: number of args, the name included
+ */
+inline bool cmd_arity_ok(const CmdSpec *spec, size_t argc)
+{
+    return argc >= spec->min_args && (spec->max_args == 0 || argc <= spec->max_args);
+}
+
+#endif
@@ -1,23 +1,116 @@
 #ifndef CONN_H
 #define CONN_H
 
+#include <cstdint>
+#include <string>
+#include <vector>
+
 #include "./enums/state_enum.h"
+#include "./enums/proto_enum.h"
 #include "constants.h"
+#include "hashtable.h"
+#include "entry.h"
+#include "buffer.h"
+#include "arena.h"
+#include "args.h"
+#include "out_buf.h"
+#include "timer_wheel.h"
+
+struct ShmChannel;
+struct CmdSpec;
+
+// what one key of a multi-key command gave, see combine_enum
+struct KeyResult
+{
+    int64_t n = 0; // COMBINE_SUM
+    Value val;     // COMBINE_ARRAY, NULL for a missing key
+};
 
 class Conn
 {
 public:
     int fd = -1;
     uint32_t state = 0; // either STATE_REQ or STATE_RES
+    uint32_t interest = 0; // EV_* flags currently registered with the event loop
+    uint32_t proto = PROTO_NONE; // see proto_enum, detected from the first request
+    Timer timer;           // idle, read or write deadline
+
+    // work left this turn, a conn out of budget is continued on the next
+    // pass so one busy client can't hold the loop
+    size_t budget = 0;
+    size_t budget_bytes = 0;
+    size_t turn_requests = k_turn_requests; // budget given by new_turn()
+    size_t turn_bytes = k_turn_bytes;
+    bool queued = false; // waiting in the run queue of the server
 
-    size_t rbuf_size = 0;
-    uint8_t rbuf[4 + k_max_msg];
+    // set for clients on the shared memory rings, fd is then the eventfd
+    // they ring and the bytes go through the rings instead of a socket
+    ShmChannel *shm = NULL;
 
-    size_t wbuf_size = 0;
-    size_t wbuf_sent = 0;
-    uint8_t wbuf[4 + k_max_msg];
+    // bytes received, rbuf.data[rbuf_head..rbuf.size) are not parsed yet.
+    // requests are consumed in place, grows up to max_buf
+    Buffer rbuf;
+    size_t rbuf_head = 0;
+    size_t max_buf = k_max_client_buf;
+
+    // responses waiting to be sent, flushed together once per pass
+    OutBuf wbuf;
+    size_t resp_hdr = 0;   // where the header of the response being written is
+    size_t resp_start = 0; // wbuf.size() when that response was started
+
+    // shard-per-core mode: parts of the request still running on other shards
+    uint32_t pending = 0;
+    uint32_t pending_rescode = 0;
+    const CmdSpec *pending_multi = NULL; // the multi-key command waiting, NULL for the others
+    std::vector<KeyResult> pending_keys; // its results, in the order of its keys
+    OutBuf pending_res;
+    bool closing = false; // ended while parts were running, freed by the last reply
+
+    // requests parsed from rbuf, cmds[0..ncmds) are waiting to be run.
+    // their args point into rbuf, or into arena if rbuf had to move
+    // before they ran, the arena is reset once they all did
+    std::vector<Args> cmds;
+    size_t ncmds = 0;
+    Arena arena;
+
+    // a request too large to be buffered whole, its args are filled as
+    // the bytes arrive and it joins cmds once complete
+    struct
+    {
+        bool active = false;
+        uint32_t stage = 0;    // STREAM_* of stream_enum
+        uint32_t left = 0;     // bytes of the request not parsed yet
+        uint32_t nargs = 0;    // args not started yet
+        uint32_t arg_len = 0;  // declared length of cmd.back()
+        uint32_t arg_left = 0; // bytes missing from cmd.back()
+        std::vector<std::string> cmd;
+    } stream;
 
     void connection_io();
+    void new_turn();
+    bool yielded() const;
+    bool handle_request();
+    bool parse_request();
+    bool parse_stream();
+    bool parse_resp();
+    bool exec_requests();
+    void io_read();
+    void io_write();
+    void begin_response();
+    void end_response(uint32_t rescode);
+    void release_buffers();
+    void rbuf_room(size_t n);
+    void pin_args();
+    bool mid_request() const;
 };
 
+uint32_t exec_cmd(HMap *db, LookupKey &key, Args &cmd, OutBuf &out);
+void exec_keys(HMap *db, Args &cmd, const std::vector<uint64_t> &hcodes,
+               std::vector<KeyResult> &res);
+void combine_begin(const CmdSpec *spec, size_t nkeys, OutBuf &out);
+void combine_key(const CmdSpec *spec, const KeyResult &res, int64_t *sum, OutBuf &out);
+void combine_end(const CmdSpec *spec, int64_t sum, OutBuf &out);
+bool db_rehash(uint64_t budget_us);
+HMapStats db_stats();
+
 #endif
\ No newline at end of file
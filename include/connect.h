@@ -6,6 +6,7 @@
 #include <vector>
 #include "./enums/state_enum.h"
 #include "constants.h"
+#include "entry.h"
 
 class Connect
 {
@@ -13,7 +14,7 @@ public:
     uint32_t rescode = 0;
     size_t wbuf_size = 0;
     size_t wbuf_sent = 0;
-    std::string wbuf;
+    Value wbuf;
 
 public:
     void do_request(std::string);
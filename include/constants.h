@@ -2,10 +2,55 @@
 #define CONSTANTS_H
 
 #include <cstddef>
+#include <cstdint>
 
-const size_t k_max_msg = 4096;
+const size_t k_max_msg = 4096; // WebSocket frontend only, see k_max_client_buf
 const size_t k_max_args = 1024;
-const size_t k_resizing_work = 128;
-const size_t k_max_load_factor = 8;
+const size_t k_max_inline = 64 * 1024; // longest inline command of the RESP protocol
+const size_t k_max_client_buf = 512 * 1024 * 1024; // default largest request
+const size_t k_buf_min = 512;                      // smallest pooled buffer
+const size_t k_buf_classes = 12;                   // pooled sizes 512 B .. 1 MB
+const size_t k_buf_pool_max = 64;                  // free blocks kept per class per thread
+const size_t k_read_min = 4096;                    // room made in rbuf before a read
+const size_t k_arena_block = 4096;                 // args copied out of rbuf, see Arena
+const size_t k_stream_min = 64 * 1024;             // larger requests are parsed as they arrive
+const size_t k_stream_chunk = 256 * 1024;          // bytes read at once into a streamed arg
+const size_t k_zero_copy_min = 1024;              // GET replies this large reference the value
+const size_t k_max_iov = 64;                       // iovecs per writev
+const size_t k_wbuf_flush = 64 * 1024; // flush responses early past this many bytes
+const size_t k_max_pipeline = 1024;    // requests parsed ahead by an I/O thread
+const size_t k_resizing_work = 128; // slots of the old table moved per HMap call
+const size_t k_max_load_eighths = 7; // a table grows once 7/8 of its slots are used
+const size_t k_min_load_eighths = 1; // and shrinks once less than 1/8 hold a node
+const uint64_t k_rehash_idle_ms = 100;  // rehash cron period while no table resizes
+const uint64_t k_rehash_active_ms = 1;  // and while one does
+const uint64_t k_rehash_budget_us = 250; // rehash time per run on an idle server
+const uint64_t k_rehash_busy_us = 25;    // if requests came in since the last run
+const size_t k_db_stripe_bits = 6; // keyspace is split in 2^bits locked stripes
+const size_t k_cmap_min_buckets = 16; // initial buckets of a CMap
+const size_t k_cmap_max_load = 1;     // nodes per bucket before the buckets double
+const size_t k_epoch_batch = 64;      // retires between tries to advance the epoch
+const int k_listen_backlog = 65535; // capped by net.core.somaxconn
+const size_t k_accept_batch = 1024; // connections accepted per readiness event
+const size_t k_turn_requests = 128;       // requests a conn may run per turn
+const size_t k_turn_bytes = 1024 * 1024;  // bytes a conn may read per turn
+const size_t k_io_threads_min_batch = 4; // smaller batches skip the I/O threads
+const size_t k_shard_queue_size = 4096; // messages in flight between two shards, power of 2
+
+// timers, in ms, 0 disables a timeout
+const uint32_t k_wheel_bits = 6;   // 64 slots per level
+const uint32_t k_wheel_levels = 4; // 1 ms tick, the last level spans 4.6 hours
+const uint64_t k_idle_timeout_ms = 300 * 1000; // nothing received nor pending
+const uint64_t k_read_timeout_ms = 30 * 1000;  // to receive the rest of a request
+const uint64_t k_write_timeout_ms = 30 * 1000; // for the client to take the responses
+
+// shared memory transport
+const size_t k_shm_ring_size = 1 << 20; // bytes per direction, power of 2
+const uint32_t k_shm_spin = 1024;       // polls of an empty ring before sleeping
+
+// io_uring backend
+const unsigned k_uring_entries = 4096;
+const uint32_t k_uring_bufs = 1024; // provided read buffers, power of 2
+const uint32_t k_uring_buf_size = 4096;
 
 #endif
\ No newline at end of file
@@ -2,14 +2,58 @@
 #define ENTRY_H
 
 #include <string.h>
+#include <memory>
+#include <string>
+#include <string_view>
 
 #include "hashtable.h"
+#include "cmap.h"
+#include "hash.h"
+
+// values are immutable once stored and shared with the responses sending
+// them, a SET swaps in a new one instead of writing over the old bytes
+typedef std::shared_ptr<const std::string> Value;
 
 struct Entry
 {
     struct HNode node;
     std::string key;
-    std::string val;
+    Value val;
+};
+
+/**
+ * what the entries are compared with on a lookup, the key is not copied
+ *
+ * the hash is computed once per request, it also picks the stripe or the
+ * shard owning the key
+ */
+struct LookupKey
+{
+    HNode node;
+    std::string_view key;
+
+    explicit LookupKey(std::string_view k) : key(k)
+    {
+        node.hcode = str_hash((const uint8_t *)k.data(), k.size());
+    }
+
+    // hashed already, by the shard that received the request
+    LookupKey(std::string_view k, uint64_t hcode) : key(k)
+    {
+        node.hcode = hcode;
+    }
+};
+
+/**
+ * entry of a CMap, reached by several threads at once: val is read and
+ * swapped with std::atomic_load() and std::atomic_store(), the entry is
+ * freed through epoch_retire()
+ */
+struct CEntry
+{
+    struct CNode node;
+    std::string key;
+    Value val;
 };
 
 #endif
\ No newline at end of file
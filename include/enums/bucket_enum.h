@@ -0,0 +1,12 @@
+#ifndef BUCKET_ENUM_H
+#define BUCKET_ENUM_H
+
+// state of a CBucket
+enum
+{
+	BUCKET_EMPTY = 0,
+	BUCKET_LINKING = 1, // one thread is linking the dummy into the list
+	BUCKET_READY = 2,
+};
+
+#endif
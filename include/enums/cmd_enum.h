@@ -0,0 +1,18 @@
+#ifndef CMD_H
+#define CMD_H
+
+// commands of the command table, the values index it
+enum
+{
+	CMD_GET = 0,
+	CMD_SET = 1,
+	CMD_DEL = 2,
+	CMD_PING = 3,
+	CMD_HELLO = 4,
+	CMD_INFO = 5,
+	CMD_EXISTS = 6,
+	CMD_MGET = 7,
+	CMD_COUNT = 8, // number of commands, not a command
+};
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef CMD_FLAG_H
+#define CMD_FLAG_H
+
+// properties of a command, or-ed in its table entry
+enum
+{
+	CMD_WRITE = 1, // modifies the keyspace
+	CMD_MULTIKEY = 2, // every arg after the name is a key
+	CMD_PROTO = 4, // part of the RESP protocol, answered by the conn itself
+	CMD_NOKEY = 8, // about the server, run where the conn is, without a key
+};
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef COMBINE_H
+#define COMBINE_H
+
+// how the per-key results of a multi-key command make up its reply
+enum
+{
+	COMBINE_NONE = 0, // single-key command, its handler replies itself
+	COMBINE_SUM = 1, // integer reply, the sum of the per-key results
+	COMBINE_ARRAY = 2, // array reply, the value of every key or nil
+};
+
+#endif
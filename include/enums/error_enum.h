@@ -1,10 +1,11 @@
-#ifndef RES_H
-#define RES_H
+#ifndef ERROR_H
+#define ERROR_H
 
 enum
 {
     ERR_UNKNOWN = 1,
     ERR_2BIG = 2,
+    ERR_NOPROTO = 3, // HELLO with a protocol version that is not spoken
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,11 @@
+#ifndef HASH_ENUM_H
+#define HASH_ENUM_H
+
+// function behind str_hash(), see hash_set_mode()
+enum
+{
+	HASH_FAST = 0, // multiply-mix over 16 bytes per step, seeded
+	HASH_SIP = 1, // SipHash-2-4 with a secret key, for untrusted clients
+};
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef LOOP_H
+#define LOOP_H
+
+// event loop backends
+enum
+{
+    LOOP_EPOLL = 0,
+    LOOP_POLL = 1,
+    LOOP_URING = 2, // completion based, falls back to epoll if unavailable
+};
+
+// readiness flags reported by / registered with an event loop
+enum
+{
+    EV_READ = 1,
+    EV_WRITE = 2,
+    EV_ERR = 4,
+    EV_EDGE = 8, // edge-triggered, only honoured by the epoll backend
+};
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef PROTO_H
+#define PROTO_H
+
+// wire protocol of a connection, detected from its first bytes
+enum
+{
+	PROTO_NONE = 0, // nothing received yet
+	PROTO_BIN = 1, // u32 length, u32 argc, then length-prefixed args
+	PROTO_RESP2 = 2, // Redis serialization protocol, or inline commands
+	PROTO_RESP3 = 3, // RESP2 plus the RESP3 types, after HELLO 3
+};
+
+#endif
@@ -6,6 +6,7 @@ enum
 	STATE_REQ = 0,
 	STATE_RES = 1,
 	STATE_END = 2,
+	STATE_WAIT = 3, // waiting for other shards to run the request
 };
 
 #endif
\ No newline at end of file
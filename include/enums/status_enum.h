@@ -4,7 +4,8 @@
 enum
 {
     SUCCESS = 1,
-    FAILED = -1
+    FAILED = -1,
+    DEFERRED = 2
 };
 
 #endif
\ No newline at end of file
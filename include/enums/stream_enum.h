@@ -0,0 +1,12 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+// what a streamed request expects next
+enum
+{
+	STREAM_ARGC = 0, // number of args
+	STREAM_ARGLEN = 1, // length of the next arg
+	STREAM_ARG = 2, // bytes of the current arg
+};
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <stdint.h>
+
+/**
+ * epoch-based reclamation of memory shared between threads
+ *
+ * readers run between epoch_enter() and epoch_exit() and may use any
+ * node they reach meanwhile. a removed node is handed to epoch_retire()
+ * once it can no longer be reached, it is freed after every thread that
+ * was inside at that time has left
+ */
+void epoch_enter();
+void epoch_exit();
+bool epoch_active();
+void epoch_retire(void *ptr, void (*free_fn)(void *));
+
+// epoch_enter() for the lifetime of the guard, nesting is allowed
+struct EpochGuard
+{
+    EpochGuard() { epoch_enter(); }
+    ~EpochGuard() { epoch_exit(); }
+    EpochGuard(const EpochGuard &) = delete;
+    EpochGuard &operator=(const EpochGuard &) = delete;
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <vector>
+#include <cstdint>
+#include <poll.h>
+#include <sys/epoll.h>
+
+#include "./enums/loop_enum.h"
+
+struct Event
+{
+    int fd = -1;
+    uint32_t events = 0; // EV_READ | EV_WRITE | EV_ERR
+};
+
+class EventLoop
+{
+public:
+    virtual ~EventLoop() {}
+
+    virtual int add(int fd, uint32_t events) = 0;
+    virtual int mod(int fd, uint32_t events) = 0;
+    virtual int del(int fd) = 0;
+    virtual int wait(std::vector<Event> &out, int timeout_ms) = 0;
+
+    static EventLoop *create(uint32_t type);
+};
+
+class EpollLoop : public EventLoop
+{
+private:
+    int epfd = -1;
+    std::vector<struct epoll_event> ready;
+
+public:
+    EpollLoop();
+    ~EpollLoop();
+    int add(int fd, uint32_t events);
+    int mod(int fd, uint32_t events);
+    int del(int fd);
+    int wait(std::vector<Event> &out, int timeout_ms);
+};
+
+class PollLoop : public EventLoop
+{
+private:
+    std::vector<struct pollfd> pfds;
+    std::vector<int> fd2idx; // fd -> index into pfds, -1 if not registered
+
+public:
+    int add(int fd, uint32_t events);
+    int mod(int fd, uint32_t events);
+    int del(int fd);
+    int wait(std::vector<Event> &out, int timeout_ms);
+};
+
+#endif
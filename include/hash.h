@@ -0,0 +1,13 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./enums/hash_enum.h"
+
+void hash_set_mode(uint32_t mode);
+void hash_set_seeds(uint64_t seed, const uint64_t sip[2]);
+uint64_t str_hash(const uint8_t *data, size_t len);
+
+#endif
@@ -6,28 +6,55 @@
 
 struct HNode
 {
-	HNode *next = NULL;
 	uint64_t hcode = 0;
 };
 
+/**
+ * open addressing table of HNode*, probed 16 slots at a time
+ *
+ * every slot has a control byte: EMPTY, DELETED or the 7-bit tag of the
+ * hash of its node, so most slots are ruled out without touching their
+ * node. the first 16 control bytes are repeated after the last one, a
+ * probe can then load 16 of them from any slot
+ */
 struct HTable
 {
-	HNode **table = NULL; // array of HNode*
+	uint8_t *ctrl = NULL; // mask + 1 + 16 control bytes
+	HNode **slots = NULL;
 	size_t mask = 0;
-	size_t size = 0;
+	size_t size = 0; // live nodes
+	size_t used = 0; // slots that are not EMPTY, DELETED ones included
 };
 
+/**
+ * two tables while resizing, the nodes are moved from ht_secondary to
+ * ht_primary a few at a time by every insert, and by hm_rehash()
+ */
 struct HMap
 {
 	HTable ht_primary;
 	HTable ht_secondary;
 	size_t resizing_pos = 0;
+	uint64_t resizes = 0;   // resizes started
+	uint64_t rehash_us = 0; // time spent in hm_rehash()
+};
+
+// see hm_stats()
+struct HMapStats
+{
+	size_t size = 0;
+	bool resizing = false;
+	uint32_t progress = 0; // percent of the old table moved so far
+	uint64_t resizes = 0;
+	uint64_t rehash_us = 0;
 };
 
 HNode *hm_lookup(HMap *hmap, HNode *key, bool (*eq)(HNode *, HNode *));
 void hm_insert(HMap *hmap, HNode *node);
 HNode *hm_pop(HMap *hmap, HNode *key, bool (*eq)(HNode *, HNode *));
 size_t hm_size(HMap *hmap);
+bool hm_rehash(HMap *hmap, uint64_t budget_us);
+HMapStats hm_stats(HMap *hmap);
 void hm_destroy(HMap *hmap);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,43 @@
+#ifndef IO_THREADS_H
+#define IO_THREADS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "conn.h"
+
+/**
+ * pool of threads doing the socket I/O and parsing of a batch of conns
+ *
+ * the main thread hands a batch over with run(), takes a share of it
+ * itself and returns once every thread is done, so the conns are only
+ * ever touched by one thread at a time
+ */
+class IoThreads
+{
+private:
+    std::vector<std::thread> threads;
+    std::mutex mu;
+    std::condition_variable cv;
+    uint64_t gen = 0; // bumped for every batch
+    bool stopping = false;
+
+    std::vector<Conn *> *batch = NULL;
+    void (Conn::*fn)() = NULL;
+    std::atomic<uint32_t> remaining{0};
+
+    void worker(uint32_t id);
+    void run_share(uint32_t id);
+
+public:
+    explicit IoThreads(uint32_t n_threads);
+    ~IoThreads();
+
+    void run(std::vector<Conn *> &conns, void (Conn::*fn)());
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef OUT_BUF_H
+#define OUT_BUF_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <sys/uio.h>
+
+#include "buffer.h"
+#include "entry.h"
+#include "./enums/proto_enum.h"
+
+// a stored value sent by reference, right before buf.data[off]
+struct OutRef
+{
+    size_t off = 0;
+    Value val;
+};
+
+/**
+ * outgoing bytes of a connection
+ *
+ * small payloads are copied into buf, large values are only referenced so
+ * a GET does not copy them, the reference keeps the value alive until it
+ * is sent even if the key is overwritten meanwhile. the bytes are sent in
+ * order with writev, from a cursor that remembers how much went out
+ */
+struct OutBuf
+{
+    Buffer buf;
+    std::vector<OutRef> refs;
+    size_t refs_len = 0; // bytes held by refs
+    uint32_t proto = PROTO_BIN; // encoding of the reply_*() calls, see proto_enum
+
+    // binary protocol, elements still expected by each open array
+    std::vector<size_t> arr_left;
+
+    // send cursor
+    size_t sent = 0;     // bytes of buf sent
+    size_t ref_done = 0; // refs fully sent
+    size_t ref_sent = 0; // bytes sent of refs[ref_done]
+
+    size_t size() const { return buf.size + refs_len; }
+    bool empty() const { return buf.size == 0 && refs.empty(); }
+    bool all_sent() const { return sent == buf.size && ref_done == refs.size(); }
+
+    void append(const void *src, size_t n);
+    void append_value(const Value &val);
+    void splice(OutBuf &other);
+
+    // typed replies, the binary protocol has the rescode in its header so
+    // nil, status and integer replies carry no payload there
+    void reply_nil();
+    void reply_status(const char *s);
+    void reply_int(int64_t n);
+    void reply_str(const char *s, size_t n);
+    void reply_value(const Value &val);
+    void reply_err(uint32_t code, const char *msg);
+    void reply_arr(size_t n);
+    void reply_map(size_t n);
+
+    size_t unsent() const;
+    size_t iov(struct iovec *iov, size_t max) const;
+    void consume(size_t n);
+    void clear();
+
+private:
+    bool tagged() const { return this->proto == PROTO_BIN && !this->arr_left.empty(); }
+    void elem_done();
+};
+
+#endif
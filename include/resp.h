@@ -0,0 +1,13 @@
+#ifndef RESP_H
+#define RESP_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "args.h"
+
+bool resp_detect(const uint8_t *data, size_t avail, uint32_t *proto);
+int64_t resp_parse(const uint8_t *data, size_t avail, size_t max_len,
+                   Args &out, size_t *need);
+
+#endif
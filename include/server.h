@@ -2,24 +2,95 @@
 #define SERVER_H
 
 #include <vector>
+#include <string>
 #include <cstdint>
-#include <poll.h>
 
 #include "./conn.h"
+#include "./event_loop.h"
+#include "./shard.h"
+#include "./io_threads.h"
+#include "./timer_wheel.h"
+
+// how long a connection may wait on its client, in ms, 0 disables
+struct Timeouts
+{
+    uint64_t idle_ms = k_idle_timeout_ms;
+    uint64_t read_ms = k_read_timeout_ms;
+    uint64_t write_ms = k_write_timeout_ms;
+};
+
+// a task run every interval_ms by the event loop
+struct Periodic
+{
+    Timer timer;
+    TimerWheel *wheel = NULL;
+    uint64_t interval_ms = 0;
+    void (*fn)(void *) = NULL;
+    void *arg = NULL;
+};
+
+Conn *conn_new(int fd, size_t max_buf = k_max_client_buf);
+void set_no_delay(int fd);
+void conn_put(std::vector<Conn *> &fd2conn, struct Conn *conn);
+uint64_t conn_timeout(const Conn *conn, const Timeouts &timeouts);
+void on_periodic(Timer *timer, void *ctx);
 
 class Server
 {
 private:
     std::vector<Conn *> fd2conn;
-    std::vector<struct pollfd> poll_args;
+    uint32_t loop_type;
+    EventLoop *loop = NULL;
+    Shard *shard = NULL; // set in shard-per-core mode
+    IoThreads *io_threads = NULL;
+    size_t max_client_buf = k_max_client_buf;
+    size_t turn_requests = k_turn_requests;
+    size_t turn_bytes = k_turn_bytes;
+    TimerWheel timers;
+    Timeouts timeouts;
+    std::vector<Periodic *> periodic;
+    uint64_t now_ms = 0; // monotonic_ms() after the last wait
+    std::vector<int> runq; // fds of conns out of budget, continued next pass
+    Periodic *rehash_task = NULL; // see on_rehash()
+    uint64_t served = 0; // events handled since the last rehash run
+
+    int backlog = k_listen_backlog;
+    int unix_fd = -1; // extra listener, see init_unix()
+    std::string unix_path;
+    int shm_fd = -1; // listener of the shared memory clients, see init_shm()
+    std::string shm_path;
 
     int32_t accept_new_conn(int);
+    int32_t accept_one(int);
+    int32_t accept_shm(int);
+    void update_interest(Conn *);
+    void destroy_conn(Conn *);
+    bool run_uring(int);
+    void resume_conns(std::vector<Conn *> &);
+    void run_batch(std::vector<Conn *> &);
+    void finish_conn(Conn *);
+    void serve_conn(Conn *, std::vector<Conn *> &);
+    void arm_timer(Conn *);
+    static void on_conn_timer(Timer *, void *);
+    static void on_rehash(void *);
 
 public:
-    Server();
-    int init();
+    Server(uint32_t loop_type = LOOP_EPOLL);
+    ~Server();
+    int init(bool reuse_port = false);
+    int init_unix(const char *path);
+    int init_shm(const char *path);
     int set_non_blocking(int);
+    void set_io_threads(uint32_t n_threads);
+    void set_client_buf_limit(size_t max_buf);
+    void set_turn_budget(size_t requests, size_t bytes);
+    void set_backlog(int n);
+    void set_timeouts(uint64_t idle_ms, uint64_t read_ms, uint64_t write_ms);
+    void add_periodic(uint64_t interval_ms, void (*fn)(void *), void *arg);
     void run_server(int);
+
+    static void run_reactors(uint32_t n_reactors, uint32_t loop_type = LOOP_EPOLL);
+    static void run_shards(uint32_t n_shards, uint32_t loop_type = LOOP_EPOLL);
 };
 
 #endif
\ No newline at end of file
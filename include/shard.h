@@ -0,0 +1,58 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+
+#include "conn.h"
+#include "hashtable.h"
+#include "spsc_queue.h"
+
+enum
+{
+    MSG_REQ = 0, // command to run on the owning shard
+    MSG_RES = 1, // its result, on the way back to the connection's shard
+};
+
+struct ShardMsg
+{
+    uint32_t type = MSG_REQ;
+    uint32_t from = 0; // shard owning the connection
+    Conn *conn = NULL; // only dereferenced on the `from` shard
+    std::vector<std::string> cmd; // copied, the args of the conn don't outlive its turn
+    std::vector<uint64_t> hcodes; // hash of every key in cmd, computed by the sender
+    uint32_t rescode = 0;
+    std::vector<uint32_t> pos;    // multi-key: where each key of cmd is in the request
+    std::vector<KeyResult> keys;  // and its result on the owning shard
+    OutBuf res;
+};
+
+/**
+ * one core's slice of the keyspace
+ *
+ * the HMap is only touched by the shard's own thread, other shards reach
+ * it by sending a ShardMsg through the SPSC queue they own in inbox
+ */
+struct Shard
+{
+    uint32_t id = 0;
+    int efd = -1; // eventfd, rung when messages are queued in inbox
+    HMap db;
+    std::vector<SpscQueue<ShardMsg *> *> inbox;   // inbox[from], NULL for self
+    std::vector<std::deque<ShardMsg *>> backlog; // per destination, when its queue is full
+    std::vector<bool> wake;                      // destinations to ring on flush
+};
+
+// shard of the calling thread, NULL when not running in shard mode
+extern thread_local Shard *tls_shard;
+
+void shards_init(uint32_t n_shards);
+Shard *shard_get(uint32_t id);
+int32_t shard_dispatch(Conn *conn, const CmdSpec *spec, Args &cmd,
+                       uint32_t *rescode, OutBuf &out);
+void shard_drain(Shard *shard, std::vector<Conn *> &done);
+bool shard_flush(Shard *shard);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef SHM_CLIENT_H
+#define SHM_CLIENT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "shm_ring.h"
+
+/**
+ * same-host client talking to a Server::init_shm() listener
+ *
+ * requests and responses use the socket framing, only the transport is
+ * the pair of shared rings. the calls block, spinning first
+ */
+class ShmClient
+{
+    ShmRegion *region = NULL;
+    int sock = -1;
+    int efd_srv = -1;
+    int efd_cli = -1;
+
+    void put(const void *src, size_t n);
+    void get(void *dst, size_t n);
+
+public:
+    ~ShmClient();
+    int connect(const char *path);
+    void send(const std::vector<std::string> &cmd);
+    uint32_t recv(std::string &res);
+    uint32_t request(const std::vector<std::string> &cmd, std::string &res);
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "constants.h"
+
+/**
+ * byte ring shared by one producer and one consumer process
+ *
+ * it carries the same length-prefixed frames as a socket, a frame may be
+ * split over several writes. a side that finds nothing to do sets its
+ * waiting flag before it sleeps on an eventfd, the other side only rings
+ * the eventfd when it sees the flag, so a busy pair never makes a syscall
+ */
+struct ShmRing
+{
+    alignas(64) std::atomic<uint64_t> head; // bytes consumed
+    alignas(64) std::atomic<uint64_t> tail; // bytes produced
+    alignas(64) std::atomic<uint32_t> cons_waiting; // consumer sleeps until data comes
+    std::atomic<uint32_t> prod_waiting;             // producer sleeps until room is made
+    alignas(64) uint8_t data[k_shm_ring_size];
+};
+
+// the shared mapping, requests go client to server, responses back
+struct ShmRegion
+{
+    ShmRing req;
+    ShmRing res;
+};
+
+// server side of a shared memory connection
+struct ShmChannel
+{
+    ShmRegion *region = NULL;
+    int sock = -1;    // unix socket of the handshake, EOF means the client left
+    int efd_srv = -1; // rung by the client, requests or room in res
+    int efd_cli = -1; // rung by the server, responses or room in req
+    bool closed = false; // the client left, reads get EOF once req is drained
+};
+
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+uint32_t shm_spin_limit();
+ssize_t shm_ring_write(ShmRing *ring, const void *src, size_t n);
+ssize_t shm_ring_read(ShmRing *ring, void *dst, size_t n);
+bool shm_ring_wait(ShmRing *ring, bool producer);
+void shm_ring_wake(ShmRing *ring, bool producer, int efd);
+
+ShmChannel *shm_channel_new(int sock);
+void shm_channel_free(ShmChannel *ch);
+ssize_t shm_recv(ShmChannel *ch, void *dst, size_t n);
+ssize_t shm_sendv(ShmChannel *ch, const struct iovec *iov, int cnt);
+bool shm_peer_closed(ShmChannel *ch);
+
+#endif
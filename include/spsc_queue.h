@@ -0,0 +1,65 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/**
+ * bounded lock-free queue for exactly one producer and one consumer thread
+ *
+ * head and tail live on their own cache lines and each side caches the
+ * other side's index, so the shared lines are only read when the cached
+ * value says the queue looks full (producer) or empty (consumer)
+ */
+template <typename T>
+class SpscQueue
+{
+private:
+    std::vector<T> slots;
+    size_t mask;
+
+    alignas(64) std::atomic<size_t> head{0}; // next slot to pop, written by consumer
+    size_t tail_cache = 0;                   // consumer's view of tail
+
+    alignas(64) std::atomic<size_t> tail{0}; // next slot to push, written by producer
+    size_t head_cache = 0;                   // producer's view of head
+
+public:
+    // capacity must be a power of 2
+    explicit SpscQueue(size_t capacity) : slots(capacity), mask(capacity - 1) {}
+
+    bool push(const T &item)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head_cache > mask)
+        {
+            head_cache = head.load(std::memory_order_acquire);
+            if (t - head_cache > mask)
+            {
+                return false; // full
+            }
+        }
+        slots[t & mask] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &item)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail_cache)
+        {
+            tail_cache = tail.load(std::memory_order_acquire);
+            if (h == tail_cache)
+            {
+                return false; // empty
+            }
+        }
+        item = slots[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+#endif
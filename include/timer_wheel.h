@@ -0,0 +1,60 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "constants.h"
+
+struct Timer;
+typedef void (*timer_fn)(Timer *, void *ctx);
+
+/**
+ * a timer linked in one slot of the wheel, embedded in its owner and
+ * found back with container_of
+ */
+struct Timer
+{
+    Timer *prev = NULL;
+    Timer *next = NULL;
+    uint64_t expire = 0; // ms, monotonic clock
+    uint8_t level = 0;
+    uint8_t slot = 0;
+    timer_fn fn = NULL;
+
+    bool linked() const { return next != NULL; }
+};
+
+/**
+ * hierarchical timer wheel with a 1 ms tick
+ *
+ * every level has 64 slots, each slot of level L spans 64^L ticks, so
+ * adding and removing a timer is O(1) and timers only move down a level
+ * when their slot comes up. a bitmap of non-empty slots per level gives
+ * the next deadline without walking the slots
+ */
+class TimerWheel
+{
+private:
+    Timer slots[k_wheel_levels][1 << k_wheel_bits]; // list heads
+    uint64_t occupied[k_wheel_levels] = {};
+    uint64_t cur = 0; // next tick to run
+    size_t count = 0;
+
+    void link(Timer *t);
+    void unlink(Timer *t);
+    void cascade(uint32_t level);
+
+public:
+    explicit TimerWheel(uint64_t now);
+
+    void add(Timer *t, uint64_t expire, timer_fn fn);
+    void del(Timer *t);
+    void advance(uint64_t now, void *ctx);
+    int timeout_ms(uint64_t now, int max_ms) const;
+};
+
+uint64_t monotonic_ms();
+uint64_t monotonic_us();
+
+#endif
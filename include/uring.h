@@ -0,0 +1,63 @@
+#ifndef URING_H
+#define URING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <linux/io_uring.h>
+
+/**
+ * minimal io_uring wrapper on top of the raw syscalls
+ *
+ * only what the server needs: getting SQEs, submitting them in one
+ * io_uring_enter() per loop pass, reaping CQEs and one provided buffer ring
+ */
+class Uring
+{
+private:
+    int ring_fd = -1;
+
+    // submission queue
+    void *sq_ptr = NULL;
+    size_t sq_len = 0;
+    unsigned *sq_head = NULL;
+    unsigned *sq_tail = NULL;
+    unsigned *sq_mask = NULL;
+    unsigned *sq_array = NULL;
+    struct io_uring_sqe *sqes = NULL;
+    size_t sqes_len = 0;
+    unsigned sq_pending = 0; // SQEs filled but not yet submitted
+    unsigned sq_local_tail = 0;
+
+    // completion queue
+    void *cq_ptr = NULL;
+    size_t cq_len = 0;
+    unsigned *cq_head = NULL;
+    unsigned *cq_tail = NULL;
+    unsigned *cq_mask = NULL;
+    struct io_uring_cqe *cqes = NULL;
+
+    // provided buffer ring
+    struct io_uring_buf_ring *br = NULL;
+    size_t br_len = 0;
+    uint8_t *br_mem = NULL;
+    uint32_t br_entries = 0;
+    uint32_t br_buf_size = 0;
+    uint16_t br_tail = 0;
+
+public:
+    ~Uring();
+
+    int init(unsigned entries);
+    int setup_buf_ring(uint16_t bgid, uint32_t entries, uint32_t buf_size);
+
+    struct io_uring_sqe *get_sqe();
+    int submit_and_wait(unsigned wait_nr);
+
+    struct io_uring_cqe *peek_cqe();
+    void cqe_seen();
+
+    uint8_t *buf_addr(uint16_t bid);
+    void buf_recycle(uint16_t bid);
+};
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef STATS_UTILS_H
+#define STATS_UTILS_H
+
+#include <stdint.h>
+#include <atomic>
+
+/**
+ * syscalls made on the request path: the waits of the event loops and
+ * their registrations, io_uring_enter(), socket reads and writes, accepts
+ * and the eventfds between shards. reported by INFO, so benchmarks can
+ * tell syscalls per request
+ */
+inline std::atomic<uint64_t> g_syscalls{0};
+
+static inline void count_syscall()
+{
+    g_syscalls.fetch_add(1, std::memory_order_relaxed);
+}
+
+#endif
@@ -1,19 +1,20 @@
 #ifndef STRING_UTILS_H
 #define STRING_UTILS_H
 
-static uint64_t str_hash(const uint8_t *data, size_t len)
-{
-    uint32_t h = 0x811C9DC5;
-    for (size_t i = 0; i < len; i++)
-    {
-        h = (h + data[i]) * 0x01000193;
-    }
-    return h;
-}
+#include <string.h>
+#include <strings.h>
+#include <string_view>
+
+#include "../hash.h"
 
-static bool cmd_is(const std::string &word, const char *cmd)
+/**
+ * @brief case-insensitive comparison of a received word with a command
+ * name, the lengths first so neither side is read past its end
+ */
+static bool cmd_is(std::string_view word, const char *cmd)
 {
-    return 0 == strcasecmp(word.c_str(), cmd);
+    size_t n = strlen(cmd);
+    return word.size() == n && 0 == strncasecmp(word.data(), cmd, n);
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -10,7 +10,6 @@ class WebSocketServer
 private:
     static crow::SimpleApp *app;
     static std::unordered_set<crow::websocket::connection *> users;
-    static Connect *connect;
 
     WebSocketServer(){};
 
@@ -0,0 +1,30 @@
+#include "../include/arena.h"
+#include "../include/constants.h"
+
+/**
+ * @brief hands out n bytes, valid until the next reset()
+ */
+char *Arena::alloc(size_t n)
+{
+    if (this->blocks.empty() || this->blocks.back().cap - this->blocks.back().size < n)
+    {
+        this->blocks.emplace_back();
+        this->blocks.back().reserve((n > k_arena_block) ? n : k_arena_block);
+    }
+    Buffer &b = this->blocks.back();
+    char *p = (char *)&b.data[b.size];
+    b.size += n;
+    return p;
+}
+
+void Arena::reset()
+{
+    while (this->blocks.size() > 1)
+    {
+        this->blocks.pop_back();
+    }
+    if (!this->blocks.empty())
+    {
+        this->blocks.front().clear();
+    }
+}
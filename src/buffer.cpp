@@ -0,0 +1,150 @@
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "../include/buffer.h"
+#include "../include/constants.h"
+#include "../include/utils/print_utils.h"
+
+/**
+ * free blocks of every size class, class i holds blocks of k_buf_min << i
+ * bytes. the pool is per thread so no lock is needed, a block freed on
+ * another thread than the one which allocated it just changes pool
+ */
+struct BufferPool
+{
+    std::vector<uint8_t *> free_list[k_buf_classes];
+
+    ~BufferPool()
+    {
+        for (std::vector<uint8_t *> &list : free_list)
+        {
+            for (uint8_t *block : list)
+            {
+                free(block);
+            }
+        }
+    }
+};
+
+static thread_local BufferPool tls_pool;
+
+/**
+ * @brief finds the smallest size class holding n bytes
+ *
+ * @return the class, k_buf_classes if n is too big to be pooled
+ */
+static size_t class_of(size_t n)
+{
+    size_t cls = 0;
+    while (cls < k_buf_classes && (k_buf_min << cls) < n)
+    {
+        cls++;
+    }
+    return cls;
+}
+
+/**
+ * @brief gets a block of at least n bytes
+ *
+ * @param *cap: set to the real size of the block
+ */
+static uint8_t *pool_get(size_t n, size_t *cap)
+{
+    size_t cls = class_of(n);
+    if (cls == k_buf_classes)
+    {
+        *cap = n;
+        return (uint8_t *)malloc(n);
+    }
+
+    *cap = k_buf_min << cls;
+    std::vector<uint8_t *> &list = tls_pool.free_list[cls];
+    if (list.empty())
+    {
+        return (uint8_t *)malloc(*cap);
+    }
+    uint8_t *block = list.back();
+    list.pop_back();
+    return block;
+}
+
+static void pool_put(uint8_t *block, size_t cap)
+{
+    if (!block)
+    {
+        return;
+    }
+
+    size_t cls = class_of(cap);
+    if (cls == k_buf_classes || (k_buf_min << cls) != cap ||
+        tls_pool.free_list[cls].size() >= k_buf_pool_max)
+    {
+        free(block);
+        return;
+    }
+    tls_pool.free_list[cls].push_back(block);
+}
+
+Buffer::~Buffer()
+{
+    pool_put(data, cap);
+}
+
+/**
+ * @brief makes room for at least n more bytes after size
+ *
+ * the capacity is at least doubled so appending is amortized O(1)
+ *
+ * @param n: number of bytes about to be appended
+ */
+void Buffer::reserve(size_t n)
+{
+    if (cap - size >= n)
+    {
+        return;
+    }
+
+    size_t want = size + n;
+    if (want < cap * 2)
+    {
+        want = cap * 2;
+    }
+
+    size_t ncap = 0;
+    uint8_t *ndata = pool_get(want, &ncap);
+    if (!ndata)
+    {
+        die("malloc()");
+    }
+    if (size)
+    {
+        memcpy(ndata, data, size);
+    }
+    pool_put(data, cap);
+    data = ndata;
+    cap = ncap;
+}
+
+void Buffer::append(const void *src, size_t n)
+{
+    reserve(n);
+    memcpy(&data[size], src, n);
+    size += n;
+}
+
+void Buffer::clear()
+{
+    size = 0;
+}
+
+/**
+ * @brief hands the memory back to the pool, the buffer must be empty
+ */
+void Buffer::release()
+{
+    pool_put(data, cap);
+    data = NULL;
+    size = 0;
+    cap = 0;
+}
@@ -0,0 +1,304 @@
+#include <assert.h>
+
+#include "../include/cmap.h"
+#include "../include/epoch.h"
+
+typedef bool (*cm_eq)(CNode *, CNode *);
+
+static const uintptr_t k_mark = 1; // in CNode::next, the node is deleted
+
+static CNode *cm_ptr(uintptr_t link)
+{
+    return (CNode *)(link & ~k_mark);
+}
+
+static bool cm_marked(uintptr_t link)
+{
+    return (link & k_mark) != 0;
+}
+
+static uint64_t bit_reverse(uint64_t x)
+{
+    x = ((x >> 1) & 0x5555555555555555ull) | ((x & 0x5555555555555555ull) << 1);
+    x = ((x >> 2) & 0x3333333333333333ull) | ((x & 0x3333333333333333ull) << 2);
+    x = ((x >> 4) & 0x0F0F0F0F0F0F0F0Full) | ((x & 0x0F0F0F0F0F0F0F0Full) << 4);
+    return __builtin_bswap64(x);
+}
+
+/**
+ * the list is sorted by the reversed hash, so the nodes of bucket b are
+ * found together and the ones of 2b and 2b + 1 are its two halves.
+ * a node gets the top bit set before the reversal, its skey is odd and
+ * comes after the even skey of the dummy of its bucket
+ */
+static uint64_t cm_skey(uint64_t hcode)
+{
+    return bit_reverse(hcode | (1ull << 63));
+}
+
+static uint64_t cm_dummy_skey(size_t b)
+{
+    return bit_reverse(b);
+}
+
+// the bucket that was split to make b
+static size_t cm_parent(size_t b)
+{
+    return b ^ ((size_t)1 << (63 - __builtin_clzll(b)));
+}
+
+/**
+ * @param alloc: allocate the segment of b if missing, else return NULL
+ */
+static CBucket *cm_slot(CMap *cmap, size_t b, bool alloc)
+{
+    uint32_t s = 64 - __builtin_clzll(b);
+    size_t base = (size_t)1 << (s - 1);
+    CBucket *seg = cmap->segs[s].load(std::memory_order_acquire);
+    if (!seg)
+    {
+        if (!alloc)
+        {
+            return NULL;
+        }
+        CBucket *fresh = new CBucket[base]();
+        if (cmap->segs[s].compare_exchange_strong(seg, fresh))
+        {
+            seg = fresh;
+        }
+        else
+        {
+            delete[] fresh; // seg is the winner's
+        }
+    }
+    return &seg[b - base];
+}
+
+static bool cm_match(CNode *node, CNode *key, cm_eq eq)
+{
+    if (!(node->skey & 1))
+    {
+        return true; // a dummy, the skey is enough
+    }
+    return eq && node->hcode == key->hcode && eq(node, key);
+}
+
+/**
+ * @brief walks from the dummy d to where a node of this skey belongs
+ *
+ * deleted nodes met on the way are unlinked. with eq NULL no regular node
+ * matches, the walk then goes past every node of this skey
+ *
+ * @param **prev: set to the link pointing to *cur
+ * @param **cur: set to the match, or to the first node after the position
+ * @return the matching node, NULL if there is none
+ */
+static CNode *cm_find(CNode *d, uint64_t skey, CNode *key, cm_eq eq,
+                      std::atomic<uintptr_t> **prev, CNode **cur)
+{
+    std::atomic<uintptr_t> *p = &d->next;
+    CNode *c = cm_ptr(p->load(std::memory_order_acquire));
+    while (c)
+    {
+        uintptr_t next = c->next.load(std::memory_order_acquire);
+        if (cm_marked(next))
+        {
+            uintptr_t expected = (uintptr_t)c;
+            if (!p->compare_exchange_strong(expected, next & ~k_mark))
+            {
+                // p was unlinked or changed under us, start over
+                p = &d->next;
+                c = cm_ptr(p->load(std::memory_order_acquire));
+                continue;
+            }
+            c = cm_ptr(next);
+            continue;
+        }
+        if (c->skey > skey)
+        {
+            break;
+        }
+        if (c->skey == skey && cm_match(c, key, eq))
+        {
+            *prev = p;
+            *cur = c;
+            return c;
+        }
+        p = &c->next;
+        c = cm_ptr(next);
+    }
+    *prev = p;
+    *cur = c;
+    return NULL;
+}
+
+/**
+ * @brief links node after the dummy d, unless an equal one is there
+ *
+ * @return the equal node, NULL if node was linked
+ */
+static CNode *cm_link(CNode *d, CNode *node, cm_eq eq)
+{
+    std::atomic<uintptr_t> *prev = NULL;
+    CNode *cur = NULL;
+    for (;;)
+    {
+        if (cm_find(d, node->skey, node, eq, &prev, &cur))
+        {
+            return cur;
+        }
+        node->next.store((uintptr_t)cur, std::memory_order_relaxed);
+        uintptr_t expected = (uintptr_t)cur;
+        if (prev->compare_exchange_strong(expected, (uintptr_t)node))
+        {
+            return NULL;
+        }
+    }
+}
+
+/**
+ * @brief the dummy of bucket b, linked into the list of its parent first
+ * if the bucket was never used
+ *
+ * while another thread links it, the dummy of the parent is returned
+ * instead: its part of the list holds every node of b
+ */
+static CNode *cm_bucket_init(CMap *cmap, size_t b)
+{
+    if (b == 0)
+    {
+        return &cmap->head;
+    }
+    CBucket *bucket = cm_slot(cmap, b, true);
+    uint32_t state = bucket->state.load(std::memory_order_acquire);
+    if (state == BUCKET_READY)
+    {
+        return &bucket->dummy;
+    }
+
+    CNode *parent = cm_bucket_init(cmap, cm_parent(b));
+    if (state != BUCKET_EMPTY ||
+        !bucket->state.compare_exchange_strong(state, BUCKET_LINKING))
+    {
+        return parent;
+    }
+    bucket->dummy.skey = cm_dummy_skey(b);
+    cm_link(parent, &bucket->dummy, NULL);
+    bucket->state.store(BUCKET_READY, std::memory_order_release);
+    return &bucket->dummy;
+}
+
+/**
+ * @brief finds the node equal to key, without a lock
+ *
+ * only a bucket used for the first time is written to, its dummy is
+ * linked so later calls start next to the node instead of at the parent
+ */
+CNode *cm_lookup(CMap *cmap, CNode *key, bool (*eq)(CNode *, CNode *))
+{
+    assert(epoch_active());
+    uint64_t skey = cm_skey(key->hcode);
+    size_t nb = cmap->buckets.load(std::memory_order_acquire);
+    CNode *d = cm_bucket_init(cmap, key->hcode & (nb - 1));
+    CNode *c = cm_ptr(d->next.load(std::memory_order_acquire));
+    while (c && c->skey <= skey)
+    {
+        // a deleted node still leads on to the rest of the list
+        uintptr_t next = c->next.load(std::memory_order_acquire);
+        if (!cm_marked(next) && c->skey == skey && cm_match(c, key, eq))
+        {
+            return c;
+        }
+        c = cm_ptr(next);
+    }
+    return NULL;
+}
+
+/**
+ * @brief inserts node unless an equal one is already in the map
+ *
+ * doubles the buckets once they average k_cmap_max_load nodes, the new
+ * ones are filled in lazily by the calls that reach them
+ *
+ * @return the node already in the map, NULL if node was inserted
+ */
+CNode *cm_insert(CMap *cmap, CNode *node, bool (*eq)(CNode *, CNode *))
+{
+    assert(epoch_active());
+    node->skey = cm_skey(node->hcode);
+    size_t nb = cmap->buckets.load(std::memory_order_acquire);
+    CNode *found = cm_link(cm_bucket_init(cmap, node->hcode & (nb - 1)), node, eq);
+    if (found)
+    {
+        return found;
+    }
+
+    size_t n = cmap->size.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (n > nb * k_cmap_max_load)
+    {
+        cmap->buckets.compare_exchange_strong(nb, nb * 2);
+    }
+    return NULL;
+}
+
+/**
+ * @brief removes the node equal to key
+ *
+ * the node is marked first, which freezes its link, then unlinked. it is
+ * unreachable when this returns, readers may still hold it until the
+ * caller's epoch_retire() frees it
+ *
+ * @return the removed node, NULL if not found
+ */
+CNode *cm_pop(CMap *cmap, CNode *key, bool (*eq)(CNode *, CNode *))
+{
+    assert(epoch_active());
+    uint64_t skey = cm_skey(key->hcode);
+    size_t nb = cmap->buckets.load(std::memory_order_acquire);
+    CNode *d = cm_bucket_init(cmap, key->hcode & (nb - 1));
+    std::atomic<uintptr_t> *prev = NULL;
+    CNode *cur = NULL;
+    for (;;)
+    {
+        if (!cm_find(d, skey, key, eq, &prev, &cur))
+        {
+            return NULL;
+        }
+        uintptr_t next = cur->next.load(std::memory_order_acquire);
+        if (cm_marked(next) || !cur->next.compare_exchange_strong(next, next | k_mark))
+        {
+            continue; // changed or being deleted, look again
+        }
+
+        CNode *node = cur;
+        uintptr_t expected = (uintptr_t)node;
+        if (!prev->compare_exchange_strong(expected, next))
+        {
+            // a walk past the whole skey unlinks it
+            cm_find(d, skey, NULL, NULL, &prev, &cur);
+        }
+        cmap->size.fetch_sub(1, std::memory_order_relaxed);
+        return node;
+    }
+}
+
+size_t cm_size(CMap *cmap)
+{
+    return cmap->size.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief frees the segments, the nodes are left to the caller
+ *
+ * no other thread may use the map anymore
+ */
+void cm_destroy(CMap *cmap)
+{
+    for (std::atomic<CBucket *> &seg : cmap->segs)
+    {
+        delete[] seg.exchange(NULL);
+    }
+    cmap->head.next.store(0);
+    cmap->buckets.store(k_cmap_min_buckets);
+    cmap->size.store(0);
+}
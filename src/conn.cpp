@@ -9,108 +9,360 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/ip.h>
 #include <vector>
 #include <map>
+#include <mutex>
 #include <iostream>
 
 #include "../include/conn.h"
 #include "../include/utils/print_utils.h"
+#include "../include/utils/stats_utils.h"
 #include "../include/entry.h"
 #include "../include/utils/string_utils.h"
 #include "../include/enums/res_enum.h"
+#include "../include/enums/error_enum.h"
+#include "../include/enums/status_enum.h"
+#include "../include/enums/stream_enum.h"
+#include "../include/shard.h"
+#include "../include/shm_ring.h"
+#include "../include/resp.h"
+#include "../include/cmd_table.h"
+#include "../include/timer_wheel.h"
 
 #define container_of(ptr, type, member) ({                  \
     const typeof( ((type *)0)->member ) *__mptr = (ptr);    \
     (type *)( (char *)__mptr - offsetof(type, member) ); })
 
-static struct
+/**
+ * the keyspace is split in stripes, each with its own lock, so reactor
+ * threads only contend when they touch keys of the same stripe
+ */
+struct Stripe
 {
+    std::mutex mu;
     HMap db;
+};
+
+static struct
+{
+    Stripe stripes[1 << k_db_stripe_bits];
 } g_data;
 
+typedef uint32_t (*cmd_fn)(HMap *, LookupKey &, Args &, OutBuf &);
+typedef void (*key_fn)(HMap *, LookupKey &, KeyResult &);
+
+/**
+ * @brief picks the stripe owning the key of this hash
+ *
+ * the hash is mixed first, the low bits of hcode already pick the slot
+ * inside the stripe's HMap
+ */
+static Stripe &stripe_of(uint64_t hcode)
+{
+    return g_data.stripes[(hcode * 0x9E3779B97F4A7C15ull) >> (64 - k_db_stripe_bits)];
+}
+
+/**
+ * @param *lhs: node of an Entry in the table
+ * @param *rhs: node of a LookupKey
+ */
 static bool entry_eq(HNode *lhs, HNode *rhs)
 {
     struct Entry *le = container_of(lhs, struct Entry, node);
-    struct Entry *re = container_of(rhs, struct Entry, node);
-    return le->key == re->key;
+    struct LookupKey *rk = container_of(rhs, struct LookupKey, node);
+    return le->key == rk->key;
 }
 
-static uint32_t do_get(
-    const std::vector<std::string> &cmd, uint8_t *res, uint32_t *reslen)
+static uint32_t do_get(HMap *db, LookupKey &key, Args &cmd, OutBuf &out)
 {
-    Entry key;
-    key.key = cmd[1];
-    key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
-
-    HNode *node = hm_lookup(&g_data.db, &key.node, &entry_eq);
+    (void)cmd;
+    HNode *node = hm_lookup(db, &key.node, &entry_eq);
     if (!node)
     {
+        out.reply_nil();
         return RES_NX;
     }
 
-    const std::string &val = container_of(node, Entry, node)->val;
-    assert(val.size() <= k_max_msg);
-    memcpy(res, val.data(), val.size());
-    *reslen = (uint32_t)val.size();
+    out.reply_value(container_of(node, Entry, node)->val);
     return RES_OK;
 }
 
-static uint32_t do_set(
-    std::vector<std::string> &cmd, uint8_t *res, uint32_t *reslen)
+static uint32_t do_set(HMap *db, LookupKey &key, Args &cmd, OutBuf &out)
 {
-    (void)res;
-    (void)reslen;
-
-    Entry key;
-    key.key.swap(cmd[1]);
-    key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
-
-    HNode *node = hm_lookup(&g_data.db, &key.node, &entry_eq);
+    HNode *node = hm_lookup(db, &key.node, &entry_eq);
     if (node)
     {
-        container_of(node, Entry, node)->val.swap(cmd[2]);
+        container_of(node, Entry, node)->val =
+            std::make_shared<const std::string>(cmd.take(2));
     }
     else
     {
         Entry *ent = new Entry();
-        ent->key.swap(key.key);
+        ent->key = cmd.take(1);
         ent->node.hcode = key.node.hcode;
-        ent->val.swap(cmd[2]);
-        hm_insert(&g_data.db, &ent->node);
+        ent->val = std::make_shared<const std::string>(cmd.take(2));
+        hm_insert(db, &ent->node);
     }
+    out.reply_status("OK");
     return RES_OK;
 }
 
-static uint32_t do_del(
-    std::vector<std::string> &cmd, uint8_t *res, uint32_t *reslen)
+static void del_key(HMap *db, LookupKey &key, KeyResult &res)
 {
-    (void)res;
-    (void)reslen;
+    HNode *node = hm_pop(db, &key.node, &entry_eq);
+    if (node)
+    {
+        delete container_of(node, Entry, node);
+        res.n = 1;
+    }
+}
 
-    Entry key;
-    key.key.swap(cmd[1]);
-    key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
+static void exists_key(HMap *db, LookupKey &key, KeyResult &res)
+{
+    res.n = hm_lookup(db, &key.node, &entry_eq) ? 1 : 0;
+}
 
-    HNode *node = hm_pop(&g_data.db, &key.node, &entry_eq);
+static void mget_key(HMap *db, LookupKey &key, KeyResult &res)
+{
+    HNode *node = hm_lookup(db, &key.node, &entry_eq);
     if (node)
     {
-        delete container_of(node, Entry, node);
+        res.val = container_of(node, Entry, node)->val;
     }
+}
+
+// per-key handlers of the CMD_MULTIKEY commands, indexed by cmd_enum
+static const key_fn k_key_handlers[CMD_COUNT] = {
+    NULL,       // CMD_GET
+    NULL,       // CMD_SET
+    del_key,    // CMD_DEL
+    NULL,       // CMD_PING
+    NULL,       // CMD_HELLO
+    NULL,       // CMD_INFO
+    exists_key, // CMD_EXISTS
+    mget_key,   // CMD_MGET
+};
+
+/**
+ * @brief runs a multi-key command on the keys cmd[1..], all of them in
+ * db, no locking is done
+ *
+ * used by shards to run the part of the keys they own
+ *
+ * @param hcodes: hash of every key, in the same order
+ * @param res: gets the result of every key, in the same order
+ */
+void exec_keys(HMap *db, Args &cmd, const std::vector<uint64_t> &hcodes,
+               std::vector<KeyResult> &res)
+{
+    const CmdSpec *spec = cmd_find(cmd[0]);
+    assert(spec && k_key_handlers[spec->id]);
+    res.resize(cmd.size() - 1);
+    for (size_t i = 1; i < cmd.size(); i++)
+    {
+        LookupKey key(cmd[i], hcodes[i - 1]);
+        k_key_handlers[spec->id](db, key, res[i - 1]);
+    }
+}
+
+/**
+ * @brief replies to a multi-key command from the results of its keys,
+ * given one at a time in the order of the command
+ *
+ * combine_begin() comes first, then combine_key() for every key and
+ * combine_end(), sum carries the integer results in between
+ */
+void combine_begin(const CmdSpec *spec, size_t nkeys, OutBuf &out)
+{
+    if (spec->combine == COMBINE_ARRAY)
+    {
+        out.reply_arr(nkeys);
+    }
+}
+
+void combine_key(const CmdSpec *spec, const KeyResult &res, int64_t *sum, OutBuf &out)
+{
+    switch (spec->combine)
+    {
+    case COMBINE_SUM:
+        *sum += res.n;
+        break;
+    case COMBINE_ARRAY:
+        if (res.val)
+        {
+            out.reply_value(res.val);
+        }
+        else
+        {
+            out.reply_nil();
+        }
+        break;
+    default:
+        assert(!"not a multi-key command");
+    }
+}
+
+void combine_end(const CmdSpec *spec, int64_t sum, OutBuf &out)
+{
+    if (spec->combine == COMBINE_SUM)
+    {
+        out.reply_int(sum);
+    }
+}
+
+/**
+ * @brief moves the nodes of the resizing tables for about budget_us
+ *
+ * in shard-per-core mode only the table of the calling shard is touched.
+ * otherwise the stripes are visited from where the last call ran out of
+ * time, the ones locked by a request are skipped. once out of time the
+ * rest are only checked for a resize in progress
+ *
+ * @return true if some table is still resizing, or may be as it was
+ * locked
+ */
+bool db_rehash(uint64_t budget_us)
+{
+    if (tls_shard)
+    {
+        return hm_rehash(&tls_shard->db, budget_us);
+    }
+
+    static thread_local size_t next = 0;
+    const size_t n = sizeof(g_data.stripes) / sizeof(g_data.stripes[0]);
+    uint64_t deadline = monotonic_us() + budget_us;
+    bool late = false;
+    bool more = false;
+    size_t first = next;
+    for (size_t i = 0; i < n; i++)
+    {
+        Stripe &st = g_data.stripes[(first + i) % n];
+        if (!st.mu.try_lock())
+        {
+            more = true;
+            continue;
+        }
+        uint64_t now = monotonic_us();
+        if (!late && now >= deadline)
+        {
+            // the next call starts here
+            late = true;
+            next = (first + i) % n;
+        }
+        if (late)
+        {
+            more = more || st.db.ht_secondary.ctrl != NULL;
+        }
+        else
+        {
+            more = hm_rehash(&st.db, deadline - now) || more;
+        }
+        st.mu.unlock();
+    }
+    return more;
+}
+
+/**
+ * @brief stats of the keyspace, of the calling shard only in
+ * shard-per-core mode
+ */
+HMapStats db_stats()
+{
+    if (tls_shard)
+    {
+        return hm_stats(&tls_shard->db);
+    }
+
+    HMapStats total;
+    uint32_t resizing = 0;
+    for (Stripe &st : g_data.stripes)
+    {
+        std::lock_guard<std::mutex> lock(st.mu);
+        HMapStats s = hm_stats(&st.db);
+        total.size += s.size;
+        total.resizes += s.resizes;
+        total.rehash_us += s.rehash_us;
+        if (s.resizing)
+        {
+            total.progress += s.progress;
+            resizing++;
+        }
+    }
+    total.resizing = resizing > 0;
+    total.progress = resizing ? total.progress / resizing : 0;
+    return total;
+}
+
+/**
+ * @brief replies with the keyspace stats, as "name:value" lines
+ */
+static uint32_t do_info(HMap *db, LookupKey &key, Args &cmd, OutBuf &out)
+{
+    (void)db;
+    (void)key;
+    (void)cmd;
+    HMapStats st = db_stats();
+    char text[256];
+    int n = snprintf(text, sizeof(text),
+                     "# Keyspace\r\n"
+                     "keys:%zu\r\n"
+                     "resizing:%d\r\n"
+                     "resize_progress:%u\r\n"
+                     "resizes:%llu\r\n"
+                     "rehash_time_us:%llu\r\n"
+                     "# Stats\r\n"
+                     "syscalls:%llu\r\n",
+                     st.size, (int)st.resizing, st.progress,
+                     (unsigned long long)st.resizes,
+                     (unsigned long long)st.rehash_us,
+                     (unsigned long long)g_syscalls.load(std::memory_order_relaxed));
+    out.reply_str(text, (size_t)n);
     return RES_OK;
 }
 
+// handlers of the commands, indexed by cmd_enum, the protocol commands
+// are answered by do_resp_cmd and the multi-key ones by k_key_handlers
+static const cmd_fn k_handlers[CMD_COUNT] = {
+    do_get,  // CMD_GET
+    do_set,  // CMD_SET
+    NULL,    // CMD_DEL
+    NULL,    // CMD_PING
+    NULL,    // CMD_HELLO
+    do_info, // CMD_INFO
+    NULL,    // CMD_EXISTS
+    NULL,    // CMD_MGET
+};
+
+/**
+ * @brief runs a command against the given HMap, no locking is done
+ *
+ * used by shards to run commands on the part of the keyspace they own
+ *
+ * @param key: cmd[1], hashed
+ * @param out: the payload of the response is appended to it
+ *
+ * @return response code according to res_enum
+ */
+uint32_t exec_cmd(HMap *db, LookupKey &key, Args &cmd, OutBuf &out)
+{
+    const CmdSpec *spec = cmd_find(cmd[0]);
+    assert(spec && k_handlers[spec->id]);
+    return k_handlers[spec->id](db, key, cmd, out);
+}
+
 /**
  * @brief parse the request from client and populate in cmd vector
  *
  * @param *data: request
  * @param len: length of the request
- * @param out: vector to populate commands
+ * @param out: filled with views of the args, into data
  *
  * @return 0 if successful, -1 otherwise
  */
 static int32_t parse_req(
-    const uint8_t *data, size_t len, std::vector<std::string> &out)
+    const uint8_t *data, size_t len, Args &out)
 {
     if (len < 4)
     {
@@ -137,7 +389,7 @@ static int32_t parse_req(
         {
             return -1;
         }
-        out.push_back(std::string((char *)&data[pos + 4], sz));
+        out.push_back(std::string_view((const char *)&data[pos + 4], sz));
         pos += 4 + sz;
     }
 
@@ -148,207 +400,742 @@ static int32_t parse_req(
     return 0;
 }
 
+/**
+ * @brief answers the commands of the RESP protocol itself, PING and
+ * HELLO are sent by standard clients and benchmarks before anything else
+ *
+ * HELLO 3 switches the conn to RESP3, its reply is already in RESP3
+ *
+ * @param id: CMD_PING or CMD_HELLO
+ */
+static void do_resp_cmd(Conn *conn, uint32_t id, Args &cmd, OutBuf &out)
+{
+    if (id == CMD_PING)
+    {
+        if (cmd.size() == 2)
+        {
+            out.reply_str(cmd[1].data(), cmd[1].size());
+        }
+        else
+        {
+            out.reply_status("PONG");
+        }
+        return;
+    }
+
+    if (cmd.size() >= 2)
+    {
+        // the AUTH and SETNAME options are ignored
+        if (cmd[1] != "2" && cmd[1] != "3")
+        {
+            out.reply_err(ERR_NOPROTO, "unsupported protocol version");
+            return;
+        }
+        conn->proto = (cmd[1] == "3") ? PROTO_RESP3 : PROTO_RESP2;
+        conn->wbuf.proto = conn->proto;
+        conn->pending_res.proto = conn->proto;
+    }
+
+    out.reply_map(3);
+    out.reply_str("server", 6);
+    out.reply_str("kv", 2);
+    out.reply_str("proto", 5);
+    out.reply_int((conn->proto == PROTO_RESP3) ? 3 : 2);
+    out.reply_str("mode", 4);
+    out.reply_str("standalone", 10);
+}
+
 /**
  * @brief call the appropriate function according to request from client
  *
- * @param *req: request
- * @param reqlen: length of the request
+ * @param *conn: connection the request came from
+ * @param cmd: parsed request
  * @param *rescode: response code according to res_enum
- * @param *res: pointer to response array
- * @param *reslen: length of the response
+ * @param out: the payload of the response is appended to it
  *
- * @return 0 if successful
+ * @return 0 if successful, DEFERRED if the command was sent to other
+ * shards and the response comes later
  */
 static int32_t do_request(
-    const uint8_t *req, uint32_t reqlen,
-    uint32_t *rescode, uint8_t *res, uint32_t *reslen)
+    Conn *conn, Args &cmd, uint32_t *rescode, OutBuf &out)
 {
-    std::vector<std::string> cmd;
-    if (0 != parse_req(req, reqlen, cmd))
+    const CmdSpec *spec = cmd_find(cmd[0]);
+    if (!spec || !cmd_arity_ok(spec, cmd.size()) ||
+        ((spec->flags & CMD_PROTO) && conn->proto == PROTO_BIN))
     {
-        msg("bad req");
-        return -1;
+        // cmd is not recognized
+        *rescode = RES_ERR;
+        out.reply_err(ERR_UNKNOWN, "Unknown cmd");
+        return 0;
     }
 
-    for (auto ci : cmd)
-        print(ci);
-    print("");
-
-    if (cmd.size() == 2 && cmd_is(cmd[0], "get"))
+    if (spec->flags & CMD_PROTO)
     {
-        *rescode = do_get(cmd, res, reslen);
+        do_resp_cmd(conn, spec->id, cmd, out);
+        *rescode = RES_OK;
+        return 0;
     }
-    else if (cmd.size() == 3 && cmd_is(cmd[0], "set"))
+
+    if (spec->flags & CMD_NOKEY)
     {
-        *rescode = do_set(cmd, res, reslen);
+        LookupKey none(std::string_view(), 0);
+        *rescode = k_handlers[spec->id](NULL, none, cmd, out);
+        return 0;
     }
-    else if (cmd.size() == 2 && cmd_is(cmd[0], "del"))
+
+    if (tls_shard)
     {
-        *rescode = do_del(cmd, res, reslen);
+        // shard-per-core mode, the keys are owned by shards not stripes
+        return shard_dispatch(conn, spec, cmd, rescode, out);
     }
-    else
+
+    if (spec->flags & CMD_MULTIKEY)
     {
-        // cmd is not recognized
-        *rescode = RES_ERR;
-        const char *msg = "Unknown cmd";
-        strcpy((char *)res, msg);
-        *reslen = strlen(msg);
+        // the keys may live in different stripes, each is locked in turn
+        int64_t sum = 0;
+        combine_begin(spec, cmd.size() - 1, out);
+        for (size_t i = 1; i < cmd.size(); i++)
+        {
+            LookupKey key(cmd[i]);
+            KeyResult res;
+            {
+                Stripe &st = stripe_of(key.node.hcode);
+                std::lock_guard<std::mutex> lock(st.mu);
+                k_key_handlers[spec->id](&st.db, key, res);
+            }
+            combine_key(spec, res, &sum, out);
+        }
+        combine_end(spec, sum, out);
+        *rescode = RES_OK;
         return 0;
     }
+
+    LookupKey key(cmd[1]);
+    Stripe &st = stripe_of(key.node.hcode);
+    std::lock_guard<std::mutex> lock(st.mu);
+    *rescode = k_handlers[spec->id](&st.db, key, cmd, out);
     return 0;
 }
 
 /**
- * @brief sends all data in write-buffer to the client
+ * @brief read() on the socket, or on the request ring of a shm client
+ */
+static ssize_t conn_read(Conn *conn, void *dst, size_t n)
+{
+    if (conn->shm)
+    {
+        return shm_recv(conn->shm, dst, n);
+    }
+    count_syscall();
+    return read(conn->fd, dst, n);
+}
+
+/**
+ * @brief writev() on the socket, or on the response ring of a shm client
+ */
+static ssize_t conn_writev(Conn *conn, const struct iovec *iov, int cnt)
+{
+    if (conn->shm)
+    {
+        return shm_sendv(conn->shm, iov, cnt);
+    }
+    count_syscall();
+    return writev(conn->fd, iov, cnt);
+}
+
+/**
+ * @brief sends the data in write-buffer to the client
  *
- * sends all data in write-buffer to client and updates buffer accordingly
- * if all data is sent, state is changed back to STATE_REQ
+ * sends all data in write-buffer to client and updates buffer accordingly,
+ * the buffer holds the responses of every request handled since the last
+ * flush so they go out together
  *
  * @param *conn: pointer to the Conn object
  *
- * @return true if all data is sent, false otherwise.
- * in case true is returned the function is called again
+ * @return 1 if all data is sent, 0 on EAGAIN, -1 if the conn reached STATE_END
  *
  */
-bool try_flush_buffer(Conn *conn)
+static int32_t try_flush_buffer(Conn *conn)
 {
     print("inside try_flush_buffer...");
-    ssize_t rv = 0;
 
-    do
+    while (!conn->wbuf.all_sent())
     {
-        size_t remain = conn->wbuf_size - conn->wbuf_sent;
-        rv = write(conn->fd, &conn->wbuf[conn->wbuf_sent], remain);
-        print("rv flush", rv);
-    } while (rv < 0 && errno == EINTR);
+        struct iovec iov[k_max_iov];
+        size_t cnt = conn->wbuf.iov(iov, k_max_iov);
+        ssize_t rv = 0;
+        do
+        {
+            rv = conn_writev(conn, iov, (int)cnt);
+            print("rv flush", rv);
+        } while (rv < 0 && errno == EINTR);
 
-    if (rv < 0 && errno == EAGAIN)
-    {
-        // got EAGAIN, stop.
-        return false;
+        if (rv < 0 && errno == EAGAIN)
+        {
+            // got EAGAIN, stop.
+            return 0;
+        }
+
+        if (rv < 0)
+        {
+            msg("write() error");
+            conn->state = STATE_END;
+            return -1;
+        }
+
+        conn->wbuf.consume((size_t)rv);
     }
 
-    if (rv < 0)
+    // responses were fully sent
+    conn->wbuf.clear();
+    return 1;
+}
+
+/**
+ * @brief flushes the pending responses, switching to STATE_RES if the
+ * socket can't take them all
+ *
+ * nothing is written while a request waits on the shards, a failed write
+ * would end the conn under the feet of their replies. the responses go
+ * out with the deferred one
+ *
+ * @param *conn: pointer to the Conn object
+ *
+ */
+static void flush_responses(Conn *conn)
+{
+    if (conn->pending > 0)
     {
-        msg("write() error");
-        conn->state = STATE_END;
-        return false;
+        return;
     }
+    if (try_flush_buffer(conn) == 0 && conn->state == STATE_REQ)
+    {
+        conn->state = STATE_RES;
+    }
+}
 
-    conn->wbuf_sent += (size_t)rv;
-    assert(conn->wbuf_sent <= conn->wbuf_size);
-
-    if (conn->wbuf_sent == conn->wbuf_size)
+void state_res(Conn *conn)
+{
+    if (try_flush_buffer(conn) > 0)
     {
-        // response was fully sent, change state back
+        // change state back
         conn->state = STATE_REQ;
-        conn->wbuf_sent = 0;
-        conn->wbuf_size = 0;
-        return false;
     }
-
-    // still got some data in wbuf, could try to write again
-    return true;
 }
 
-void state_res(Conn *conn)
+/**
+ * @brief drops n parsed bytes from the front of the read-buffer
+ *
+ * the bytes stay put while parsed requests point into them
+ */
+static void rbuf_consume(Conn *conn, size_t n)
 {
-    while (try_flush_buffer(conn))
+    conn->rbuf_head += n;
+    if (conn->rbuf_head == conn->rbuf.size && conn->ncmds == 0)
     {
+        // everything was consumed, start over at the front for free
+        conn->rbuf.clear();
+        conn->rbuf_head = 0;
     }
 }
 
 /**
- * @brief reads message from client and sends the same message back
+ * @brief parses one request from the read-buffer
  *
- * reads the message from the client
+ * reads the message from the read-buffer
  *      if buffer size does not include the len of string, try in next iteation
  *      if the buffer size does not include the string itself, try in next iteration
- * copy the same message to write buffer and send it back to client
- * shift the read-buffer accordingly i.e. remove the part of message we just read
+ * the request is consumed in place by moving rbuf_head past it, bytes are
+ * only moved by rbuf_room() when the tail runs out of space
  *
- * @param *conn: pointer to the Conn object
+ * requests of k_stream_min bytes or more are not buffered whole, they are
+ * handed to parse_stream() which fills their args as the bytes arrive
  *
- * @return if the state is STATE_REQ, in which case it'll call the same function again
+ * the request is queued in cmds, it does not touch the keyspace so it is
+ * safe to run on an I/O thread
+ *
+ * the protocol is detected on the first bytes of the conn, RESP requests
+ * are handed to parse_resp()
+ *
+ * @return true if a request was parsed
  */
-static bool try_one_request(Conn *conn)
+bool Conn::parse_request()
 {
-    print("inside try_one_request...");
+    if (this->stream.active)
+    {
+        return this->parse_stream();
+    }
 
-    if (conn->rbuf_size < 4)
+    if (this->proto == PROTO_NONE)
     {
-        /**
-         * not enough data in the buffer. will retry in the next iteration
-         * state is still STATE_REQ, so it will call try_fill_buffer again
-         * which inturn calls try_one_request again
-         */
+        const uint8_t *p = &this->rbuf.data[this->rbuf_head];
+        if (!resp_detect(p, this->rbuf.size - this->rbuf_head, &this->proto))
+        {
+            return false;
+        }
+        this->wbuf.proto = this->proto;
+        this->pending_res.proto = this->proto;
+    }
+    if (this->proto != PROTO_BIN)
+    {
+        return this->parse_resp();
+    }
+
+    size_t avail = this->rbuf.size - this->rbuf_head;
+    if (avail < 4)
+    {
+        // not enough data in the buffer. will retry in the next iteration
         return false;
     }
 
     uint32_t len = 0;
-    memcpy(&len, &conn->rbuf[0], 4);
-    if (len > k_max_msg)
+    const uint8_t *req = &this->rbuf.data[this->rbuf_head];
+    memcpy(&len, &req[0], 4);
+    if (4 + (size_t)len > this->max_buf)
     {
         msg("too long");
-        conn->state = STATE_END;
+        this->state = STATE_END;
         return false;
     }
 
-    if (4 + len > conn->rbuf_size)
+    if (4 + len > avail && len >= k_stream_min)
     {
-        /**
-         * not enough data in the buffer. will retry in the next iteration
-         * state is still STATE_REQ, so it will call try_fill_buffer again
-         * which inturn calls try_one_request again
-         */
+        // too large to be buffered whole, parse it as it arrives
+        this->stream.active = true;
+        this->stream.stage = STREAM_ARGC;
+        this->stream.left = len;
+        this->stream.nargs = 0;
+        this->stream.arg_len = 0;
+        this->stream.arg_left = 0;
+        this->stream.cmd.clear();
+        rbuf_consume(this, 4);
+        return this->parse_stream();
+    }
+
+    if (4 + len > avail)
+    {
+        // not enough data in the buffer, make room for the whole request
+        // and retry in the next iteration
+        this->rbuf_room(4 + len - avail);
         return false;
     }
 
-    // got one request generate the response
-    uint32_t rescode = 0;
-    uint32_t wlen = 0;
-    int32_t err = do_request(&conn->rbuf[4], len,
-                             &rescode, &conn->wbuf[4 + 4], &wlen);
+    if (this->ncmds == this->cmds.size())
+    {
+        this->cmds.emplace_back();
+    }
+    Args &cmd = this->cmds[this->ncmds];
+    cmd.clear();
+    if (0 != parse_req(&req[4], len, cmd))
+    {
+        msg("bad req");
+        this->state = STATE_END;
+        return false;
+    }
+    this->ncmds++;
 
-    if (err)
+    rbuf_consume(this, 4 + len);
+    return true;
+}
+
+/**
+ * @brief parses one RESP request from the read-buffer, in place like
+ * parse_request()
+ *
+ * RESP requests are always buffered whole, up to max_buf, empty ones
+ * are skipped
+ *
+ * @return true if a request was parsed
+ */
+bool Conn::parse_resp()
+{
+    while (true)
+    {
+        if (this->ncmds == this->cmds.size())
+        {
+            this->cmds.emplace_back();
+        }
+        Args &cmd = this->cmds[this->ncmds];
+        cmd.clear();
+
+        size_t avail = this->rbuf.size - this->rbuf_head;
+        size_t need = 0;
+        int64_t used = resp_parse(&this->rbuf.data[this->rbuf_head], avail,
+                                  this->max_buf, cmd, &need);
+        if (used < 0)
+        {
+            msg("bad req");
+            this->state = STATE_END;
+            return false;
+        }
+        if (used == 0)
+        {
+            if (need > avail)
+            {
+                // a bulk string is missing, the room grows with the bytes
+                // received like stream_grow() does, not with the declared
+                // length, a client may announce 512 MB and send nothing
+                size_t room = (avail > k_read_min) ? avail : k_read_min;
+                this->rbuf_room((need - avail < room) ? need - avail : room);
+            }
+            return false;
+        }
+
+        if (!cmd.empty())
+        {
+            this->ncmds++;
+            rbuf_consume(this, (size_t)used);
+            return true;
+        }
+        rbuf_consume(this, (size_t)used);
+    }
+}
+
+/**
+ * @brief parses a large request incrementally
+ *
+ * the length prefixes are read from the read-buffer, the bytes of each
+ * arg are moved into their string as they come, or read straight into it
+ * by read_once(), so the read-buffer never holds more than one read
+ *
+ * @return true once the whole request was parsed and queued in cmds
+ */
+bool Conn::parse_stream()
+{
+    while (true)
+    {
+        size_t avail = this->rbuf.size - this->rbuf_head;
+        const uint8_t *p = &this->rbuf.data[this->rbuf_head];
+
+        if (this->stream.stage == STREAM_ARG)
+        {
+            std::string &arg = this->stream.cmd.back();
+            size_t n = (avail < this->stream.arg_left) ? avail : this->stream.arg_left;
+            if (n || !this->stream.arg_left)
+            {
+                // drop the room read_once() left past the bytes received
+                arg.resize(this->stream.arg_len - this->stream.arg_left);
+            }
+            arg.append((const char *)p, n);
+            rbuf_consume(this, n);
+            this->stream.arg_left -= (uint32_t)n;
+            this->stream.left -= (uint32_t)n;
+            if (this->stream.arg_left)
+            {
+                return false;
+            }
+            this->stream.stage = STREAM_ARGLEN;
+            continue;
+        }
+
+        if (this->stream.stage == STREAM_ARGLEN && this->stream.nargs == 0)
+        {
+            if (this->stream.left != 0)
+            {
+                msg("bad req"); // trailing garbage
+                this->state = STATE_END;
+                return false;
+            }
+            if (this->ncmds == this->cmds.size())
+            {
+                this->cmds.emplace_back();
+            }
+            this->cmds[this->ncmds++].adopt(this->stream.cmd);
+            this->stream.cmd.clear();
+            this->stream.active = false;
+            return true;
+        }
+
+        if (avail < 4)
+        {
+            // not enough data in the buffer. will retry in the next iteration
+            return false;
+        }
+
+        uint32_t n = 0;
+        memcpy(&n, p, 4);
+        if (this->stream.left < 4 ||
+            (this->stream.stage == STREAM_ARGC && n > k_max_args) ||
+            (this->stream.stage == STREAM_ARGLEN && n > this->stream.left - 4))
+        {
+            msg("bad req");
+            this->state = STATE_END;
+            return false;
+        }
+        rbuf_consume(this, 4);
+        this->stream.left -= 4;
+
+        if (this->stream.stage == STREAM_ARGC)
+        {
+            this->stream.nargs = n;
+            this->stream.stage = STREAM_ARGLEN;
+            continue;
+        }
+
+        // the arg grows with the bytes received, not the declared length
+        this->stream.cmd.emplace_back();
+        this->stream.nargs--;
+        this->stream.arg_len = n;
+        this->stream.arg_left = n;
+        this->stream.stage = STREAM_ARG;
+    }
+}
+
+/**
+ * @brief runs the parsed requests in order, appending their responses
+ * to the write-buffer
+ *
+ * stops at a request deferred to other shards, the ones after it are
+ * kept for when the conn resumes
+ *
+ * @return true if every parsed request got its response
+ */
+bool Conn::exec_requests()
+{
+    for (size_t i = 0; i < this->ncmds; i++)
+    {
+        uint32_t rescode = 0;
+        this->begin_response();
+        int32_t err = do_request(this, this->cmds[i], &rescode, this->wbuf);
+
+        if (err == DEFERRED)
+        {
+            // the response is written by shard_drain once the shards reply
+            this->wbuf.buf.size = this->resp_hdr;
+            this->state = STATE_WAIT;
+            size_t left = this->ncmds - i - 1;
+            for (size_t j = 0; j < left; j++)
+            {
+                this->cmds[j].swap(this->cmds[i + 1 + j]);
+            }
+            this->ncmds = left;
+            return false;
+        }
+
+        this->end_response(rescode);
+    }
+
+    this->ncmds = 0;
+    this->arena.reset();
+    rbuf_consume(this, 0);
+    return true;
+}
+
+/**
+ * @brief executes one request from the read-buffer
+ *
+ * the response is appended to the write-buffer, nothing is written to
+ * the socket, the caller decides when the responses are sent
+ *
+ * @return true if a request was handled and its response is in wbuf
+ */
+bool Conn::handle_request()
+{
+    if (this->ncmds && !this->exec_requests())
     {
-        conn->state = STATE_END;
         return false;
     }
+    return this->parse_request() && this->exec_requests();
+}
 
-    wlen += 4;
-    memcpy(&conn->wbuf[0], &wlen, 4);
-    memcpy(&conn->wbuf[4], &rescode, 4);
-    conn->wbuf_size = 4 + wlen;
+/**
+ * @brief starts one more response in the write-buffer
+ *
+ * room is left for the header of the binary protocol, the payload is
+ * then appended to wbuf. RESP replies carry their own framing
+ */
+void Conn::begin_response()
+{
+    this->resp_hdr = this->wbuf.buf.size;
+    this->resp_start = this->wbuf.size();
+    if (this->proto == PROTO_BIN)
+    {
+        this->wbuf.buf.reserve(4 + 4);
+        this->wbuf.buf.size += 4 + 4;
+    }
+}
 
-    size_t remain = conn->rbuf_size - 4 - len;
-    if (remain)
+/**
+ * @brief writes the header in front of the payload appended since
+ * begin_response(), the response is then part of the write-buffer
+ *
+ * @param rescode: response code according to res_enum
+ */
+void Conn::end_response(uint32_t rescode)
+{
+    if (this->proto != PROTO_BIN)
     {
-        memmove(conn->rbuf, &conn->rbuf[4 + len], remain);
+        return;
     }
-    conn->rbuf_size = remain;
+    uint8_t *p = &this->wbuf.buf.data[this->resp_hdr];
+    uint32_t wlen = (uint32_t)(this->wbuf.size() - this->resp_start - 4);
+    memcpy(&p[0], &wlen, 4);
+    memcpy(&p[4], &rescode, 4);
+}
 
-    // change state
-    conn->state = STATE_RES;
-    state_res(conn);
+/**
+ * @brief makes room for n more bytes at the end of the read-buffer
+ *
+ * the unparsed bytes are moved to the front only when the free space
+ * at the tail is too small, the buffer grows only if that is not enough
+ *
+ * @param n: number of bytes about to be received
+ */
+void Conn::rbuf_room(size_t n)
+{
+    if (this->ncmds && this->rbuf.cap - this->rbuf.size < n)
+    {
+        // the bytes are about to move, the pending requests point into them
+        this->pin_args();
+    }
 
-    // continue the outer loop if the request was fully processed
-    return (conn->state == STATE_REQ);
+    if (this->rbuf.cap - this->rbuf.size >= n || this->rbuf_head == 0)
+    {
+        this->rbuf.reserve(n);
+        return;
+    }
+
+    size_t remain = this->rbuf.size - this->rbuf_head;
+    memmove(this->rbuf.data, &this->rbuf.data[this->rbuf_head], remain);
+    this->rbuf.size = remain;
+    this->rbuf_head = 0;
+    this->rbuf.reserve(n);
 }
 
 /**
- * @brief fills buffer and calls try_one_request
+ * @brief copies the args of the pending requests that point into the
+ * read-buffer to the arena
+ */
+void Conn::pin_args()
+{
+    uintptr_t lo = (uintptr_t)this->rbuf.data;
+    uintptr_t hi = lo + this->rbuf.size;
+    for (size_t i = 0; i < this->ncmds; i++)
+    {
+        for (std::string_view &arg : this->cmds[i].v)
+        {
+            uintptr_t p = (uintptr_t)arg.data();
+            if (p < lo || p >= hi)
+            {
+                continue; // already apart, or empty at the very end
+            }
+            char *copy = this->arena.alloc(arg.size());
+            memcpy(copy, arg.data(), arg.size());
+            arg = std::string_view(copy, arg.size());
+        }
+    }
+}
+
+/**
+ * @return true if part of a request was received and the rest is awaited
+ */
+bool Conn::mid_request() const
+{
+    return this->rbuf.size > this->rbuf_head || this->stream.active;
+}
+
+/**
+ * @brief hands the buffers back to the pool while they are empty, so
+ * idle connections do not hold on to memory
+ */
+void Conn::release_buffers()
+{
+    if (this->rbuf.size == 0)
+    {
+        this->rbuf.release();
+    }
+    if (this->wbuf.empty())
+    {
+        this->wbuf.buf.release();
+    }
+}
+
+/**
+ * @brief executes one request
  *
- * fills the read buffer to maximum cap possible
- * while the state is in request mode, calls try_one_request in a loop
+ * @param *conn: pointer to the Conn object
+ *
+ * @return if the state is STATE_REQ, in which case it'll call the same function again
+ */
+static bool try_one_request(Conn *conn)
+{
+    print("inside try_one_request...");
+
+    /**
+     * not enough data in the buffer. will retry in the next iteration
+     * state is still STATE_REQ, so it will call try_fill_buffer again
+     * which inturn calls try_one_request again
+     */
+    if (conn->state != STATE_REQ || !conn->budget || !conn->handle_request())
+    {
+        return false;
+    }
+    conn->budget--;
+    return true;
+}
+
+/**
+ * @brief makes room in a streamed arg for want more bytes after the got
+ * bytes received so far
+ *
+ * the capacity doubles with the bytes actually received, at least one
+ * k_stream_chunk at a time but never past the declared length, so a
+ * client announcing a huge arg and sending nothing holds no memory
+ *
+ * the size of the arg is kept past got between reads, so every byte is
+ * zero-filled by resize() once rather than on each read
+ *
+ * @param left: bytes of the arg not received yet
+ */
+static void stream_grow(std::string *arg, size_t got, size_t want, size_t left)
+{
+    size_t need = got + want;
+    if (arg->capacity() < need)
+    {
+        size_t cap = 2 * arg->capacity();
+        cap = (cap > need + k_stream_chunk) ? cap : need + k_stream_chunk;
+        cap = (cap < got + left) ? cap : got + left;
+        arg->reserve(cap);
+    }
+    if (arg->size() < need)
+    {
+        arg->resize(need);
+    }
+}
+
+/**
+ * @brief reads once from the socket into the read-buffer
+ *
+ * while the body of a large arg is streamed and nothing else is buffered,
+ * the bytes are read straight into the arg instead
  *
  * @param *conn: pointer to the Conn object
  *
+ * @return 1 if data was read, 0 on EAGAIN, -1 if the conn reached STATE_END
  */
-bool try_fill_buffer(Conn *conn)
+static int32_t read_once(Conn *conn)
 {
-    print("inside try_fill_buffer...");
-    assert(conn->rbuf_size < sizeof(conn->rbuf));
+    if (conn->shm && !conn->wbuf.empty())
+    {
+        // shm_recv() spins on an empty ring, the client gets the responses
+        // first since it may be waiting for them to send more
+        flush_responses(conn);
+        if (conn->state != STATE_REQ)
+        {
+            return (conn->state == STATE_END) ? -1 : 0;
+        }
+    }
+
+    std::string *arg = NULL;
+    if (conn->stream.active && conn->stream.stage == STREAM_ARG &&
+        conn->rbuf_head == conn->rbuf.size && conn->stream.arg_left >= k_read_min)
+    {
+        arg = &conn->stream.cmd.back();
+    }
+    else
+    {
+        conn->rbuf_room(k_read_min);
+    }
     ssize_t rv = 0;
 
     /**
@@ -358,9 +1145,19 @@ bool try_fill_buffer(Conn *conn)
      */
     do
     {
-        size_t cap = sizeof(conn->rbuf) - conn->rbuf_size;
+        if (arg)
+        {
+            size_t want = conn->stream.arg_left;
+            want = (want < k_stream_chunk) ? want : k_stream_chunk;
+            size_t got = conn->stream.arg_len - conn->stream.arg_left;
+            stream_grow(arg, got, want, conn->stream.arg_left);
+            rv = conn_read(conn, &(*arg)[got], want);
+            continue;
+        }
+
+        size_t cap = conn->rbuf.cap - conn->rbuf.size;
         print("cap", cap);
-        rv = read(conn->fd, &conn->rbuf[conn->rbuf_size], cap);
+        rv = conn_read(conn, &conn->rbuf.data[conn->rbuf.size], cap);
         print("rv fill", rv);
     } while (rv < 0 && errno == EINTR);
 
@@ -371,19 +1168,19 @@ bool try_fill_buffer(Conn *conn)
      */
     if (rv < 0 && errno == EAGAIN)
     {
-        return false;
+        return 0;
     }
 
     if (rv < 0)
     {
         msg("read() error");
         conn->state = STATE_END;
-        return false;
+        return -1;
     }
 
     if (rv == 0)
     {
-        if (conn->rbuf_size > 0)
+        if (conn->rbuf.size > conn->rbuf_head || conn->stream.active)
         {
             msg("unexpected EOF");
         }
@@ -392,30 +1189,135 @@ bool try_fill_buffer(Conn *conn)
             msg("EOF");
         }
         conn->state = STATE_END;
-        return false;
+        return -1;
     }
 
-    conn->rbuf_size += (size_t)rv;
-    assert(conn->rbuf_size <= sizeof(conn->rbuf));
+    conn->budget_bytes -= (conn->budget_bytes < (size_t)rv) ? conn->budget_bytes : (size_t)rv;
+    if (arg)
+    {
+        conn->stream.arg_left -= (uint32_t)rv;
+        conn->stream.left -= (uint32_t)rv;
+        return 1;
+    }
+
+    conn->rbuf.size += (size_t)rv;
+    assert(conn->rbuf.size <= conn->rbuf.cap);
+    return 1;
+}
+
+/**
+ * @brief fills buffer and calls try_one_request
+ *
+ * fills the read buffer to maximum cap possible
+ * while the state is in request mode, calls try_one_request in a loop
+ * the responses are only flushed once k_wbuf_flush bytes piled up,
+ * otherwise they wait for the end of the pass
+ * stops once the conn used its budget for this turn
+ *
+ * @param *conn: pointer to the Conn object
+ *
+ */
+bool try_fill_buffer(Conn *conn)
+{
+    print("inside try_fill_buffer...");
+    if (!conn->budget || !conn->budget_bytes || read_once(conn) <= 0)
+    {
+        return false;
+    }
 
     while (try_one_request(conn))
     {
     }
 
+    if (conn->wbuf.size() >= k_wbuf_flush)
+    {
+        flush_responses(conn);
+    }
+
     return (conn->state == STATE_REQ);
 }
 
 /**
- * @brief
+ * @brief I/O thread side of a read: drains the socket and parses the requests
+ *
+ * the parsed requests are left in cmds for the main thread to run,
+ * reading stops early once k_max_pipeline requests are parsed or the
+ * read budget of the turn is spent
+ *
+ */
+void Conn::io_read()
+{
+    while (this->state == STATE_REQ)
+    {
+        while (this->ncmds < k_max_pipeline && this->parse_request())
+        {
+        }
+        if (this->ncmds >= k_max_pipeline || !this->budget_bytes ||
+            read_once(this) <= 0)
+        {
+            break;
+        }
+    }
+}
+
+/**
+ * @brief I/O thread side of a write: flushes the responses, then reads
+ * and parses the next requests once they are out
+ *
+ */
+void Conn::io_write()
+{
+    if (this->state == STATE_RES)
+    {
+        state_res(this);
+    }
+    else
+    {
+        flush_responses(this);
+    }
+
+    if (this->state == STATE_REQ)
+    {
+        this->io_read();
+    }
+}
+
+/**
+ * @brief serves the buffered requests, then reads until EAGAIN and flushes
+ * the responses once at the end
  *
  * @param *conn: pointer to the Conn object
  *
  */
 void state_req(Conn *conn)
 {
+    while (try_one_request(conn))
+    {
+    }
+
     while (try_fill_buffer(conn))
     {
     }
+
+    flush_responses(conn);
+}
+
+/**
+ * @brief gives the conn a fresh budget, called before every turn
+ */
+void Conn::new_turn()
+{
+    this->budget = this->turn_requests;
+    this->budget_bytes = this->turn_bytes;
+}
+
+/**
+ * @return true if the conn stopped because its budget ran out, it may
+ * have more to do without any new event coming
+ */
+bool Conn::yielded() const
+{
+    return this->state == STATE_REQ && (!this->budget || !this->budget_bytes);
 }
 
 /**
@@ -426,16 +1328,13 @@ void state_req(Conn *conn)
  */
 void Conn::connection_io()
 {
-    if (this->state == STATE_REQ)
-    {
-        state_req(this);
-    }
-    else if (this->state == STATE_RES)
+    if (this->state == STATE_RES)
     {
         state_res(this);
     }
-    else
+
+    if (this->state == STATE_REQ)
     {
-        assert(0); // not expected
+        state_req(this);
     }
-}
\ No newline at end of file
+}
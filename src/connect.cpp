@@ -5,83 +5,117 @@
 #include "../include/connect.h"
 #include "../include/utils/print_utils.h"
 #include "../include/utils/string_utils.h"
+#include "../include/cmd_table.h"
 #include "../include/enums/res_enum.h"
 #include "../include/entry.h"
+#include "../include/epoch.h"
 
+/**
+ * shared by every thread of the web frontend: lookups take no lock, each
+ * request runs inside an epoch so a deleted entry stays valid until no
+ * request can still hold it
+ */
 static struct
 {
-    HMap db;
+    CMap db;
 } g_data;
 
 #define container_of(ptr, type, member) ({                  \
     const typeof( ((type *)0)->member ) *__mptr = (ptr);    \
     (type *)( (char *)__mptr - offsetof(type, member) ); })
 
-static bool entry_eq(HNode *lhs, HNode *rhs)
+static bool entry_eq(CNode *lhs, CNode *rhs)
 {
-    struct Entry *le = container_of(lhs, struct Entry, node);
-    struct Entry *re = container_of(rhs, struct Entry, node);
+    struct CEntry *le = container_of(lhs, struct CEntry, node);
+    struct CEntry *re = container_of(rhs, struct CEntry, node);
     return le->key == re->key;
 }
 
+static void entry_free(void *ent)
+{
+    delete (CEntry *)ent;
+}
+
 void Connect::do_set(std::vector<std::string> cmd)
 {
-    Entry key;
+    EpochGuard guard;
+    CEntry key;
     key.key.swap(cmd[1]);
     key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
+    Value val = std::make_shared<const std::string>(std::move(cmd[2]));
 
-    HNode *node = hm_lookup(&g_data.db, &key.node, &entry_eq);
-    if (node)
-    {
-        container_of(node, Entry, node)->val.swap(cmd[2]);
-    }
-    else
+    CNode *node = cm_lookup(&g_data.db, &key.node, &entry_eq);
+    if (!node)
     {
-        Entry *ent = new Entry();
+        CEntry *ent = new CEntry();
         ent->key.swap(key.key);
         ent->node.hcode = key.node.hcode;
-        ent->val.swap(cmd[2]);
-        hm_insert(&g_data.db, &ent->node);
+        ent->val = val;
+        node = cm_insert(&g_data.db, &ent->node, &entry_eq);
+        if (!node)
+        {
+            this->rescode = RES_OK;
+            return;
+        }
+        // inserted by another thread meanwhile, ours was never seen
+        delete ent;
     }
+    std::atomic_store(&container_of(node, CEntry, node)->val, val);
 
     this->rescode = RES_OK;
 }
 
 void Connect::do_get(std::vector<std::string> cmd)
 {
-    Entry key;
+    EpochGuard guard;
+    CEntry key;
     key.key = cmd[1];
     key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
 
-    HNode *node = hm_lookup(&g_data.db, &key.node, &entry_eq);
+    CNode *node = cm_lookup(&g_data.db, &key.node, &entry_eq);
     if (!node)
     {
         this->rescode = RES_NX;
         return;
     }
 
-    const std::string &val = container_of(node, Entry, node)->val;
-    assert(val.size() <= k_max_msg);
-    this->wbuf = val.data();
-    this->wbuf_size = val.size();
+    // shares the stored value, nothing is copied until it is sent
+    this->wbuf = std::atomic_load(&container_of(node, CEntry, node)->val);
+    this->wbuf_size = this->wbuf->size();
     this->rescode = RES_OK;
 }
 
 void Connect::do_del(std::vector<std::string> cmd)
 {
-    Entry key;
-    key.key.swap(cmd[1]);
-    key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
-
-    HNode *node = hm_pop(&g_data.db, &key.node, &entry_eq);
-    if (node)
+    EpochGuard guard;
+    for (size_t i = 1; i < cmd.size(); i++)
     {
-        delete container_of(node, Entry, node);
+        CEntry key;
+        key.key.swap(cmd[i]);
+        key.node.hcode = str_hash((uint8_t *)key.key.data(), key.key.size());
+
+        CNode *node = cm_pop(&g_data.db, &key.node, &entry_eq);
+        if (node)
+        {
+            epoch_retire(container_of(node, CEntry, node), &entry_free);
+        }
     }
 
     this->rescode = RES_OK;
 }
 
+// handlers indexed by cmd_enum, the RESP protocol commands are not served
+static void (Connect::*const k_handlers[CMD_COUNT])(std::vector<std::string>) = {
+    &Connect::do_get,  // CMD_GET
+    &Connect::do_set,  // CMD_SET
+    &Connect::do_del,  // CMD_DEL
+    NULL,              // CMD_PING
+    NULL,              // CMD_HELLO
+    NULL,              // CMD_INFO
+    NULL,              // CMD_EXISTS
+    NULL,              // CMD_MGET
+};
+
 void Connect::do_request(std::string data)
 {
     std::vector<std::string> cmd;
@@ -94,27 +128,16 @@ void Connect::do_request(std::string data)
         cmd.push_back(tmp);
     }
 
-    for (auto ci : cmd)
-        print(ci);
-
-    if (cmd.size() == 2 && cmd_is(cmd[0], "get"))
-    {
-        do_get(cmd);
-    }
-    else if (cmd.size() == 3 && cmd_is(cmd[0], "set"))
-    {
-        do_set(cmd);
-    }
-    else if (cmd.size() == 2 && cmd_is(cmd[0], "del"))
-    {
-        do_del(cmd);
-    }
-    else
+    const CmdSpec *spec = cmd.empty() ? NULL : cmd_find(cmd[0]);
+    if (!spec || !cmd_arity_ok(spec, cmd.size()) || !k_handlers[spec->id])
     {
         // cmd is not recognized
         this->rescode = RES_ERR;
         const char *msg = "Unknown cmd";
-        this->wbuf = msg;
+        this->wbuf = std::make_shared<const std::string>(msg);
         this->wbuf_size = strlen(msg);
+        return;
     }
+
+    (this->*k_handlers[spec->id])(cmd);
 }
\ No newline at end of file
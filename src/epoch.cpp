@@ -0,0 +1,179 @@
+#include <assert.h>
+#include <atomic>
+#include <vector>
+
+#include "../include/epoch.h"
+#include "../include/constants.h"
+
+struct Retired
+{
+    void *ptr;
+    void (*free_fn)(void *);
+};
+
+/**
+ * one per thread, never freed: a record left by an exiting thread is
+ * taken over by the next new one, with what it still has to free
+ */
+struct EpochRec
+{
+    alignas(64) std::atomic<uint64_t> state{0}; // epoch << 1 | 1 while inside
+    std::atomic<bool> in_use{true};
+    uint32_t depth = 0;
+    size_t since_advance = 0; // retired since the last try to advance
+    std::vector<Retired> bag[3];
+    uint64_t bag_epoch[3] = {};
+    EpochRec *next = NULL;
+};
+
+static std::atomic<uint64_t> g_epoch{0};
+static std::atomic<EpochRec *> g_recs{NULL};
+
+static void rec_release(EpochRec *rec);
+
+// gives the record back when the thread exits
+struct EpochRecHolder
+{
+    EpochRec *rec = NULL;
+    ~EpochRecHolder()
+    {
+        if (rec)
+        {
+            rec_release(rec);
+        }
+    }
+};
+
+static thread_local EpochRecHolder tls_epoch;
+
+static EpochRec *rec_get()
+{
+    if (tls_epoch.rec)
+    {
+        return tls_epoch.rec;
+    }
+
+    for (EpochRec *rec = g_recs.load(); rec; rec = rec->next)
+    {
+        bool expected = false;
+        if (!rec->in_use.load() && rec->in_use.compare_exchange_strong(expected, true))
+        {
+            tls_epoch.rec = rec;
+            return rec;
+        }
+    }
+
+    EpochRec *rec = new EpochRec();
+    EpochRec *head = g_recs.load();
+    do
+    {
+        rec->next = head;
+    } while (!g_recs.compare_exchange_weak(head, rec));
+    tls_epoch.rec = rec;
+    return rec;
+}
+
+/**
+ * @brief moves the global epoch one step, if every thread inside has
+ * seen the current one
+ */
+static void epoch_try_advance()
+{
+    uint64_t e = g_epoch.load();
+    for (EpochRec *rec = g_recs.load(); rec; rec = rec->next)
+    {
+        uint64_t s = rec->state.load();
+        if ((s & 1) && (s >> 1) != e)
+        {
+            return;
+        }
+    }
+    g_epoch.compare_exchange_strong(e, e + 1);
+}
+
+static void bag_free(std::vector<Retired> &bag)
+{
+    for (Retired &r : bag)
+    {
+        r.free_fn(r.ptr);
+    }
+    bag.clear();
+}
+
+/**
+ * @brief frees the bags retired at least 2 epochs ago
+ */
+static void rec_collect(EpochRec *rec)
+{
+    epoch_try_advance();
+    uint64_t e = g_epoch.load();
+    for (uint32_t j = 0; j < 3; j++)
+    {
+        if (rec->bag_epoch[j] + 2 <= e)
+        {
+            bag_free(rec->bag[j]);
+        }
+    }
+}
+
+// what is still too recent to free waits for the next owner of rec
+static void rec_release(EpochRec *rec)
+{
+    assert(rec->depth == 0);
+    rec->state.store(0);
+    rec_collect(rec);
+    rec->in_use.store(false);
+}
+
+void epoch_enter()
+{
+    EpochRec *rec = rec_get();
+    if (rec->depth++ == 0)
+    {
+        // seq_cst: published before any shared node is read
+        rec->state.store(g_epoch.load() << 1 | 1);
+    }
+}
+
+void epoch_exit()
+{
+    EpochRec *rec = tls_epoch.rec;
+    assert(rec && rec->depth > 0);
+    if (--rec->depth == 0)
+    {
+        rec->state.store(0, std::memory_order_release);
+    }
+}
+
+bool epoch_active()
+{
+    return tls_epoch.rec && tls_epoch.rec->depth > 0;
+}
+
+/**
+ * @brief frees ptr with free_fn once no thread can still hold it
+ *
+ * the node must already be unreachable for new readers. a node retired
+ * in epoch e is freed once the global epoch reaches e + 2: by then every
+ * thread inside at the time of the retire has left
+ */
+void epoch_retire(void *ptr, void (*free_fn)(void *))
+{
+    EpochRec *rec = rec_get();
+    uint64_t e = g_epoch.load();
+    uint32_t i = (uint32_t)(e % 3);
+    if (rec->bag_epoch[i] != e)
+    {
+        // same slot, so at least 3 epochs old
+        bag_free(rec->bag[i]);
+        rec->bag_epoch[i] = e;
+    }
+    rec->bag[i].push_back(Retired{ptr, free_fn});
+
+    if (++rec->since_advance < k_epoch_batch)
+    {
+        return;
+    }
+    rec->since_advance = 0;
+    rec_collect(rec);
+}
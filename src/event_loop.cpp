@@ -0,0 +1,224 @@
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <vector>
+
+#include "../include/event_loop.h"
+#include "../include/utils/print_utils.h"
+#include "../include/utils/stats_utils.h"
+
+EventLoop *EventLoop::create(uint32_t type)
+{
+    if (type == LOOP_POLL)
+    {
+        return new PollLoop();
+    }
+    return new EpollLoop();
+}
+
+/**
+ * @brief converts EV_* flags into epoll event flags
+ *
+ * EPOLLERR and EPOLLHUP are always reported by epoll, no need to ask for them
+ */
+static uint32_t to_epoll(uint32_t events)
+{
+    uint32_t out = 0;
+    out |= (events & EV_READ) ? (uint32_t)EPOLLIN : 0;
+    out |= (events & EV_WRITE) ? (uint32_t)EPOLLOUT : 0;
+    out |= (events & EV_EDGE) ? (uint32_t)EPOLLET : 0;
+    return out;
+}
+
+static uint32_t from_epoll(uint32_t events)
+{
+    uint32_t out = 0;
+    out |= (events & EPOLLIN) ? EV_READ : 0;
+    out |= (events & EPOLLOUT) ? EV_WRITE : 0;
+    out |= (events & (EPOLLERR | EPOLLHUP)) ? EV_ERR : 0;
+    return out;
+}
+
+EpollLoop::EpollLoop()
+{
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0)
+    {
+        die("epoll_create1()");
+    }
+    ready.resize(256);
+}
+
+EpollLoop::~EpollLoop()
+{
+    if (epfd >= 0)
+    {
+        close(epfd);
+    }
+}
+
+int EpollLoop::add(int fd, uint32_t events)
+{
+    struct epoll_event ev = {};
+    ev.events = to_epoll(events);
+    ev.data.fd = fd;
+    count_syscall();
+    return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/**
+ * @brief changes the interest set of a registered fd
+ *
+ * for edge-triggered fds, EPOLL_CTL_MOD re-arms the fd, so an event is
+ * reported right away if it is already ready for the new interest
+ */
+int EpollLoop::mod(int fd, uint32_t events)
+{
+    struct epoll_event ev = {};
+    ev.events = to_epoll(events);
+    ev.data.fd = fd;
+    count_syscall();
+    return epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+int EpollLoop::del(int fd)
+{
+    count_syscall();
+    return epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+/**
+ * @brief waits for ready fds and fills out with them
+ *
+ * only the fds which are ready are returned, so the cost of a wakeup
+ * follows the number of active connections rather than the total
+ *
+ * @return number of ready fds, -1 on error
+ */
+int EpollLoop::wait(std::vector<Event> &out, int timeout_ms)
+{
+    out.clear();
+    count_syscall();
+    int n = epoll_wait(epfd, ready.data(), (int)ready.size(), timeout_ms);
+    if (n < 0)
+    {
+        return (errno == EINTR) ? 0 : -1;
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        Event ev;
+        ev.fd = ready[i].data.fd;
+        ev.events = from_epoll(ready[i].events);
+        out.push_back(ev);
+    }
+
+    if ((size_t)n == ready.size())
+    {
+        // the array was filled up, give the next wait more room
+        ready.resize(ready.size() * 2);
+    }
+    return n;
+}
+
+static short to_poll(uint32_t events)
+{
+    short out = POLLERR;
+    out |= (events & EV_READ) ? POLLIN : 0;
+    out |= (events & EV_WRITE) ? POLLOUT : 0;
+    return out;
+}
+
+/**
+ * @brief registers fd, the pollfd array is kept across iterations
+ * and only touched when the interest set changes
+ */
+int PollLoop::add(int fd, uint32_t events)
+{
+    if (fd2idx.size() <= (size_t)fd)
+    {
+        fd2idx.resize(fd + 1, -1);
+    }
+    if (fd2idx[fd] >= 0)
+    {
+        errno = EEXIST;
+        return -1;
+    }
+
+    struct pollfd pfd = {fd, to_poll(events), 0};
+    fd2idx[fd] = (int)pfds.size();
+    pfds.push_back(pfd);
+    return 0;
+}
+
+int PollLoop::mod(int fd, uint32_t events)
+{
+    if (fd2idx.size() <= (size_t)fd || fd2idx[fd] < 0)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+    pfds[fd2idx[fd]].events = to_poll(events);
+    return 0;
+}
+
+/**
+ * @brief unregisters fd by moving the last pollfd into its slot
+ */
+int PollLoop::del(int fd)
+{
+    if (fd2idx.size() <= (size_t)fd || fd2idx[fd] < 0)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+
+    int idx = fd2idx[fd];
+    pfds[idx] = pfds.back();
+    fd2idx[pfds[idx].fd] = idx;
+    pfds.pop_back();
+    fd2idx[fd] = -1;
+    return 0;
+}
+
+int PollLoop::wait(std::vector<Event> &out, int timeout_ms)
+{
+    out.clear();
+
+    /**
+     * poll for active fds
+     *
+     * int poll(struct pollfd fds[], nfds_t nfds, int timeout);
+     *
+     * fds is the array of sockets we want to moniter
+     * nfds is the size of the array
+     * timeout is timeout in milliseconds, pass negative timeout to wait forever
+     *
+     * returns the number of elements in the array that have an event occur
+     *
+     */
+    count_syscall();
+    int n = poll(pfds.data(), (nfds_t)pfds.size(), timeout_ms);
+    if (n < 0)
+    {
+        return (errno == EINTR) ? 0 : -1;
+    }
+
+    for (size_t i = 0; i < pfds.size() && (int)out.size() < n; i++)
+    {
+        short re = pfds[i].revents;
+        if (!re)
+        {
+            continue;
+        }
+
+        Event ev;
+        ev.fd = pfds[i].fd;
+        ev.events |= (re & POLLIN) ? EV_READ : 0;
+        ev.events |= (re & POLLOUT) ? EV_WRITE : 0;
+        ev.events |= (re & (POLLERR | POLLHUP | POLLNVAL)) ? EV_ERR : 0;
+        out.push_back(ev);
+    }
+    return n;
+}
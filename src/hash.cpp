@@ -0,0 +1,206 @@
+#include <assert.h>
+#include <string.h>
+#include <sys/random.h>
+
+#include "../include/hash.h"
+#include "../include/utils/print_utils.h"
+
+// odd constants with well spread bits, from wyhash
+static const uint64_t k_mix0 = 0xa0761d6478bd642full;
+static const uint64_t k_mix1 = 0xe7037ed1a0b428dbull;
+
+static struct
+{
+    uint32_t mode = HASH_FAST;
+    uint64_t seed = 0;   // HASH_FAST
+    uint64_t sip[2] = {}; // HASH_SIP key
+} g_hash;
+
+/**
+ * @brief draws the seeds of this process, so the hashes and with them
+ * the slots of the keys cannot be guessed from outside
+ */
+static bool hash_seed()
+{
+    uint64_t rnd[3];
+    if (getrandom(rnd, sizeof(rnd), 0) != (ssize_t)sizeof(rnd))
+    {
+        die("getrandom()");
+    }
+    g_hash.seed = rnd[0];
+    g_hash.sip[0] = rnd[1];
+    g_hash.sip[1] = rnd[2];
+    return true;
+}
+
+static bool g_seeded = hash_seed();
+
+/**
+ * @brief picks the function behind str_hash(), see hash_enum
+ *
+ * HASH_FAST is seeded, but inputs colliding for every seed can be built
+ * against it. HASH_SIP is slower and keeps the slots unpredictable to
+ * clients that try to pile their keys into one probe sequence
+ *
+ * must be called before anything is hashed, the tables would not find
+ * their keys anymore
+ */
+void hash_set_mode(uint32_t mode)
+{
+    assert(g_seeded && (mode == HASH_FAST || mode == HASH_SIP));
+    g_hash.mode = mode;
+}
+
+/**
+ * @brief replaces the seeds drawn at start, so the hashes can be checked
+ * against known values
+ *
+ * same as hash_set_mode(), before anything is hashed
+ */
+void hash_set_seeds(uint64_t seed, const uint64_t sip[2])
+{
+    g_hash.seed = seed;
+    g_hash.sip[0] = sip[0];
+    g_hash.sip[1] = sip[1];
+}
+
+static uint64_t r8(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static uint64_t r4(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+/**
+ * @brief 64x64 -> 128 bits multiply, folded back to 64 bits
+ */
+static uint64_t mix(uint64_t a, uint64_t b)
+{
+    __uint128_t r = (__uint128_t)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+/**
+ * @brief wyhash-style hash, 16 bytes per multiply
+ *
+ * keys up to 16 bytes, most of them, take two overlapping reads and two
+ * multiplies without a loop
+ */
+static uint64_t fast_hash(const uint8_t *p, size_t len, uint64_t seed)
+{
+    seed ^= mix(seed ^ k_mix0, k_mix1);
+    uint64_t a = 0;
+    uint64_t b = 0;
+    if (len <= 16)
+    {
+        if (len >= 4)
+        {
+            size_t mid = (len >> 3) << 2;
+            a = (r4(p) << 32) | r4(p + mid);
+            b = (r4(p + len - 4) << 32) | r4(p + len - 4 - mid);
+        }
+        else if (len > 0)
+        {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+        }
+    }
+    else
+    {
+        size_t i = len;
+        while (i > 16)
+        {
+            seed = mix(r8(p) ^ k_mix1, r8(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        // the last 16 bytes, overlapping what was already mixed
+        a = r8(p + i - 16);
+        b = r8(p + i - 8);
+    }
+
+    __uint128_t r = (__uint128_t)(a ^ k_mix1) * (b ^ seed);
+    a = (uint64_t)r;
+    b = (uint64_t)(r >> 64);
+    return mix(a ^ k_mix0 ^ len, b ^ k_mix1);
+}
+
+#define ROTL(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND            \
+    do                      \
+    {                       \
+        v0 += v1;           \
+        v1 = ROTL(v1, 13);  \
+        v1 ^= v0;           \
+        v0 = ROTL(v0, 32);  \
+        v2 += v3;           \
+        v3 = ROTL(v3, 16);  \
+        v3 ^= v2;           \
+        v0 += v3;           \
+        v3 = ROTL(v3, 21);  \
+        v3 ^= v0;           \
+        v2 += v1;           \
+        v1 = ROTL(v1, 17);  \
+        v1 ^= v2;           \
+        v2 = ROTL(v2, 32);  \
+    } while (0)
+
+/**
+ * @brief SipHash-2-4, 8 bytes per step
+ */
+static uint64_t sip_hash(const uint8_t *p, size_t len, const uint64_t key[2])
+{
+    uint64_t v0 = key[0] ^ 0x736f6d6570736575ull;
+    uint64_t v1 = key[1] ^ 0x646f72616e646f6dull;
+    uint64_t v2 = key[0] ^ 0x6c7967656e657261ull;
+    uint64_t v3 = key[1] ^ 0x7465646279746573ull;
+
+    const uint8_t *end = p + (len & ~(size_t)7);
+    for (; p != end; p += 8)
+    {
+        uint64_t m = r8(p);
+        v3 ^= m;
+        SIPROUND;
+        SIPROUND;
+        v0 ^= m;
+    }
+
+    uint64_t m = (uint64_t)len << 56;
+    for (size_t i = 0; i < (len & 7); i++)
+    {
+        m |= (uint64_t)p[i] << (8 * i);
+    }
+    v3 ^= m;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= m;
+
+    v2 ^= 0xff;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/**
+ * @brief hashes a key with the function picked by hash_set_mode()
+ *
+ * all 64 bits are usable, the slot of an HTable comes from some of them
+ * and its tag from others
+ */
+uint64_t str_hash(const uint8_t *data, size_t len)
+{
+    if (g_hash.mode == HASH_SIP)
+    {
+        return sip_hash(data, len, g_hash.sip);
+    }
+    return fast_hash(data, len, g_hash.seed);
+}
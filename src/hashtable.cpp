@@ -1,90 +1,202 @@
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "../include/hashtable.h"
 #include "../include/constants.h"
+#include "../include/timer_wheel.h"
+
+// control bytes, a full slot has the 7-bit tag of its node instead
+static const uint8_t k_ctrl_empty = 0x80;
+static const uint8_t k_ctrl_deleted = 0xFE;
+static const size_t k_group = 16; // control bytes matched at once
+
+/**
+ * the slot comes from the hash without its low 7 bits, the tag from
+ * those. the top bits are left alone, they pick the stripe or the shard
+ * of the key, all the keys of one table may share them
+ */
+static size_t h_pos(uint64_t hcode, size_t mask)
+{
+    return (size_t)(hcode >> 7) & mask;
+}
+
+static uint8_t h_tag(uint64_t hcode)
+{
+    return (uint8_t)(hcode & 0x7F);
+}
+
+/**
+ * @return bit i is set if ctrl[i] == b, for the 16 bytes from ctrl
+ */
+static uint32_t group_match(const uint8_t *ctrl, uint8_t b)
+{
+#if defined(__SSE2__)
+    __m128i g = _mm_loadu_si128((const __m128i *)ctrl);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char)b)));
+#else
+    uint32_t m = 0;
+    for (size_t i = 0; i < k_group; i++)
+    {
+        m |= (uint32_t)(ctrl[i] == b) << i;
+    }
+    return m;
+#endif
+}
+
+/**
+ * @return bit i is set if ctrl[i] is EMPTY or DELETED, the only control
+ * bytes with the high bit set
+ */
+static uint32_t group_match_free(const uint8_t *ctrl)
+{
+#if defined(__SSE2__)
+    return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+#else
+    uint32_t m = 0;
+    for (size_t i = 0; i < k_group; i++)
+    {
+        m |= (uint32_t)(ctrl[i] >> 7) << i;
+    }
+    return m;
+#endif
+}
 
 /**
  * @brief initialize a hashtable with n slots
  *
- *
  * @param *htable: pointer to Htable
- * @param n: no of slots of the hashtable
+ * @param n: no of slots of the hashtable, at least one group
  */
 static void h_init(HTable *htable, size_t n)
 {
-    assert(n > 0 && ((n - 1) & n) == 0);
-    htable->table = (HNode **)calloc(sizeof(HNode *), n);
+    assert(n >= k_group && ((n - 1) & n) == 0);
+    htable->ctrl = (uint8_t *)malloc(n + k_group);
+    memset(htable->ctrl, k_ctrl_empty, n + k_group);
+    htable->slots = (HNode **)calloc(sizeof(HNode *), n);
     htable->mask = n - 1;
     htable->size = 0;
+    htable->used = 0;
+}
+
+static void h_free(HTable *htable)
+{
+    free(htable->ctrl);
+    free(htable->slots);
+    *htable = HTable{};
+}
+
+/**
+ * @brief sets the control byte of slot i, and its copy past the end if
+ * i is one of the first 16
+ */
+static void h_set_ctrl(HTable *htable, size_t i, uint8_t c)
+{
+    htable->ctrl[i] = c;
+    htable->ctrl[((i - k_group) & htable->mask) + k_group] = c;
 }
 
 /**
  * @brief inserts a HNode into the Htable
  *
- * finds the position of the slot and inserts the
- * new node at the start of the slot
+ * the groups are probed from the slot of the hash on, at growing
+ * distances, and the node takes the first EMPTY or DELETED slot. the
+ * table must have room, see hm_insert()
  *
  * @param *htable: pointer to Htable
  * @param *node: pointer to HNode to be inserted
  */
 static void h_insert(HTable *htable, HNode *node)
 {
-    size_t pos = node->hcode & htable->mask;
-    HNode *first_node = htable->table[pos];
-    node->next = first_node;
-    htable->table[pos] = node;
+    size_t pos = h_pos(node->hcode, htable->mask);
+    size_t step = 0;
+    uint32_t m;
+    while (!(m = group_match_free(&htable->ctrl[pos])))
+    {
+        step += k_group;
+        pos = (pos + step) & htable->mask;
+    }
+
+    size_t i = (pos + (size_t)__builtin_ctz(m)) & htable->mask;
+    htable->used += (htable->ctrl[i] == k_ctrl_empty);
+    h_set_ctrl(htable, i, h_tag(node->hcode));
+    htable->slots[i] = node;
     htable->size++;
 }
 
 /**
  * @brief lookup key in the hashtable
  *
- * finds the slot belonging to the key
- * checks in the chain if the key is present
+ * the groups are probed in the order of h_insert(), only the slots whose
+ * tag matches are compared, the probe ends at the first group with an
+ * EMPTY slot
  *
  * @param *htable: pointer to Htable
  * @param *key: key to be searched
  * @param (*eq)(HNode*, HNode*): equality callback for type HNode
  *
- * @return pointer to the address of the parent which
- * contains the node
+ * @return pointer to the slot holding the node
  */
 static HNode **h_lookup(HTable *htable, HNode *key, bool (*eq)(HNode *, HNode *))
 {
-    if (!htable->table)
+    if (!htable->ctrl)
     {
         return NULL;
     }
 
-    size_t pos = key->hcode & htable->mask;
-    HNode **from = &htable->table[pos]; // incoming pointer to the result
-    for (HNode *cur; (cur = *from) != NULL; from = &cur->next)
+    uint8_t tag = h_tag(key->hcode);
+    size_t pos = h_pos(key->hcode, htable->mask);
+    size_t step = 0;
+    while (true)
     {
-        if (cur->hcode == key->hcode && eq(cur, key))
+        const uint8_t *group = &htable->ctrl[pos];
+        for (uint32_t m = group_match(group, tag); m; m &= m - 1)
+        {
+            size_t i = (pos + (size_t)__builtin_ctz(m)) & htable->mask;
+            HNode *cur = htable->slots[i];
+            if (cur->hcode == key->hcode && eq(cur, key))
+            {
+                return &htable->slots[i];
+            }
+        }
+        if (group_match(group, k_ctrl_empty))
         {
-            return from;
+            return NULL;
         }
+        step += k_group;
+        pos = (pos + step) & htable->mask;
     }
-
-    return NULL;
 }
 
 /**
  * @brief removes the HNode from table
  *
- * the from pointer is the imcoming pointer to the node which has
- * to be deleted i.e. from->next is the node to be deleted
+ * the slot goes back to EMPTY if no probe can have gone past it, that is
+ * if it is in a run of less than 16 non-EMPTY slots, else it is marked
+ * DELETED so the probes still go on
  *
  * @param *htable: pointer to Htable
- * @param **from: the incoming node to the node which has to be removed
+ * @param **from: the slot of the node which has to be removed
  *
  * @return the detached node
  */
 static HNode *h_detach(HTable *htable, HNode **from)
 {
+    size_t i = (size_t)(from - htable->slots);
     HNode *node = *from;
-    *from = node->next;
+
+    uint32_t empty_after = group_match(&htable->ctrl[i], k_ctrl_empty);
+    uint32_t empty_before = group_match(&htable->ctrl[(i - k_group) & htable->mask], k_ctrl_empty);
+    bool never_full = empty_before && empty_after &&
+                      (size_t)(__builtin_clz(empty_before) - 16 + __builtin_ctz(empty_after)) < k_group;
+
+    h_set_ctrl(htable, i, never_full ? k_ctrl_empty : k_ctrl_deleted);
+    htable->used -= never_full;
+    *from = NULL;
     htable->size--;
     return node;
 }
@@ -94,33 +206,82 @@ static void hm_help_resizing(HMap *hmap)
     size_t nwork = 0;
     while (nwork < k_resizing_work && hmap->ht_secondary.size > 0)
     {
-        // scan for nodes from ht2 and move them to ht1
-        HNode **from = &hmap->ht_secondary.table[hmap->resizing_pos];
-        if (!*from)
+        // scan the slots of ht2 and move their nodes to ht1
+        assert(hmap->resizing_pos <= hmap->ht_secondary.mask);
+        HNode **from = &hmap->ht_secondary.slots[hmap->resizing_pos++];
+        if (*from)
         {
-            hmap->resizing_pos++;
-            continue;
+            h_insert(&hmap->ht_primary, h_detach(&hmap->ht_secondary, from));
         }
-
-        h_insert(&hmap->ht_primary, h_detach(&hmap->ht_secondary, from));
         nwork++;
     }
 
-    if (hmap->ht_secondary.size == 0 && hmap->ht_secondary.table)
+    if (hmap->ht_secondary.size == 0 && hmap->ht_secondary.ctrl)
     {
         // done
-        free(hmap->ht_secondary.table);
-        hmap->ht_secondary = HTable{};
+        h_free(&hmap->ht_secondary);
     }
 }
 
-static void hm_start_resizing(HMap *hmap)
+/**
+ * @brief moves the table aside and starts an empty one of n slots, the
+ * nodes follow a few at a time, see hm_help_resizing()
+ */
+static void hm_start_resizing(HMap *hmap, size_t n)
 {
-    assert(hmap->ht_secondary.table == NULL);
-    // create a bigger hashtable and swap them
+    assert(hmap->ht_secondary.ctrl == NULL);
     hmap->ht_secondary = hmap->ht_primary;
-    h_init(&hmap->ht_primary, (hmap->ht_primary.mask + 1) * 2);
+    h_init(&hmap->ht_primary, n);
     hmap->resizing_pos = 0;
+    hmap->resizes++;
+}
+
+/**
+ * @brief starts growing a table that has no EMPTY slots to spare
+ *
+ * the new table is twice as large, or as large if the old one is mostly
+ * DELETED slots. either way the old nodes and the inserts made until they
+ * are all moved stay under the load limit of the new table
+ */
+static void hm_grow(HMap *hmap)
+{
+    size_t n = hmap->ht_primary.mask + 1;
+    if (2 * (hmap->ht_primary.size + 1) * 8 > n * k_max_load_eighths)
+    {
+        n *= 2;
+    }
+    hm_start_resizing(hmap, n);
+}
+
+/**
+ * @brief starts shrinking the table once it is mostly empty
+ *
+ * it shrinks below k_min_load_eighths and grows past k_max_load_eighths,
+ * the new table is sized for half the max load, so that a few inserts or
+ * deletes right after cannot resize it back. room is also left for one
+ * insert per call until the old table is moved, k_resizing_work slots of
+ * it a call
+ */
+static void hm_maybe_shrink(HMap *hmap)
+{
+    HTable *ht = &hmap->ht_primary;
+    size_t cap = ht->mask + 1;
+    if (hmap->ht_secondary.ctrl || cap == k_group ||
+        ht->size * 8 >= cap * k_min_load_eighths)
+    {
+        return;
+    }
+
+    size_t want = ht->size + 1 + cap / k_resizing_work;
+    size_t n = k_group;
+    while (n * k_max_load_eighths < 2 * want * 8)
+    {
+        n *= 2;
+    }
+    if (n < cap)
+    {
+        hm_start_resizing(hmap, n);
+    }
 }
 
 /**
@@ -129,13 +290,16 @@ static void hm_start_resizing(HMap *hmap)
  * the new table is the main table which is used
  * we insert the node in the new table
  *
- * if old table is not in use(meaning no resizing has
- * happened or previous resizing is complete),
- * we check the load-factor i.e. no of elements to no of buckets
- * resizing process is started if load-factor is more than threshold
+ * the insert moves k_resizing_work slots of a resize in progress, so the
+ * new table is drained before the inserts can fill it, see hm_grow().
+ * lookups and deletes leave that work to hm_rehash()
+ *
+ * resizing is started once the used slots, DELETED ones included, would
+ * go past k_max_load_eighths of the table. it always has some EMPTY slots
+ * left that way, they end the probes of missing keys
  *
  * for resizing, the old table now holds the values of the new table
- * and new table is reinitialized with a bigger size
+ * and new table is reinitialized, see hm_grow()
  *
  * @param *hmap: pointer to HMap
  * @param *node: pointer to HNode to be inserted
@@ -143,37 +307,44 @@ static void hm_start_resizing(HMap *hmap)
  */
 void hm_insert(HMap *hmap, HNode *node)
 {
-    if (!hmap->ht_primary.table)
+    HTable *ht = &hmap->ht_primary;
+    if (!ht->ctrl)
     {
-        h_init(&hmap->ht_primary, 4);
+        h_init(ht, k_group);
     }
-    h_insert(&hmap->ht_primary, node);
-
-    if (!hmap->ht_secondary.table)
+    else if ((ht->used + 1) * 8 > (ht->mask + 1) * k_max_load_eighths)
     {
-        size_t load_factor = hmap->ht_primary.size / (hmap->ht_primary.mask + 1);
-        if (load_factor >= k_max_load_factor)
+        // the previous resize is long done by now, see hm_grow()
+        while (hmap->ht_secondary.ctrl)
         {
-            hm_start_resizing(hmap);
+            hm_help_resizing(hmap);
         }
+        hm_grow(hmap);
     }
+    h_insert(ht, node);
     hm_help_resizing(hmap);
 }
 
 HNode *hm_lookup(HMap *hmap, HNode *key, bool (*eq)(HNode *, HNode *))
 {
-    hm_help_resizing(hmap);
     HNode **from = h_lookup(&hmap->ht_primary, key, eq);
     from = from ? from : h_lookup(&hmap->ht_secondary, key, eq);
     return from ? *from : NULL;
 }
 
+/**
+ * @brief removes the node matching key from the hashmap
+ *
+ * the table starts shrinking once most of its slots are free, the nodes
+ * are moved to the smaller table like they are on growth
+ */
 HNode *hm_pop(HMap *hmap, HNode *key, bool (*eq)(HNode *, HNode *))
 {
-    hm_help_resizing(hmap);
     if (HNode **from = h_lookup(&hmap->ht_primary, key, eq))
     {
-        return h_detach(&hmap->ht_primary, from);
+        HNode *node = h_detach(&hmap->ht_primary, from);
+        hm_maybe_shrink(hmap);
+        return node;
     }
     if (HNode **from = h_lookup(&hmap->ht_secondary, key, eq))
     {
@@ -187,9 +358,51 @@ size_t hm_size(HMap *hmap)
     return hmap->ht_primary.size + hmap->ht_secondary.size;
 }
 
+/**
+ * @brief moves the nodes of a resize in progress for about budget_us,
+ * k_resizing_work slots at a time
+ *
+ * called from a cron, so a resize finishes even if nothing is inserted
+ * and the lookups do not pay for it. it also starts the shrink of a
+ * table emptied while it was still growing
+ *
+ * @return true if the resize is not done yet
+ */
+bool hm_rehash(HMap *hmap, uint64_t budget_us)
+{
+    uint64_t start = monotonic_us();
+    uint64_t now = start;
+    while (hmap->ht_secondary.ctrl && now - start < budget_us)
+    {
+        hm_help_resizing(hmap);
+        now = monotonic_us();
+    }
+    hmap->rehash_us += now - start;
+
+    if (!hmap->ht_secondary.ctrl)
+    {
+        hm_maybe_shrink(hmap);
+    }
+    return hmap->ht_secondary.ctrl != NULL;
+}
+
+HMapStats hm_stats(HMap *hmap)
+{
+    HMapStats st;
+    st.size = hm_size(hmap);
+    st.resizing = hmap->ht_secondary.ctrl != NULL;
+    if (st.resizing)
+    {
+        st.progress = (uint32_t)(hmap->resizing_pos * 100 / (hmap->ht_secondary.mask + 1));
+    }
+    st.resizes = hmap->resizes;
+    st.rehash_us = hmap->rehash_us;
+    return st;
+}
+
 void hm_destroy(HMap *hmap)
 {
-    free(hmap->ht_primary.table);
-    free(hmap->ht_secondary.table);
+    h_free(&hmap->ht_primary);
+    h_free(&hmap->ht_secondary);
     *hmap = HMap{};
-}
\ No newline at end of file
+}
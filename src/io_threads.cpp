@@ -0,0 +1,99 @@
+#include <vector>
+#include <thread>
+#include <mutex>
+
+#include "../include/io_threads.h"
+#include "../include/constants.h"
+
+/**
+ * @param n_threads: threads doing I/O including the main thread,
+ * so n_threads - 1 threads are started
+ */
+IoThreads::IoThreads(uint32_t n_threads)
+{
+    for (uint32_t i = 1; i < n_threads; i++)
+    {
+        threads.emplace_back(&IoThreads::worker, this, i);
+    }
+}
+
+IoThreads::~IoThreads()
+{
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        stopping = true;
+    }
+    cv.notify_all();
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+}
+
+/**
+ * @brief runs fn on every conn of the batch whose index maps to thread id
+ */
+void IoThreads::run_share(uint32_t id)
+{
+    size_t step = threads.size() + 1;
+    for (size_t i = id; i < batch->size(); i += step)
+    {
+        ((*batch)[i]->*fn)();
+    }
+}
+
+void IoThreads::worker(uint32_t id)
+{
+    uint64_t seen = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mu);
+            cv.wait(lock, [&]()
+                    { return stopping || gen != seen; });
+            if (stopping)
+            {
+                return;
+            }
+            seen = gen;
+        }
+
+        run_share(id);
+        remaining.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+/**
+ * @brief runs fn on every conn of the batch, spread over the I/O threads
+ *
+ * small batches are not worth a wakeup and run on the calling thread
+ *
+ * @param conns: batch of connections
+ * @param fn: Conn::io_read or Conn::io_write
+ */
+void IoThreads::run(std::vector<Conn *> &conns, void (Conn::*fn)())
+{
+    if (threads.empty() || conns.size() < k_io_threads_min_batch)
+    {
+        for (Conn *conn : conns)
+        {
+            (conn->*fn)();
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        this->batch = &conns;
+        this->fn = fn;
+        remaining.store((uint32_t)threads.size(), std::memory_order_relaxed);
+        gen++;
+    }
+    cv.notify_all();
+
+    run_share(0);
+    while (remaining.load(std::memory_order_acquire) != 0)
+    {
+        std::this_thread::yield();
+    }
+}
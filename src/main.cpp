@@ -1,17 +1,186 @@
 #include "../include/server.h"
 #include "../include/conn.h"
 #include "../include/connect.h"
+#include "../include/hash.h"
 #include "../include/utils/print_utils.h"
 #include "../include/enums/res_enum.h"
+#include "../include/enums/loop_enum.h"
 #include "../include/web_socket_server.h"
 
 #include <iostream>
+#include <stdlib.h>
+#include <string.h>
 
 #include "../include/crow_all.h"
 
+// what the command line asked for, see parse_options()
+struct Options
+{
+    uint32_t loop_type = LOOP_EPOLL;
+    uint32_t reactors = 0;
+    uint32_t shards = 0;
+    uint32_t io_threads = 0;
+    uint32_t hash_mode = HASH_FAST;
+    const char *unix_path = NULL;
+    const char *shm_path = NULL;
+    bool web = false;
+};
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [--loop epoll|poll|uring] [--reactors n | --shards n]\n"
+            "          [--io-threads n] [--unix path] [--shm path] [--hash fast|sip] [--web]\n"
+            "\n"
+            "  --loop        event loop backend, epoll by default\n"
+            "  --reactors    n threads sharing the keyspace, SO_REUSEPORT listeners\n"
+            "  --shards      n threads each owning a part of the keyspace\n"
+            "  --io-threads  n threads reading and writing for the single reactor\n"
+            "  --unix        extra listener on a Unix domain socket\n"
+            "  --shm         listener handing out shared memory rings\n"
+            "  --hash        key hash, fast by default, sip for SipHash-2-4 when\n"
+            "                clients may pick keys to collide\n"
+            "  --web         WebSocket frontend on port 18080 instead\n",
+            prog);
+    exit(2);
+}
+
+static uint32_t parse_count(const char *prog, const char *arg)
+{
+    char *end = NULL;
+    long n = arg ? strtol(arg, &end, 10) : 0;
+    if (!arg || *end || n < 1 || n > 1024)
+    {
+        usage(prog);
+    }
+    return (uint32_t)n;
+}
+
+/**
+ * @brief fills opts from argv, exits with the usage on a bad option
+ */
+static void parse_options(int argc, char **argv, Options &opts)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char *opt = argv[i];
+        const char *arg = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (!strcmp(opt, "--web"))
+        {
+            opts.web = true;
+            continue;
+        }
+        if (!arg)
+        {
+            usage(argv[0]);
+        }
+        i++;
+
+        if (!strcmp(opt, "--loop"))
+        {
+            if (!strcmp(arg, "epoll"))
+            {
+                opts.loop_type = LOOP_EPOLL;
+            }
+            else if (!strcmp(arg, "poll"))
+            {
+                opts.loop_type = LOOP_POLL;
+            }
+            else if (!strcmp(arg, "uring"))
+            {
+                opts.loop_type = LOOP_URING;
+            }
+            else
+            {
+                usage(argv[0]);
+            }
+        }
+        else if (!strcmp(opt, "--reactors"))
+        {
+            opts.reactors = parse_count(argv[0], arg);
+        }
+        else if (!strcmp(opt, "--shards"))
+        {
+            opts.shards = parse_count(argv[0], arg);
+        }
+        else if (!strcmp(opt, "--io-threads"))
+        {
+            opts.io_threads = parse_count(argv[0], arg);
+        }
+        else if (!strcmp(opt, "--hash"))
+        {
+            if (!strcmp(arg, "fast"))
+            {
+                opts.hash_mode = HASH_FAST;
+            }
+            else if (!strcmp(arg, "sip"))
+            {
+                opts.hash_mode = HASH_SIP;
+            }
+            else
+            {
+                usage(argv[0]);
+            }
+        }
+        else if (!strcmp(opt, "--unix"))
+        {
+            opts.unix_path = arg;
+        }
+        else if (!strcmp(opt, "--shm"))
+        {
+            opts.shm_path = arg;
+        }
+        else
+        {
+            usage(argv[0]);
+        }
+    }
+
+    // the extra listeners and the I/O threads belong to a single reactor
+    bool single = opts.io_threads || opts.unix_path || opts.shm_path;
+    if ((opts.reactors && opts.shards) || ((opts.reactors || opts.shards) && single))
+    {
+        usage(argv[0]);
+    }
+}
+
 int main(int argc, char **argv)
 {
-    std::string input = "set key value";
-    Connect *connect = new Connect();
-    connect->do_request(input);
-}
\ No newline at end of file
+    Options opts;
+    parse_options(argc, argv, opts);
+    // before any key is hashed
+    hash_set_mode(opts.hash_mode);
+
+    if (opts.web)
+    {
+        WebSocketServer::init();
+        return 0;
+    }
+    if (opts.reactors)
+    {
+        Server::run_reactors(opts.reactors, opts.loop_type);
+        return 0;
+    }
+    if (opts.shards)
+    {
+        Server::run_shards(opts.shards, opts.loop_type);
+        return 0;
+    }
+
+    Server server(opts.loop_type);
+    if (opts.io_threads)
+    {
+        server.set_io_threads(opts.io_threads);
+    }
+    int fd = server.init();
+    if (opts.unix_path && server.init_unix(opts.unix_path) < 0)
+    {
+        return 1;
+    }
+    if (opts.shm_path && server.init_shm(opts.shm_path) < 0)
+    {
+        return 1;
+    }
+    server.run_server(fd);
+    return 0;
+}
@@ -0,0 +1,367 @@
+#include <assert.h>
+#include <string.h>
+
+#include "../include/out_buf.h"
+#include "../include/constants.h"
+#include "../include/enums/serial_enum.h"
+#include "../include/enums/error_enum.h"
+
+void OutBuf::append(const void *src, size_t n)
+{
+    this->buf.append(src, n);
+}
+
+/**
+ * @brief appends a stored value, by reference if it is large enough
+ * for the copy to cost more than one more iovec
+ */
+void OutBuf::append_value(const Value &val)
+{
+    if (val->size() < k_zero_copy_min)
+    {
+        this->buf.append(val->data(), val->size());
+        return;
+    }
+
+    OutRef ref;
+    ref.off = this->buf.size;
+    ref.val = val;
+    this->refs.push_back(ref);
+    this->refs_len += val->size();
+}
+
+/**
+ * @brief formats "<type><n>\r\n", the header of most RESP types, so
+ * that it ends right before end
+ *
+ * @return where it starts, at most 24 bytes before end
+ */
+static char *format_line(char *end, char type, int64_t n)
+{
+    char *p = end;
+    *--p = '\n';
+    *--p = '\r';
+    uint64_t v = (n < 0) ? -(uint64_t)n : (uint64_t)n;
+    do
+    {
+        *--p = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    if (n < 0)
+    {
+        *--p = '-';
+    }
+    *--p = type;
+    return p;
+}
+
+static void append_line(OutBuf &out, char type, int64_t n)
+{
+    char tmp[24];
+    char *p = format_line(&tmp[sizeof(tmp)], type, n);
+    out.append(p, (size_t)(&tmp[sizeof(tmp)] - p));
+}
+
+/**
+ * @brief appends a serial_enum tag followed by a u32, the header of the
+ * tagged strings and arrays of the binary protocol
+ */
+static void append_tag(OutBuf &out, uint8_t tag, uint32_t n)
+{
+    uint8_t tmp[1 + 4];
+    tmp[0] = tag;
+    memcpy(&tmp[1], &n, 4);
+    out.append(tmp, sizeof(tmp));
+}
+
+/**
+ * @brief counts one more complete element of the innermost open array,
+ * closing the arrays that are complete with it. binary protocol only
+ */
+void OutBuf::elem_done()
+{
+    while (!this->arr_left.empty())
+    {
+        size_t &left = this->arr_left.back();
+        if (--left > 0)
+        {
+            return;
+        }
+        this->arr_left.pop_back();
+    }
+}
+
+void OutBuf::reply_nil()
+{
+    if (this->proto == PROTO_RESP2)
+    {
+        this->append("$-1\r\n", 5);
+    }
+    else if (this->proto == PROTO_RESP3)
+    {
+        this->append("_\r\n", 3);
+    }
+    else if (this->tagged())
+    {
+        uint8_t tag = SER_NIL;
+        this->append(&tag, 1);
+        this->elem_done();
+    }
+}
+
+void OutBuf::reply_status(const char *s)
+{
+    if (this->proto != PROTO_BIN)
+    {
+        this->append("+", 1);
+        this->append(s, strlen(s));
+        this->append("\r\n", 2);
+    }
+    else if (this->tagged())
+    {
+        this->reply_str(s, strlen(s));
+    }
+}
+
+void OutBuf::reply_int(int64_t n)
+{
+    if (this->proto != PROTO_BIN)
+    {
+        append_line(*this, ':', n);
+    }
+    else if (this->tagged())
+    {
+        uint8_t tmp[1 + 8];
+        tmp[0] = SER_INT;
+        memcpy(&tmp[1], &n, 8);
+        this->append(tmp, sizeof(tmp));
+        this->elem_done();
+    }
+}
+
+void OutBuf::reply_str(const char *s, size_t n)
+{
+    if (this->proto != PROTO_BIN)
+    {
+        append_line(*this, '$', (int64_t)n);
+        this->append(s, n);
+        this->append("\r\n", 2);
+        return;
+    }
+    bool tagged = this->tagged();
+    if (tagged)
+    {
+        append_tag(*this, SER_STR, (uint32_t)n);
+    }
+    this->append(s, n);
+    if (tagged)
+    {
+        this->elem_done();
+    }
+}
+
+/**
+ * @brief replies with a stored value, sent by reference if large enough
+ */
+void OutBuf::reply_value(const Value &val)
+{
+    if (this->proto != PROTO_BIN)
+    {
+        append_line(*this, '$', (int64_t)val->size());
+        this->append_value(val);
+        this->append("\r\n", 2);
+        return;
+    }
+    bool tagged = this->tagged();
+    if (tagged)
+    {
+        append_tag(*this, SER_STR, (uint32_t)val->size());
+    }
+    this->append_value(val);
+    if (tagged)
+    {
+        this->elem_done();
+    }
+}
+
+/**
+ * @param code: error code according to error_enum, it picks the prefix
+ * of the RESP error
+ */
+void OutBuf::reply_err(uint32_t code, const char *msg)
+{
+    size_t n = strlen(msg);
+    if (this->proto != PROTO_BIN)
+    {
+        const char *prefix = (code == ERR_NOPROTO) ? "-NOPROTO " : "-ERR ";
+        this->append(prefix, strlen(prefix));
+        this->append(msg, n);
+        this->append("\r\n", 2);
+        return;
+    }
+    bool tagged = this->tagged();
+    if (tagged)
+    {
+        uint8_t tmp[1 + 4 + 4];
+        uint32_t len = (uint32_t)n;
+        tmp[0] = SER_ERR;
+        memcpy(&tmp[1], &code, 4);
+        memcpy(&tmp[5], &len, 4);
+        this->append(tmp, sizeof(tmp));
+    }
+    this->append(msg, n);
+    if (tagged)
+    {
+        this->elem_done();
+    }
+}
+
+/**
+ * @brief starts an array of n replies, the next n reply_*() calls are
+ * its elements
+ */
+void OutBuf::reply_arr(size_t n)
+{
+    if (this->proto != PROTO_BIN)
+    {
+        append_line(*this, '*', (int64_t)n);
+        return;
+    }
+    append_tag(*this, SER_ARR, (uint32_t)n);
+    if (n == 0)
+    {
+        this->elem_done();
+        return;
+    }
+    this->arr_left.push_back(n);
+}
+
+/**
+ * @brief starts a map of n key/value pairs, RESP2 and the binary
+ * protocol get them as a flat array
+ */
+void OutBuf::reply_map(size_t n)
+{
+    if (this->proto == PROTO_RESP3)
+    {
+        append_line(*this, '%', (int64_t)n);
+        return;
+    }
+    this->reply_arr(2 * n);
+}
+
+/**
+ * @brief moves the content of other to the end, other is left empty
+ *
+ * other must not have sent anything yet
+ */
+void OutBuf::splice(OutBuf &other)
+{
+    assert(other.sent == 0 && other.ref_done == 0);
+    size_t base = this->buf.size;
+    this->buf.append(other.buf.data, other.buf.size);
+    for (OutRef &ref : other.refs)
+    {
+        ref.off += base;
+        this->refs_len += ref.val->size();
+        this->refs.push_back(std::move(ref));
+    }
+    other.clear();
+}
+
+/**
+ * @return number of bytes not sent yet
+ */
+size_t OutBuf::unsent() const
+{
+    size_t n = this->buf.size - this->sent;
+    for (size_t i = this->ref_done; i < this->refs.size(); i++)
+    {
+        n += this->refs[i].val->size();
+    }
+    return n - this->ref_sent;
+}
+
+/**
+ * @brief describes the unsent bytes, from the cursor on
+ *
+ * @param *iov: filled with at most max entries
+ *
+ * @return number of entries filled, 0 if everything was sent
+ */
+size_t OutBuf::iov(struct iovec *iov, size_t max) const
+{
+    size_t cnt = 0;
+    size_t pos = this->sent;
+    size_t i = this->ref_done;
+    size_t ref_off = this->ref_sent;
+    while (cnt < max)
+    {
+        size_t end = (i < this->refs.size()) ? this->refs[i].off : this->buf.size;
+        if (pos < end)
+        {
+            iov[cnt].iov_base = &this->buf.data[pos];
+            iov[cnt].iov_len = end - pos;
+            cnt++;
+            pos = end;
+            continue;
+        }
+        if (i == this->refs.size())
+        {
+            break;
+        }
+
+        const Value &val = this->refs[i].val;
+        iov[cnt].iov_base = (void *)(val->data() + ref_off);
+        iov[cnt].iov_len = val->size() - ref_off;
+        cnt++;
+        ref_off = 0;
+        i++;
+    }
+    return cnt;
+}
+
+/**
+ * @brief moves the cursor past n sent bytes, a value is let go as soon
+ * as it was fully sent
+ */
+void OutBuf::consume(size_t n)
+{
+    while (n)
+    {
+        size_t end = (this->ref_done < this->refs.size())
+                         ? this->refs[this->ref_done].off
+                         : this->buf.size;
+        if (this->sent < end)
+        {
+            size_t k = (n < end - this->sent) ? n : end - this->sent;
+            this->sent += k;
+            n -= k;
+            continue;
+        }
+
+        assert(this->ref_done < this->refs.size());
+        OutRef &ref = this->refs[this->ref_done];
+        size_t left = ref.val->size() - this->ref_sent;
+        size_t k = (n < left) ? n : left;
+        this->ref_sent += k;
+        n -= k;
+        if (this->ref_sent == ref.val->size())
+        {
+            ref.val.reset();
+            this->ref_done++;
+            this->ref_sent = 0;
+        }
+    }
+}
+
+void OutBuf::clear()
+{
+    this->buf.clear();
+    this->refs.clear();
+    this->refs_len = 0;
+    this->sent = 0;
+    this->ref_done = 0;
+    this->ref_sent = 0;
+    this->arr_left.clear();
+}
@@ -0,0 +1,301 @@
+#include <ctype.h>
+#include <string.h>
+
+#include "../include/resp.h"
+#include "../include/constants.h"
+#include "../include/enums/proto_enum.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// longest "*<n>\r\n" or "$<len>\r\n" line accepted
+const size_t k_resp_line_max = 24;
+
+static_assert(k_max_args < (1 << 16), "resp_detect() needs the argc of binary requests below 2^16");
+
+/**
+ * @brief checks that the bytes at hand start with a whole RESP line, a
+ * multibulk header "*<n>\r\n" or a printable inline command, followed by
+ * nothing or the start of the next command
+ */
+static bool resp_line_whole(const uint8_t *data, size_t avail)
+{
+    const uint8_t *lf = (const uint8_t *)memchr(data, '\n', avail);
+    if (!lf)
+    {
+        return false;
+    }
+    const uint8_t *eol = (lf > data && lf[-1] == '\r') ? lf - 1 : lf;
+    for (const uint8_t *p = data + 1; p < eol; p++)
+    {
+        if ((data[0] == '*') ? !isdigit(*p) : !isprint(*p))
+        {
+            return false;
+        }
+    }
+    if (data[0] == '*' && eol - data < 2)
+    {
+        return false;
+    }
+    const uint8_t *next = lf + 1;
+    return next == data + avail || *next == '*' || isalpha(*next);
+}
+
+/**
+ * @brief tells the binary protocol from RESP by the first bytes of a conn
+ *
+ * RESP starts with '*', an inline command with a letter. a binary request
+ * starts with its u32 length, the 4th byte of which is 0 below 16 MB.
+ * above, its first byte may be anything, but the u32 argc that follows is
+ * at most k_max_args so bytes 6 and 7 are 0, which no RESP header or
+ * inline command has. until 8 bytes came, only a whole RESP line, sent by
+ * a client that now waits for the reply, is taken as RESP
+ *
+ * @param *proto: set to PROTO_BIN or PROTO_RESP2 once known
+ *
+ * @return false if more bytes are needed to decide
+ */
+bool resp_detect(const uint8_t *data, size_t avail, uint32_t *proto)
+{
+    if (avail == 0)
+    {
+        return false;
+    }
+    if (data[0] != '*' && !isalpha(data[0]))
+    {
+        *proto = PROTO_BIN;
+        return true;
+    }
+    if (avail >= 4 && data[3] == 0)
+    {
+        *proto = PROTO_BIN;
+        return true;
+    }
+    if (avail >= 8)
+    {
+        *proto = (data[6] == 0 && data[7] == 0) ? PROTO_BIN : PROTO_RESP2;
+        return true;
+    }
+    if (resp_line_whole(data, avail))
+    {
+        *proto = PROTO_RESP2; // a short command, like "x\r\n" or "*0\r\n"
+        return true;
+    }
+    return false;
+}
+
+#if defined(__SSE2__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+/**
+ * @brief decodes n <= 8 ascii digits at once
+ *
+ * 8 bytes are loaded, p[n..8) must be readable but are ignored
+ *
+ * @return false if one of the n bytes is not a digit
+ */
+static bool decode_digits8(const uint8_t *p, size_t n, size_t *v)
+{
+    uint64_t w = 0;
+    memcpy(&w, p, 8);
+    w <<= 8 * (8 - n); // p[0] is the most significant digit, zeros in front
+    uint64_t mask = ~0ull << (8 * (8 - n)); // bytes of the number
+
+    // a digit is 0x3_ and stays 0x3_ once 6 is added
+    const uint64_t high = 0xF0F0F0F0F0F0F0F0ull;
+    const uint64_t zeros = 0x3030303030303030ull;
+    if ((((w & high) ^ zeros) & mask) ||
+        ((((w + 0x0606060606060606ull) & high) ^ zeros) & mask))
+    {
+        return false;
+    }
+
+    w &= 0x0F0F0F0F0F0F0F0Full;
+    w = (w * 10 + (w >> 8)) & 0x00FF00FF00FF00FFull;
+    w = (w * 100 + (w >> 16)) & 0x0000FFFF0000FFFFull;
+    *v = (size_t)((w * 10000 + (w >> 32)) & 0xFFFFFFFFull);
+    return true;
+}
+#endif
+/**
+ * @brief reads a "<type><decimal>\r\n" line, byte by byte
+ *
+ * @param **next: set past the line
+ *
+ * @return 1 if read, 0 if incomplete, -1 on a malformed line
+ */
+static int32_t read_line_scalar(const uint8_t *p, const uint8_t *end, uint8_t type,
+                                size_t *n, const uint8_t **next)
+{
+    size_t lim = (size_t)(end - p);
+    lim = (lim < k_resp_line_max) ? lim : k_resp_line_max;
+    const uint8_t *lf = (const uint8_t *)memchr(p, '\n', lim);
+    if (!lf)
+    {
+        return (lim == k_resp_line_max) ? -1 : 0;
+    }
+    if (p[0] != type || lf - p < 3 || lf - p > 20 || lf[-1] != '\r')
+    {
+        return -1;
+    }
+
+    size_t v = 0;
+    for (const uint8_t *d = p + 1; d < lf - 1; d++)
+    {
+        if (*d < '0' || *d > '9')
+        {
+            return -1;
+        }
+        v = v * 10 + (*d - '0'); // at most 18 digits, can't overflow
+    }
+    *n = v;
+    *next = lf + 1;
+    return 1;
+}
+
+/**
+ * @brief reads a "<type><decimal>\r\n" line
+ *
+ * with 17 bytes at hand the '\r' is found by one SSE2 compare and up to
+ * 8 digits are decoded at once, anything else takes the scalar path
+ *
+ * @param **next: set past the line
+ *
+ * @return 1 if read, 0 if incomplete, -1 on a malformed line
+ */
+static inline int32_t read_line(const uint8_t *p, const uint8_t *end, uint8_t type,
+                                size_t *n, const uint8_t **next)
+{
+#if defined(__SSE2__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (end - p > 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        uint32_t crs = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+        size_t cr = crs ? (size_t)__builtin_ctz(crs) : 0;
+        if (cr >= 2 && cr <= 9 && p[0] == type && p[cr + 1] == '\n' &&
+            decode_digits8(p + 1, cr - 1, n))
+        {
+            *next = p + cr + 2;
+            return 1;
+        }
+    }
+#endif
+    return read_line_scalar(p, end, type, n, next);
+}
+
+/**
+ * @brief parses an array of bulk strings, "*<n>\r\n" then n "$<len>\r\n<bytes>\r\n"
+ *
+ * one pass, the args point into data once their bytes are known to be
+ * there, they are dropped if the request is incomplete
+ */
+static int64_t parse_multibulk(const uint8_t *data, size_t avail, size_t max_len,
+                               Args &out, size_t *need)
+{
+    const uint8_t *end = data + avail;
+    const uint8_t *p = data;
+    size_t nargs = 0;
+    int32_t rv = read_line(p, end, '*', &nargs, &p);
+    if (rv <= 0)
+    {
+        return rv;
+    }
+    if (nargs > k_max_args)
+    {
+        return -1;
+    }
+
+    for (size_t i = 0; i < nargs; i++)
+    {
+        size_t len = 0;
+        rv = read_line(p, end, '$', &len, &p);
+        if (rv <= 0)
+        {
+            out.clear();
+            return rv;
+        }
+        size_t total = (size_t)(p - data);
+        if (len > max_len || total + len + 2 > max_len)
+        {
+            return -1; // too long
+        }
+        if (total + len + 2 > avail)
+        {
+            *need = total + len + 2;
+            out.clear();
+            return 0;
+        }
+        if (p[len] != '\r' || p[len + 1] != '\n')
+        {
+            return -1;
+        }
+        out.push_back(std::string_view((const char *)p, len));
+        p += len + 2;
+    }
+    return (int64_t)(p - data);
+}
+
+/**
+ * @brief parses an inline command, words separated by spaces up to "\n"
+ *
+ * as typed in telnet, quoting is not supported
+ */
+static int64_t parse_inline(const uint8_t *data, size_t avail,
+                            Args &out)
+{
+    size_t lim = (avail < k_max_inline) ? avail : k_max_inline;
+    const uint8_t *lf = (const uint8_t *)memchr(data, '\n', lim);
+    if (!lf)
+    {
+        return (lim == k_max_inline) ? -1 : 0;
+    }
+
+    const uint8_t *end = (lf > data && lf[-1] == '\r') ? lf - 1 : lf;
+    const uint8_t *p = data;
+    while (p < end)
+    {
+        if (*p == ' ' || *p == '\t')
+        {
+            p++;
+            continue;
+        }
+        const uint8_t *word = p;
+        while (p < end && *p != ' ' && *p != '\t')
+        {
+            p++;
+        }
+        if (out.size() == k_max_args)
+        {
+            return -1;
+        }
+        out.push_back(std::string_view((const char *)word, (size_t)(p - word)));
+    }
+    return (int64_t)(lf - data + 1);
+}
+
+/**
+ * @brief parses one RESP request, either an array of bulk strings or an
+ * inline command
+ *
+ * @param max_len: largest request accepted, in bytes
+ * @param out: filled with the command and its args, views into data,
+ * left empty for an empty request which the caller just skips
+ * @param *need: if incomplete, the size of the request when it is known
+ * so far, 0 otherwise
+ *
+ * @return bytes used by the request, 0 if it is incomplete, -1 if it is
+ * malformed or too long
+ */
+int64_t resp_parse(const uint8_t *data, size_t avail, size_t max_len,
+                   Args &out, size_t *need)
+{
+    *need = 0;
+    if (avail == 0)
+    {
+        return 0;
+    }
+    if (data[0] == '*')
+    {
+        return parse_multibulk(data, avail, max_len, out, need);
+    }
+    return parse_inline(data, avail, out);
+}
@@ -6,12 +6,18 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <signal.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/ip.h>
+#include <netinet/tcp.h>
 #include <vector>
 #include <map>
+#include <string>
+#include <thread>
+#include <new>
 #include <iostream>
 
 #include "../include/server.h"
@@ -19,11 +25,21 @@
 #include "../include/constants.h"
 #include "../include/utils/print_utils.h"
 #include "../include/utils/string_utils.h"
+#include "../include/utils/stats_utils.h"
 #include "../include/enums/state_enum.h"
 #include "../include/enums/res_enum.h"
 #include "../include/entry.h"
 #include "../include/hashtable.h"
 #include "../include/enums/status_enum.h"
+#include "../include/enums/loop_enum.h"
+#include "../include/event_loop.h"
+#include "../include/shard.h"
+#include "../include/shm_ring.h"
+#include "../include/timer_wheel.h"
+
+#define container_of(ptr, type, member) ({                  \
+    const typeof( ((type *)0)->member ) *__mptr = (ptr);    \
+    (type *)( (char *)__mptr - offsetof(type, member) ); })
 
 /**
  * @brief adds a new conn to the connection list
@@ -44,20 +60,117 @@ void conn_put(std::vector<Conn *> &fd2conn, struct Conn *conn)
 }
 
 /**
- * @brief accepts a new connection and adds it to fd2conn vector
- *
- * the new connection is added in the request state
+ * @brief allocates a Conn in the request state for the given fd
  *
- * @param fd2conn: vector of pointer to connections
  * @param fd: file descriptor of the new connection
+ * @param max_buf: largest request the client may send, in bytes
+ *
+ * @return pointer to the new Conn, NULL if allocation failed
+ *
+ */
+Conn *conn_new(int fd, size_t max_buf)
+{
+    struct Conn *conn = new (std::nothrow) Conn();
+    if (!conn)
+    {
+        return NULL;
+    }
+
+    conn->fd = fd;
+    conn->state = STATE_REQ;
+    conn->max_buf = max_buf;
+    return conn;
+}
+
+/**
+ * @brief turns Nagle off on a TCP connection
+ *
+ * the responses of a pass already go out in one write, Nagle would only
+ * hold back the next flush of a deep pipeline until the client's delayed
+ * ACK, 40 ms later. fails harmlessly on a Unix socket
+ *
+ */
+void set_no_delay(int fd)
+{
+    int yes = 1;
+    (void)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+}
+
+/**
+ * @brief picks the deadline the connection is waiting under
  *
- * @return -1 if error, 0 otherwise
+ * a conn blocked on writing gets the write timeout, one holding part of a
+ * request the read timeout and one with nothing going on the idle timeout.
+ * a conn waiting for shards has none, its memory is still referenced by
+ * the messages in flight
+ *
+ * @return the timeout in ms, 0 if no timer should run
+ */
+uint64_t conn_timeout(const Conn *conn, const Timeouts &timeouts)
+{
+    if (conn->state == STATE_RES)
+    {
+        return timeouts.write_ms;
+    }
+    if (conn->state == STATE_REQ)
+    {
+        return conn->mid_request() ? timeouts.read_ms : timeouts.idle_ms;
+    }
+    return 0;
+}
+
+/**
+ * @brief runs a periodic task and schedules its next run
+ */
+void on_periodic(Timer *timer, void *ctx)
+{
+    (void)ctx;
+    Periodic *task = container_of(timer, Periodic, timer);
+    task->fn(task->arg);
+    task->wheel->add(&task->timer, monotonic_ms() + task->interval_ms, &on_periodic);
+}
+
+/**
+ * @brief accepts the pending connections and adds them to fd2conn vector
+ *
+ * the backlog is drained until EAGAIN, at most k_accept_batch at a time
+ * so a connection storm does not starve the established conns, the
+ * listening fd is level-triggered and reported again if more are left.
+ * the new connections are added in the request state
+ *
+ * @param fd: listening socket, non-blocking
+ *
+ * @return number of connections accepted
  *
  */
 int32_t Server::accept_new_conn(int fd)
 {
-    // accept
-    struct sockaddr_in client_addr = {};
+    int32_t accepted = 0;
+    while (accepted < (int32_t)k_accept_batch)
+    {
+        int32_t rv = accept_one(fd);
+        if (rv < 0)
+        {
+            break;
+        }
+        accepted += rv;
+    }
+    return accepted;
+}
+
+/**
+ * @brief accepts one connection
+ *
+ * @param fd: listening socket
+ *
+ * @return 1 if a conn was added, 0 if one was accepted and dropped or
+ * accept can be retried, -1 if the backlog is empty or accept failed
+ *
+ */
+int32_t Server::accept_one(int fd)
+{
+    // accept, the listener is either TCP or a Unix socket
+    struct sockaddr_storage client_addr = {};
     socklen_t socklen = sizeof(client_addr);
 
     /**
@@ -73,40 +186,427 @@ int32_t Server::accept_new_conn(int fd)
      *
      * -1 is returned in case of an error and errno is set accordingly
      *
+     * accept4 sets the new fd non-blocking and close-on-exec in the same
+     * syscall, no fcntl round trips per connection
+     *
      */
-    int connfd = accept(fd, (struct sockaddr *)&client_addr, &socklen);
+    count_syscall();
+    int connfd = accept4(fd, (struct sockaddr *)&client_addr, &socklen,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
     if (connfd < 0)
     {
-        msg("accept() error");
-        return -1; // error
+        if (errno == EINTR || errno == ECONNABORTED)
+        {
+            return 0; // try the next one
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            msg("accept() error");
+        }
+        return -1;
     }
 
-    // set the new connection fd to nonblocking mode
-    set_non_blocking(connfd);
+    if (fd == shm_fd)
+    {
+        return accept_shm(connfd);
+    }
+    if (client_addr.ss_family == AF_INET)
+    {
+        set_no_delay(connfd);
+    }
 
     // creating the struct Conn
-    struct Conn *conn = (struct Conn *)malloc(sizeof(struct Conn));
+    struct Conn *conn = conn_new(connfd, max_client_buf);
     if (!conn)
     {
         close(connfd);
-        return -1;
+        return 0;
     }
+    conn->turn_requests = turn_requests;
+    conn->turn_bytes = turn_bytes;
 
-    conn->fd = connfd;
-    conn->state = STATE_REQ;
-    conn->rbuf_size = 0;
-    conn->wbuf_size = 0;
-    conn->wbuf_sent = 0;
+    conn->interest = EV_READ | EV_EDGE;
     conn_put(fd2conn, conn);
+    arm_timer(conn);
 
-    return 0;
+    if (loop->add(connfd, conn->interest))
+    {
+        msg("event loop add() error");
+        destroy_conn(conn);
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief hands the shared rings to a client of the shm listener
+ *
+ * the conn is keyed by the eventfd the client rings, the socket stays
+ * registered only to see the client leave
+ *
+ * @param sock: accepted socket
+ *
+ * @return 1 if a conn was added, 0 if it was dropped
+ */
+int32_t Server::accept_shm(int sock)
+{
+    ShmChannel *ch = shm_channel_new(sock);
+    if (!ch)
+    {
+        return 0;
+    }
+
+    struct Conn *conn = conn_new(ch->efd_srv, max_client_buf);
+    if (!conn)
+    {
+        shm_channel_free(ch);
+        return 0;
+    }
+    conn->turn_requests = turn_requests;
+    conn->turn_bytes = turn_bytes;
+    conn->shm = ch;
+
+    // the eventfd stands for both directions, see update_interest()
+    conn->interest = EV_READ | EV_EDGE;
+    conn_put(fd2conn, conn);
+    if (fd2conn.size() <= (size_t)sock)
+    {
+        fd2conn.resize(sock + 1);
+    }
+    fd2conn[sock] = conn;
+    arm_timer(conn);
+
+    if (loop->add(conn->fd, conn->interest) || loop->add(sock, EV_READ))
+    {
+        msg("event loop add() error");
+        destroy_conn(conn);
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief the client of a shm conn closed its socket
+ *
+ * the conn is not freed here, it may be waiting for shards or queued.
+ * its eventfd is rung instead, the next read sees EOF once the requests
+ * already in the ring are served
+ *
+ * @param *conn: pointer to the Conn object
+ *
+ */
+static void shm_hangup(EventLoop *loop, std::vector<Conn *> &fd2conn, Conn *conn)
+{
+    ShmChannel *ch = conn->shm;
+    if (!shm_peer_closed(ch))
+    {
+        return;
+    }
+    (void)loop->del(ch->sock);
+    fd2conn[ch->sock] = NULL;
+    ch->closed = true;
+
+    uint64_t one = 1;
+    (void)write(ch->efd_srv, &one, sizeof(one));
+}
+
+/**
+ * @brief re-registers the connection if it switched between STATE_REQ, STATE_RES
+ * and STATE_WAIT
+ *
+ * the interest set is only touched on a state change, so a connection that
+ * stays in the same state costs nothing per iteration
+ *
+ * @param *conn: pointer to the Conn object
+ *
+ */
+void Server::update_interest(Conn *conn)
+{
+    uint32_t interest = EV_EDGE;
+    if (conn->state == STATE_REQ)
+    {
+        interest |= EV_READ;
+    }
+    else if (conn->state == STATE_RES)
+    {
+        interest |= EV_WRITE;
+    }
+    // STATE_WAIT: nothing until the shards reply, the fd is re-armed then
+    if (conn->shm)
+    {
+        // the client rings the eventfd for new requests and for room in
+        // the response ring alike
+        interest = EV_READ | EV_EDGE;
+    }
+    if (interest == conn->interest)
+    {
+        return;
+    }
+
+    conn->interest = interest;
+    if (loop->mod(conn->fd, interest))
+    {
+        msg("event loop mod() error");
+        conn->state = STATE_END;
+    }
+}
+
+/**
+ * @brief removes the connection from the event loop and frees it
+ *
+ * a conn whose request still runs on other shards is only marked closing,
+ * their replies point to it. the last one brings it back here through
+ * resume_conns(), the fd stays open meanwhile so it isn't reused
+ *
+ * @param *conn: pointer to the Conn object
+ *
+ */
+void Server::destroy_conn(Conn *conn)
+{
+    timers.del(&conn->timer);
+    if (!conn->closing)
+    {
+        (void)loop->del(conn->fd);
+    }
+    if (conn->pending > 0)
+    {
+        conn->state = STATE_END;
+        conn->closing = true;
+        return;
+    }
+
+    print("STATE_END reached, freeing conn", conn->fd);
+    fd2conn[conn->fd] = NULL;
+    if (conn->shm)
+    {
+        ShmChannel *ch = conn->shm;
+        if (!ch->closed)
+        {
+            (void)loop->del(ch->sock);
+            fd2conn[ch->sock] = NULL;
+        }
+        shm_channel_free(ch); // closes conn->fd too
+    }
+    else
+    {
+        (void)close(conn->fd);
+    }
+    delete conn;
+}
+
+/**
+ * @brief restarts the deadline of the conn, from now_ms
+ *
+ * @param *conn: pointer to the Conn object
+ *
+ */
+void Server::arm_timer(Conn *conn)
+{
+    uint64_t timeout = conn_timeout(conn, timeouts);
+    if (!timeout)
+    {
+        timers.del(&conn->timer);
+        return;
+    }
+    timers.add(&conn->timer, now_ms + timeout, &Server::on_conn_timer);
+}
+
+/**
+ * @brief closes a connection whose client did not keep up
+ *
+ * @param *timer: the timer of the conn
+ * @param *ctx: the Server
+ *
+ */
+void Server::on_conn_timer(Timer *timer, void *ctx)
+{
+    Conn *conn = container_of(timer, Conn, timer);
+    msg("timeout, closing conn");
+    ((Server *)ctx)->destroy_conn(conn);
+}
+
+Server::Server(uint32_t loop_type)
+    : loop_type(loop_type), timers(monotonic_ms()), now_ms(monotonic_ms())
+{
+    // a client resetting its connection fails the write with EPIPE
+    // instead of killing the server
+    signal(SIGPIPE, SIG_IGN);
+    loop = EventLoop::create(loop_type);
+    add_periodic(k_rehash_idle_ms, &Server::on_rehash, this);
+    rehash_task = periodic.back();
+}
+
+/**
+ * @brief cron moving the nodes of the resizing tables, so the requests
+ * do not have to
+ *
+ * a server that handled no event since the last run gives it
+ * k_rehash_budget_us, a busy one only k_rehash_busy_us. it runs every
+ * k_rehash_active_ms while a table resizes, every k_rehash_idle_ms else
+ */
+void Server::on_rehash(void *arg)
+{
+    Server *server = (Server *)arg;
+    uint64_t budget = server->served ? k_rehash_busy_us : k_rehash_budget_us;
+    server->served = 0;
+    bool more = db_rehash(budget);
+    server->rehash_task->interval_ms = more ? k_rehash_active_ms : k_rehash_idle_ms;
+}
+
+Server::~Server()
+{
+    if (unix_fd >= 0)
+    {
+        (void)close(unix_fd);
+        (void)unlink(unix_path.c_str());
+    }
+    if (shm_fd >= 0)
+    {
+        (void)close(shm_fd);
+        (void)unlink(shm_path.c_str());
+    }
+    for (Periodic *task : periodic)
+    {
+        timers.del(&task->timer);
+        delete task;
+    }
+    delete io_threads;
+    delete loop;
+}
+
+/**
+ * @brief moves socket reads, parsing and writes onto a pool of I/O threads
+ *
+ * commands still run on the loop thread, one batch of ready conns at a time
+ *
+ * @param n_threads: number of threads doing I/O, including the loop thread
+ *
+ */
+void Server::set_io_threads(uint32_t n_threads)
+{
+    delete io_threads;
+    io_threads = (n_threads > 1) ? new IoThreads(n_threads) : NULL;
+}
+
+/**
+ * @brief caps the read-buffer of every new connection, a client sending
+ * a larger request is disconnected
+ *
+ * @param max_buf: limit in bytes, header included
+ *
+ */
+void Server::set_client_buf_limit(size_t max_buf)
+{
+    max_client_buf = max_buf;
+}
+
+/**
+ * @brief sets the work a connection may do per turn before the others
+ * get theirs, see Conn::new_turn()
+ *
+ * @param requests, bytes: requests run and bytes read per turn, 0 for
+ * no limit
+ *
+ */
+void Server::set_turn_budget(size_t requests, size_t bytes)
+{
+    turn_requests = requests ? requests : SIZE_MAX;
+    turn_bytes = bytes ? bytes : SIZE_MAX;
+}
+
+/**
+ * @brief sets how long a connection may be idle, take to send the rest of
+ * a request, or leave its responses unread, before it is closed
+ *
+ * @param idle_ms, read_ms, write_ms: timeouts in ms, 0 disables one
+ *
+ */
+void Server::set_timeouts(uint64_t idle_ms, uint64_t read_ms, uint64_t write_ms)
+{
+    timeouts.idle_ms = idle_ms;
+    timeouts.read_ms = read_ms;
+    timeouts.write_ms = write_ms;
+}
+
+/**
+ * @brief sets the length of the listen queue used by init()
+ *
+ * values above SOMAXCONN help absorb reconnect storms, the kernel still
+ * caps them to net.core.somaxconn which has to be raised as well
+ *
+ * @param n: max number of connections waiting to be accepted
+ *
+ */
+void Server::set_backlog(int n)
+{
+    backlog = n;
+}
+
+/**
+ * @brief runs fn(arg) every interval_ms on the loop thread
+ *
+ * must be called before run_server, the task lives as long as the Server
+ *
+ */
+void Server::add_periodic(uint64_t interval_ms, void (*fn)(void *), void *arg)
+{
+    Periodic *task = new Periodic();
+    task->wheel = &timers;
+    task->interval_ms = interval_ms;
+    task->fn = fn;
+    task->arg = arg;
+    periodic.push_back(task);
+    timers.add(&task->timer, monotonic_ms() + interval_ms, &on_periodic);
+}
+
+// port 1234 on the wildcard address 0.0.0.0
+static struct sockaddr_in listen_addr()
+{
+    int portNumber = 1234;
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = ntohs(portNumber);
+    addr.sin_addr.s_addr = ntohl(0);
+    return addr;
 }
 
-Server::Server()
+/**
+ * @brief dies if anything is bound to port 1234 already
+ *
+ * the listeners of the reactors and shards set SO_REUSEPORT, and so
+ * would those of a second server started by the same user. both would
+ * bind, and the kernel would silently split the connections between two
+ * keyspaces. the probe does not set SO_REUSEPORT, so any listener left on
+ * the port makes its bind fail
+ */
+static void port_check_free()
 {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        die("socket()");
+    }
+    int yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    struct sockaddr_in addr = listen_addr();
+    if (bind(fd, (const sockaddr *)&addr, sizeof(addr)))
+    {
+        die("bind(), port 1234 in use");
+    }
+    close(fd);
 }
 
-int Server::init()
+/**
+ * @brief creates the listening socket on port 1234
+ *
+ * @param reuse_port: set SO_REUSEPORT so every reactor can bind its own
+ * listener on the same port, the kernel spreads new connections among them
+ *
+ * @return listening fd
+ */
+int Server::init(bool reuse_port)
 {
     /**
      * get the file descriptor
@@ -142,12 +642,13 @@ int Server::init()
      */
     int yes = 1;
     setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    if (reuse_port && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)))
+    {
+        die("setsockopt(SO_REUSEPORT)");
+        return FAILED;
+    }
 
-    int portNumber = 1234;
-    struct sockaddr_in addr = {};
-    addr.sin_family = AF_INET;
-    addr.sin_port = ntohs(portNumber);
-    addr.sin_addr.s_addr = ntohl(0); // wildcard address 0.0.0.0
+    struct sockaddr_in addr = listen_addr();
 
     /**
      * Associate the socket with a port on local machine
@@ -175,12 +676,13 @@ int Server::init()
      *
      * sockfd is the socket file descriptor
      * backlog is the number of connections allowed in the incoming queue
-     *      its set to SOMAXCONN which is defined as 128 on linux
+     *      it defaults to k_listen_backlog, see set_backlog(). the kernel
+     *      caps it to net.core.somaxconn
      *
      * -1 is returned in case of an error and errno is set accordingly
      *
      */
-    rv = listen(fd, SOMAXCONN);
+    rv = listen(fd, backlog);
     print("rv listen", rv);
     if (rv)
     {
@@ -191,6 +693,89 @@ int Server::init()
     return fd;
 }
 
+/**
+ * @brief binds a listening Unix socket, a stale socket file left at
+ * path is replaced
+ *
+ * @return listening fd
+ */
+static int unix_listen(const char *path, int backlog)
+{
+    struct sockaddr_un addr = {};
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        msg("unix socket path too long");
+        return FAILED;
+    }
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        die("socket()");
+        return FAILED;
+    }
+
+    (void)unlink(path);
+    if (bind(fd, (const sockaddr *)&addr, sizeof(addr)))
+    {
+        die("bind()");
+        return FAILED;
+    }
+    if (listen(fd, backlog))
+    {
+        die("listen()");
+        return FAILED;
+    }
+    return fd;
+}
+
+/**
+ * @brief creates an extra listening socket on a Unix domain path
+ *
+ * same-host clients connecting there skip the TCP/IP stack, they are
+ * served by the same Conn state machine as TCP clients. must be called
+ * before run_server
+ *
+ * @param path: filesystem path of the socket
+ *
+ * @return listening fd
+ */
+int Server::init_unix(const char *path)
+{
+    int fd = unix_listen(path, backlog);
+    if (fd >= 0)
+    {
+        unix_fd = fd;
+        unix_path = path;
+    }
+    return fd;
+}
+
+/**
+ * @brief creates a Unix socket where clients get shared memory rings
+ *
+ * a client connecting there receives a memfd with a pair of SPSC byte
+ * rings and two eventfds, see shm_channel_new(). the frames are the
+ * same as on a socket but neither side makes a syscall while the other
+ * is busy. needs the epoll or poll loop, must be called before run_server
+ *
+ * @param path: filesystem path of the socket
+ *
+ * @return listening fd
+ */
+int Server::init_shm(const char *path)
+{
+    int fd = unix_listen(path, backlog);
+    if (fd >= 0)
+    {
+        shm_fd = fd;
+        shm_path = path;
+    }
+    return fd;
+}
+
 /**
  * @brief sets the socket to non-blocking mode
  *
@@ -236,77 +821,322 @@ int Server::set_non_blocking(int fd)
     return SUCCESS;
 }
 
-void Server::run_server(int fd)
+/**
+ * @brief updates the event loop after the conn was served, or destroys it
+ *
+ * @param *conn: pointer to the Conn object
+ *
+ */
+void Server::finish_conn(Conn *conn)
 {
-    while (true)
+    if (conn->state != STATE_END)
+    {
+        update_interest(conn);
+        conn->release_buffers();
+    }
+
+    if (conn->state == STATE_END)
     {
-        poll_args.clear();
+        // client closed normally, or something bad happened.
+        // destroy this connection
+        destroy_conn(conn);
+        return;
+    }
+    arm_timer(conn);
 
-        // the listening fd is put in the first position
-        struct pollfd pfd = {fd, POLLIN, 0};
-        poll_args.push_back(pfd);
+    if (conn->yielded() && !conn->queued)
+    {
+        conn->queued = true;
+        runq.push_back(conn->fd);
+    }
+}
 
-        for (Conn *conn : fd2conn)
+/**
+ * @brief continues the connections whose shard replies are complete
+ *
+ * @param conns: connections back in STATE_REQ, or closing ones in STATE_END
+ * which are freed, cleared on return
+ *
+ */
+void Server::resume_conns(std::vector<Conn *> &conns)
+{
+    for (Conn *conn : conns)
+    {
+        conn->new_turn();
+        conn->connection_io();
+        finish_conn(conn);
+    }
+    conns.clear();
+}
+
+/**
+ * @brief gives the conn a turn, right away or as part of the batch of
+ * the I/O threads
+ *
+ * @param *conn: pointer to the Conn object
+ * @param batch: conns for the I/O threads
+ *
+ */
+void Server::serve_conn(Conn *conn, std::vector<Conn *> &batch)
+{
+    conn->new_turn();
+    if (io_threads)
+    {
+        batch.push_back(conn);
+        return;
+    }
+
+    conn->connection_io();
+    finish_conn(conn);
+}
+
+/**
+ * @brief serves a batch of ready conns with the I/O threads
+ *
+ * the I/O threads read and parse the requests of every conn, the loop
+ * thread runs the commands, then the I/O threads write the responses and
+ * parse the next requests. this repeats until no conn has a parsed
+ * request left or budget to run it
+ *
+ * @param batch: conns with events, cleared on return
+ *
+ */
+void Server::run_batch(std::vector<Conn *> &batch)
+{
+    std::vector<Conn *> writers;
+    for (Conn *conn : batch)
+    {
+        if (conn->state == STATE_RES)
         {
-            if (conn == NULL)
+            writers.push_back(conn);
+        }
+    }
+    io_threads->run(writers, &Conn::io_write);
+    io_threads->run(batch, &Conn::io_read);
+
+    while (true)
+    {
+        writers.clear();
+        for (Conn *conn : batch)
+        {
+            if (conn->state == STATE_REQ && conn->ncmds && conn->budget)
             {
-                continue;
+                conn->budget -= (conn->ncmds < conn->budget) ? conn->ncmds : conn->budget;
+                conn->exec_requests();
+                writers.push_back(conn);
             }
-
-            struct pollfd pfd = {};
-            pfd.fd = conn->fd;
-            pfd.events = (conn->state == STATE_REQ) ? POLLIN : POLLOUT;
-            print("POLLIN, POLLOUT, POLLERR", POLLIN, POLLOUT, POLLERR);
-            print("pfd events without POLLERR", pfd.events);
-            pfd.events = pfd.events | POLLERR;
-            print("pfd events", pfd.events);
-            poll_args.push_back(pfd);
         }
+        if (writers.empty())
+        {
+            break;
+        }
+        io_threads->run(writers, &Conn::io_write);
+    }
+
+    for (Conn *conn : batch)
+    {
+        finish_conn(conn);
+    }
+    batch.clear();
+}
+
+void Server::run_server(int fd)
+{
+    if (loop_type == LOOP_URING && shm_fd >= 0)
+    {
+        msg("shared memory clients need epoll, not using io_uring");
+    }
+    else if (loop_type == LOOP_URING && !shard && !run_uring(fd))
+    {
+        msg("io_uring not available, falling back to epoll");
+    }
+
+    // accept_new_conn drains the backlog until EAGAIN
+    set_non_blocking(fd);
+    if (unix_fd >= 0)
+    {
+        set_non_blocking(unix_fd);
+    }
+    if (shm_fd >= 0)
+    {
+        set_non_blocking(shm_fd);
+    }
 
-        /**
-         * poll for active fds
-         *
-         * int poll(struct pollfd fds[], nfds_t nfds, int timeout);
-         *
-         * fds is the array of sockets we want to moniter
-         * nfds is the size of the array
-         * timeout is timeout in milliseconds, pass negative timeout to wait forever
-         *
-         * returns the number of elements in the array that have an event occur
-         *
-         */
-        int rv = poll(poll_args.data(), (nfds_t)poll_args.size(), 1000);
-        print("No of conn with events", rv);
+    /**
+     * the listening fd stays level-triggered, up to k_accept_batch
+     * connections are accepted per readiness event and the rest are
+     * reported again on the next wait
+     *
+     */
+    if (loop->add(fd, EV_READ))
+    {
+        die("event loop add()");
+    }
+    if (unix_fd >= 0 && loop->add(unix_fd, EV_READ))
+    {
+        die("event loop add()");
+    }
+    if (shm_fd >= 0 && loop->add(shm_fd, EV_READ))
+    {
+        die("event loop add()");
+    }
+    if (shard && loop->add(shard->efd, EV_READ))
+    {
+        die("event loop add()");
+    }
+
+    std::vector<Event> events;
+    std::vector<Conn *> resumed;
+    std::vector<Conn *> batch;
+    std::vector<int> turn;
+    bool backlogged = false;
+    while (true)
+    {
+        // sleeps until the next deadline, or until an event if no timer runs
+        bool busy = backlogged || !runq.empty();
+        int timeout = busy ? 0 : timers.timeout_ms(monotonic_ms(), -1);
+        int rv = loop->wait(events, timeout);
         if (rv < 0)
         {
-            die("poll");
+            die("event loop wait()");
         }
+        now_ms = monotonic_ms();
+        served += events.size() + runq.size();
+
+        // the conns queued so far get one more turn at the end of this pass,
+        // the ones running out of budget during it wait for the next one
+        turn.swap(runq);
 
         // process active connections
-        for (size_t i = 1; i < poll_args.size(); i++)
+        for (const Event &ev : events)
+        {
+            if (ev.fd == fd || ev.fd == unix_fd || ev.fd == shm_fd)
+            {
+                // accept the new connections if a listening fd is active
+                accept_new_conn(ev.fd);
+                continue;
+            }
+
+            if (shard && ev.fd == shard->efd)
+            {
+                shard_drain(shard, resumed);
+                resume_conns(resumed);
+                continue;
+            }
+
+            if ((size_t)ev.fd >= fd2conn.size() || !fd2conn[ev.fd])
+            {
+                continue;
+            }
+
+            Conn *conn = fd2conn[ev.fd];
+            if (conn->shm && ev.fd == conn->shm->sock)
+            {
+                shm_hangup(loop, fd2conn, conn);
+                continue;
+            }
+            if (conn->state == STATE_WAIT || conn->closing || conn->queued)
+            {
+                // the request is still running on other shards, or the
+                // conn gets its turn from the run queue
+                continue;
+            }
+
+            serve_conn(conn, batch);
+        }
+
+        for (int cfd : turn)
         {
-            print("index", i, "revents", poll_args[i].revents);
-            if (poll_args[i].revents)
+            Conn *conn = ((size_t)cfd < fd2conn.size()) ? fd2conn[cfd] : NULL;
+            if (!conn || !conn->queued)
             {
-                Conn *conn = fd2conn[poll_args[i].fd];
-                conn->connection_io();
-
-                if (conn->state == STATE_END)
-                {
-                    // client closed normally, or something bad happened.
-                    // destroy this connection
-                    print("STATE_END reached, freeing conn", conn->fd);
-                    fd2conn[conn->fd] = NULL;
-                    (void)close(conn->fd);
-                    free(conn);
-                }
+                continue; // closed meanwhile, the fd may be reused
             }
+            conn->queued = false;
+            serve_conn(conn, batch);
         }
+        turn.clear();
 
-        // try to accept a new connection if the listening fd is active
-        if (poll_args[0].revents)
+        if (io_threads)
         {
-            accept_new_conn(fd);
+            run_batch(batch);
         }
+
+        if (shard)
+        {
+            backlogged = shard_flush(shard);
+        }
+
+        timers.advance(now_ms, this);
+    }
+}
+
+/**
+ * @brief runs n_reactors independent reactors, one per thread
+ *
+ * every reactor owns its listener, fd2conn table and event loop, only the
+ * keyspace is shared and it is protected by per stripe locks
+ *
+ * @param n_reactors: number of reactor threads
+ * @param loop_type: event loop backend used by each reactor
+ *
+ */
+void Server::run_reactors(uint32_t n_reactors, uint32_t loop_type)
+{
+    port_check_free();
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < n_reactors; i++)
+    {
+        threads.emplace_back([loop_type, n_reactors]()
+                             {
+                                 Server server(loop_type);
+                                 int fd = server.init(n_reactors > 1);
+                                 server.run_server(fd); });
+    }
+
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+}
+
+/**
+ * @brief runs the shard-per-core mode, one shard per thread
+ *
+ * every shard owns a private HMap and its own reactor. a command is run
+ * by the shard owning its key, requests and replies for keys owned by
+ * other shards travel through lock-free SPSC queues, so the keyspace is
+ * never locked nor shared between cores
+ *
+ * @param n_shards: number of shards
+ * @param loop_type: event loop backend used by each shard, io_uring is
+ * not supported in this mode and falls back to epoll
+ *
+ */
+void Server::run_shards(uint32_t n_shards, uint32_t loop_type)
+{
+    if (loop_type == LOOP_URING)
+    {
+        loop_type = LOOP_EPOLL;
+    }
+    port_check_free();
+    shards_init(n_shards);
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < n_shards; i++)
+    {
+        threads.emplace_back([loop_type, n_shards, i]()
+                             {
+                                 tls_shard = shard_get(i);
+                                 Server server(loop_type);
+                                 server.shard = tls_shard;
+                                 int fd = server.init(n_shards > 1);
+                                 server.run_server(fd); });
+    }
+
+    for (std::thread &t : threads)
+    {
+        t.join();
     }
 }
@@ -0,0 +1,343 @@
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <vector>
+#include <string>
+
+#include "../include/shard.h"
+#include "../include/conn.h"
+#include "../include/cmd_table.h"
+#include "../include/constants.h"
+#include "../include/utils/print_utils.h"
+#include "../include/utils/string_utils.h"
+#include "../include/utils/stats_utils.h"
+#include "../include/enums/res_enum.h"
+#include "../include/enums/status_enum.h"
+
+thread_local Shard *tls_shard = NULL;
+
+static std::vector<Shard *> g_shards;
+
+/**
+ * @brief creates the shards and the SPSC queues between every pair of them
+ *
+ * must run before any shard thread is started
+ *
+ * @param n_shards: number of shards, one per core
+ */
+void shards_init(uint32_t n_shards)
+{
+    assert(g_shards.empty());
+    for (uint32_t i = 0; i < n_shards; i++)
+    {
+        Shard *shard = new Shard();
+        shard->id = i;
+        shard->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (shard->efd < 0)
+        {
+            die("eventfd()");
+        }
+        shard->inbox.resize(n_shards, NULL);
+        for (uint32_t from = 0; from < n_shards; from++)
+        {
+            if (from != i)
+            {
+                shard->inbox[from] = new SpscQueue<ShardMsg *>(k_shard_queue_size);
+            }
+        }
+        shard->backlog.resize(n_shards);
+        shard->wake.resize(n_shards, false);
+        g_shards.push_back(shard);
+    }
+}
+
+Shard *shard_get(uint32_t id)
+{
+    return g_shards[id];
+}
+
+/**
+ * @brief maps the hash of a key to the shard owning it
+ */
+static uint32_t shard_of(uint64_t hcode)
+{
+    uint64_t h = (hcode * 0x9E3779B97F4A7C15ull) >> 32;
+    return (uint32_t)((h * g_shards.size()) >> 32);
+}
+
+/**
+ * @brief queues msg for the shard `to`, the shard is rung on the next flush
+ */
+static void shard_send(Shard *from, uint32_t to, ShardMsg *msg)
+{
+    std::deque<ShardMsg *> &backlog = from->backlog[to];
+    if (!backlog.empty() || !g_shards[to]->inbox[from->id]->push(msg))
+    {
+        // keep the order, the backlog is retried on flush
+        backlog.push_back(msg);
+    }
+    from->wake[to] = true;
+}
+
+/**
+ * @brief puts the results of the keys of one part of a multi-key command
+ * where the keys are in the command
+ */
+static void shard_place(Conn *conn, ShardMsg *msg)
+{
+    for (size_t j = 0; j < msg->pos.size(); j++)
+    {
+        conn->pending_keys[msg->pos[j]] = std::move(msg->keys[j]);
+    }
+}
+
+/**
+ * @brief replies to a multi-key command once the results of all its keys
+ * are in conn->pending_keys
+ */
+static void shard_reply_keys(Conn *conn, OutBuf &out)
+{
+    const CmdSpec *spec = conn->pending_multi;
+    int64_t sum = 0;
+    combine_begin(spec, conn->pending_keys.size(), out);
+    for (const KeyResult &res : conn->pending_keys)
+    {
+        combine_key(spec, res, &sum, out);
+    }
+    combine_end(spec, sum, out);
+    conn->pending_keys.clear();
+}
+
+/**
+ * @brief runs the request on the shards owning its keys
+ *
+ * keys owned by the calling shard are served right away, the rest is
+ * grouped per owner and sent as one message per shard. multi-key
+ * commands fan out this way and the replies are gathered in
+ * conn->pending*, the results of their keys in conn->pending_keys
+ *
+ * @param *spec: the table entry of cmd[0]
+ *
+ * @return 0 if all keys were local and the response is ready,
+ * DEFERRED if the conn has to wait for other shards
+ */
+int32_t shard_dispatch(Conn *conn, const CmdSpec *spec, Args &cmd,
+                       uint32_t *rescode, OutBuf &out)
+{
+    Shard *self = tls_shard;
+
+    // a multi-key command takes any number of keys, the others one at cmd[1]
+    if (!(spec->flags & CMD_MULTIKEY))
+    {
+        LookupKey key(cmd[1]);
+        uint32_t owner = shard_of(key.node.hcode);
+        if (owner == self->id)
+        {
+            *rescode = exec_cmd(&self->db, key, cmd, out);
+            return 0;
+        }
+
+        ShardMsg *msg = new ShardMsg();
+        msg->from = self->id;
+        msg->conn = conn;
+        msg->cmd.assign(cmd.v.begin(), cmd.v.end());
+        msg->hcodes.push_back(key.node.hcode);
+        msg->res.proto = out.proto;
+        shard_send(self, owner, msg);
+        conn->pending = 1;
+        conn->pending_rescode = RES_OK;
+        conn->pending_multi = NULL;
+        conn->pending_res.clear();
+        return DEFERRED;
+    }
+
+    std::vector<ShardMsg *> parts(g_shards.size(), NULL);
+    for (size_t i = 1; i < cmd.size(); i++)
+    {
+        uint64_t hcode = str_hash((const uint8_t *)cmd[i].data(), cmd[i].size());
+        uint32_t owner = shard_of(hcode);
+        if (!parts[owner])
+        {
+            parts[owner] = new ShardMsg();
+            parts[owner]->from = self->id;
+            parts[owner]->conn = conn;
+            parts[owner]->cmd.emplace_back(cmd[0]);
+        }
+        parts[owner]->cmd.emplace_back(cmd[i]);
+        parts[owner]->hcodes.push_back(hcode);
+        parts[owner]->pos.push_back((uint32_t)(i - 1));
+    }
+
+    conn->pending = 0;
+    conn->pending_rescode = RES_OK;
+    conn->pending_multi = spec;
+    conn->pending_keys.resize(cmd.size() - 1);
+    conn->pending_res.clear();
+    for (uint32_t owner = 0; owner < parts.size(); owner++)
+    {
+        ShardMsg *msg = parts[owner];
+        if (!msg)
+        {
+            continue;
+        }
+        if (owner == self->id)
+        {
+            Args args;
+            args.adopt(msg->cmd);
+            exec_keys(&self->db, args, msg->hcodes, msg->keys);
+            shard_place(conn, msg);
+            delete msg;
+            continue;
+        }
+        shard_send(self, owner, msg);
+        conn->pending++;
+    }
+
+    if (conn->pending == 0)
+    {
+        shard_reply_keys(conn, out);
+        *rescode = conn->pending_rescode;
+        return 0;
+    }
+    return DEFERRED;
+}
+
+/**
+ * @brief runs a request owned by this shard and sends the result back
+ */
+static void shard_serve(Shard *shard, ShardMsg *msg)
+{
+    Args args;
+    args.adopt(msg->cmd);
+    if (cmd_find(args[0])->flags & CMD_MULTIKEY)
+    {
+        // the reply is written once every part is back
+        exec_keys(&shard->db, args, msg->hcodes, msg->keys);
+        msg->rescode = RES_OK;
+    }
+    else
+    {
+        LookupKey key(args[1], msg->hcodes[0]);
+        msg->rescode = exec_cmd(&shard->db, key, args, msg->res);
+    }
+    msg->cmd.clear();
+    msg->hcodes.clear();
+    msg->type = MSG_RES;
+    shard_send(shard, msg->from, msg);
+}
+
+/**
+ * @brief gathers one reply into the waiting connection
+ *
+ * @return true once every part of the request has replied
+ */
+static bool shard_gather(ShardMsg *msg)
+{
+    Conn *conn = msg->conn;
+    assert((conn->state == STATE_WAIT || conn->closing) && conn->pending > 0);
+
+    if (msg->rescode != RES_OK)
+    {
+        conn->pending_rescode = msg->rescode;
+    }
+    if (conn->pending_multi)
+    {
+        shard_place(conn, msg);
+    }
+    if (!msg->res.empty())
+    {
+        conn->pending_res.splice(msg->res);
+    }
+    delete msg;
+
+    return --conn->pending == 0;
+}
+
+/**
+ * @brief handles every message queued for this shard
+ *
+ * @param done: filled with the conns whose response is now complete,
+ * they are back in STATE_REQ and the caller resumes them, or frees the
+ * closing ones
+ */
+void shard_drain(Shard *shard, std::vector<Conn *> &done)
+{
+    uint64_t cnt = 0;
+    count_syscall();
+    (void)read(shard->efd, &cnt, sizeof(cnt));
+
+    for (SpscQueue<ShardMsg *> *q : shard->inbox)
+    {
+        if (!q)
+        {
+            continue;
+        }
+
+        ShardMsg *msg = NULL;
+        while (q->pop(msg))
+        {
+            if (msg->type == MSG_REQ)
+            {
+                shard_serve(shard, msg);
+                continue;
+            }
+
+            Conn *conn = msg->conn;
+            if (!shard_gather(msg))
+            {
+                continue;
+            }
+            if (conn->closing)
+            {
+                // nobody to answer, resume_conns() frees it
+                done.push_back(conn);
+                continue;
+            }
+            conn->begin_response();
+            if (conn->pending_multi)
+            {
+                shard_reply_keys(conn, conn->wbuf);
+            }
+            conn->wbuf.splice(conn->pending_res);
+            conn->end_response(conn->pending_rescode);
+            conn->state = STATE_REQ;
+            done.push_back(conn);
+        }
+    }
+}
+
+/**
+ * @brief pushes the backlogs and rings every shard that got messages
+ *
+ * called once per loop pass, so a burst of messages costs one eventfd
+ * write per destination
+ *
+ * @return true if some messages are still waiting for room in a queue
+ */
+bool shard_flush(Shard *shard)
+{
+    bool backlogged = false;
+    for (uint32_t to = 0; to < shard->wake.size(); to++)
+    {
+        if (!shard->wake[to])
+        {
+            continue;
+        }
+
+        std::deque<ShardMsg *> &backlog = shard->backlog[to];
+        SpscQueue<ShardMsg *> *q = g_shards[to]->inbox[shard->id];
+        while (!backlog.empty() && q->push(backlog.front()))
+        {
+            backlog.pop_front();
+        }
+
+        uint64_t one = 1;
+        count_syscall();
+        (void)write(g_shards[to]->efd, &one, sizeof(one));
+        shard->wake[to] = !backlog.empty();
+        backlogged = backlogged || shard->wake[to];
+    }
+    return backlogged;
+}
@@ -0,0 +1,215 @@
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "../include/shm_client.h"
+#include "../include/utils/print_utils.h"
+#include "../include/enums/status_enum.h"
+
+ShmClient::~ShmClient()
+{
+    if (region)
+    {
+        munmap(region, sizeof(ShmRegion));
+    }
+    int fds[3] = {sock, efd_srv, efd_cli};
+    for (int fd : fds)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+}
+
+/**
+ * @brief connects to the server and maps the rings it sends back
+ *
+ * @param path: Unix socket path given to Server::init_shm()
+ *
+ * @return 0 on success, FAILED otherwise
+ */
+int ShmClient::connect(const char *path)
+{
+    struct sockaddr_un addr = {};
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        msg("unix socket path too long");
+        return FAILED;
+    }
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0 || ::connect(sock, (const sockaddr *)&addr, sizeof(addr)))
+    {
+        msg("connect() error");
+        return FAILED;
+    }
+
+    // memfd, efd_srv, efd_cli
+    int fds[3] = {-1, -1, -1};
+    char byte = 0;
+    struct iovec iov = {&byte, 1};
+    char cbuf[CMSG_SPACE(sizeof(fds))] = {};
+    struct msghdr mh = {};
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = cbuf;
+    mh.msg_controllen = sizeof(cbuf);
+    struct cmsghdr *cm = NULL;
+    if (recvmsg(sock, &mh, MSG_CMSG_CLOEXEC) != 1 || !(cm = CMSG_FIRSTHDR(&mh)) ||
+        cm->cmsg_type != SCM_RIGHTS || cm->cmsg_len != CMSG_LEN(sizeof(fds)))
+    {
+        msg("shm handshake error");
+        return FAILED;
+    }
+    memcpy(fds, CMSG_DATA(cm), sizeof(fds));
+    efd_srv = fds[1];
+    efd_cli = fds[2];
+
+    void *p = mmap(NULL, sizeof(ShmRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    close(fds[0]);
+    if (p == MAP_FAILED)
+    {
+        msg("mmap() error");
+        return FAILED;
+    }
+    region = (ShmRegion *)p;
+    return 0;
+}
+
+/**
+ * @brief blocks until the server woke this side up
+ */
+static void shm_sleep(int efd)
+{
+    uint64_t cnt = 0;
+    (void)read(efd, &cnt, sizeof(cnt));
+}
+
+/**
+ * @brief writes n bytes into the request ring, waits while it is full
+ */
+void ShmClient::put(const void *src, size_t n)
+{
+    ShmRing *ring = &region->req;
+    const uint8_t *p = (const uint8_t *)src;
+    uint32_t spin = shm_spin_limit();
+    while (n)
+    {
+        ssize_t k = shm_ring_write(ring, p, n);
+        if (k < 0)
+        {
+            die("shm ring indices are inconsistent");
+        }
+        if (k)
+        {
+            shm_ring_wake(ring, true, efd_srv);
+            p += k;
+            n -= (size_t)k;
+            spin = shm_spin_limit();
+            continue;
+        }
+        if (--spin)
+        {
+            cpu_relax();
+            continue;
+        }
+        if (shm_ring_wait(ring, true))
+        {
+            shm_sleep(efd_cli);
+        }
+        spin = 1;
+    }
+}
+
+/**
+ * @brief reads n bytes from the response ring, waits while it is empty
+ */
+void ShmClient::get(void *dst, size_t n)
+{
+    ShmRing *ring = &region->res;
+    uint8_t *p = (uint8_t *)dst;
+    uint32_t spin = shm_spin_limit();
+    while (n)
+    {
+        ssize_t k = shm_ring_read(ring, p, n);
+        if (k < 0)
+        {
+            die("shm ring indices are inconsistent");
+        }
+        if (k)
+        {
+            shm_ring_wake(ring, false, efd_srv);
+            p += k;
+            n -= (size_t)k;
+            spin = shm_spin_limit();
+            continue;
+        }
+        if (--spin)
+        {
+            cpu_relax();
+            continue;
+        }
+        if (shm_ring_wait(ring, false))
+        {
+            shm_sleep(efd_cli);
+        }
+        spin = 1;
+    }
+}
+
+/**
+ * @brief sends one request, several may be sent before reading the responses
+ *
+ * @param cmd: command and its args, e.g. {"get", "key"}
+ */
+void ShmClient::send(const std::vector<std::string> &cmd)
+{
+    uint32_t len = 4;
+    for (const std::string &s : cmd)
+    {
+        len += 4 + (uint32_t)s.size();
+    }
+    uint32_t n = (uint32_t)cmd.size();
+
+    // one put per request, the server is rung at most once
+    std::string frame;
+    frame.reserve(4 + len);
+    frame.append((const char *)&len, 4);
+    frame.append((const char *)&n, 4);
+    for (const std::string &s : cmd)
+    {
+        uint32_t sz = (uint32_t)s.size();
+        frame.append((const char *)&sz, 4);
+        frame.append(s);
+    }
+    put(frame.data(), frame.size());
+}
+
+/**
+ * @brief waits for the next response
+ *
+ * @param res: filled with the payload
+ *
+ * @return the response code, see res_enum
+ */
+uint32_t ShmClient::recv(std::string &res)
+{
+    uint32_t len = 0;
+    uint32_t rescode = 0;
+    get(&len, 4);
+    get(&rescode, 4);
+    res.resize(len - 4);
+    get(&res[0], len - 4);
+    return rescode;
+}
+
+uint32_t ShmClient::request(const std::vector<std::string> &cmd, std::string &res)
+{
+    send(cmd);
+    return recv(res);
+}
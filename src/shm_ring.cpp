@@ -0,0 +1,347 @@
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <new>
+
+#include "../include/shm_ring.h"
+#include "../include/utils/print_utils.h"
+
+const uint64_t k_shm_mask = k_shm_ring_size - 1;
+
+/**
+ * @brief how many times an empty or full ring is polled before sleeping
+ *
+ * spinning only pays off if the other side runs on another cpu, on a
+ * single cpu it just delays the other side
+ */
+uint32_t shm_spin_limit()
+{
+    static const uint32_t limit = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? k_shm_spin : 1;
+    return limit;
+}
+
+/**
+ * @brief bytes held by the ring between head and tail
+ *
+ * the other process may write anything in the indices, a count past the
+ * size of the ring means it broke the protocol
+ *
+ * @return the count, -1 if head and tail are inconsistent
+ */
+static ssize_t ring_used(uint64_t head, uint64_t tail)
+{
+    uint64_t used = tail - head;
+    return (used <= k_shm_ring_size) ? (ssize_t)used : -1;
+}
+
+/**
+ * @brief copies up to n bytes into the ring
+ *
+ * @return number of bytes written, 0 if the ring is full, -1 if the
+ * indices are inconsistent
+ */
+ssize_t shm_ring_write(ShmRing *ring, const void *src, size_t n)
+{
+    uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    ssize_t used = ring_used(head, tail);
+    if (used < 0)
+    {
+        return -1;
+    }
+    size_t room = k_shm_ring_size - (size_t)used;
+    n = (n < room) ? n : room;
+
+    size_t off = (size_t)(tail & k_shm_mask);
+    size_t first = (n < k_shm_ring_size - off) ? n : k_shm_ring_size - off;
+    memcpy(&ring->data[off], src, first);
+    memcpy(&ring->data[0], (const uint8_t *)src + first, n - first);
+    ring->tail.store(tail + n, std::memory_order_release);
+    return (ssize_t)n;
+}
+
+/**
+ * @brief copies up to n bytes out of the ring
+ *
+ * @return number of bytes read, 0 if the ring is empty, -1 if the
+ * indices are inconsistent
+ */
+ssize_t shm_ring_read(ShmRing *ring, void *dst, size_t n)
+{
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    uint64_t tail = ring->tail.load(std::memory_order_acquire);
+    ssize_t avail = ring_used(head, tail);
+    if (avail < 0)
+    {
+        return -1;
+    }
+    n = (n < (size_t)avail) ? n : (size_t)avail;
+
+    size_t off = (size_t)(head & k_shm_mask);
+    size_t first = (n < k_shm_ring_size - off) ? n : k_shm_ring_size - off;
+    memcpy(dst, &ring->data[off], first);
+    memcpy((uint8_t *)dst + first, &ring->data[0], n - first);
+    ring->head.store(head + n, std::memory_order_release);
+    return (ssize_t)n;
+}
+
+/**
+ * @brief announces that this side is about to sleep
+ *
+ * the flag is set before the ring is checked again, so the other side
+ * either sees the flag or its update is seen here
+ *
+ * @param producer: true if the caller waits for room, false for data
+ *
+ * @return true if the caller may sleep, false if the ring changed meanwhile
+ */
+bool shm_ring_wait(ShmRing *ring, bool producer)
+{
+    std::atomic<uint32_t> &flag = producer ? ring->prod_waiting : ring->cons_waiting;
+    flag.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    uint64_t tail = ring->tail.load(std::memory_order_acquire);
+    bool blocked = producer ? (tail - head == k_shm_ring_size) : (tail == head);
+    if (!blocked)
+    {
+        flag.store(0, std::memory_order_relaxed);
+    }
+    return blocked;
+}
+
+/**
+ * @brief rings efd if the other side of the ring sleeps
+ *
+ * called after the ring was updated
+ *
+ * @param producer: true if the caller produced, the consumer is woken up,
+ * false if it consumed, the producer is woken up
+ */
+void shm_ring_wake(ShmRing *ring, bool producer, int efd)
+{
+    std::atomic<uint32_t> &flag = producer ? ring->cons_waiting : ring->prod_waiting;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (flag.load(std::memory_order_relaxed) && flag.exchange(0))
+    {
+        uint64_t one = 1;
+        (void)write(efd, &one, sizeof(one));
+    }
+}
+
+/**
+ * @brief sets up the shared memory for a client accepted on sock
+ *
+ * the memfd of the rings and both eventfds are passed to the client
+ * with SCM_RIGHTS, the socket is only kept to notice the client leaving
+ *
+ * @param sock: accepted unix socket
+ *
+ * @return the channel, NULL on error, sock is closed then
+ */
+ShmChannel *shm_channel_new(int sock)
+{
+    ShmChannel *ch = new ShmChannel();
+    ch->sock = sock;
+
+    int memfd = memfd_create("kv-shm", MFD_CLOEXEC);
+    if (memfd < 0 || ftruncate(memfd, sizeof(ShmRegion)))
+    {
+        msg("memfd_create() error");
+        if (memfd >= 0)
+        {
+            close(memfd);
+        }
+        shm_channel_free(ch);
+        return NULL;
+    }
+
+    void *p = mmap(NULL, sizeof(ShmRegion), PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    ch->efd_srv = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ch->efd_cli = eventfd(0, EFD_CLOEXEC);
+    if (p == MAP_FAILED || ch->efd_srv < 0 || ch->efd_cli < 0)
+    {
+        msg("shm setup error");
+        close(memfd);
+        if (p != MAP_FAILED)
+        {
+            munmap(p, sizeof(ShmRegion));
+        }
+        shm_channel_free(ch);
+        return NULL;
+    }
+    ch->region = new (p) ShmRegion();
+    ch->region->req.cons_waiting.store(1); // nothing read yet, ring for the first request
+
+    // one byte of payload carries the 3 fds
+    int fds[3] = {memfd, ch->efd_srv, ch->efd_cli};
+    char byte = 0;
+    struct iovec iov = {&byte, 1};
+    char cbuf[CMSG_SPACE(sizeof(fds))] = {};
+    struct msghdr mh = {};
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = cbuf;
+    mh.msg_controllen = sizeof(cbuf);
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+
+    ssize_t rv = sendmsg(sock, &mh, MSG_NOSIGNAL);
+    close(memfd);
+    if (rv != 1)
+    {
+        msg("sendmsg() error");
+        shm_channel_free(ch);
+        return NULL;
+    }
+    return ch;
+}
+
+void shm_channel_free(ShmChannel *ch)
+{
+    if (ch->region)
+    {
+        munmap(ch->region, sizeof(ShmRegion));
+    }
+    if (ch->sock >= 0)
+    {
+        close(ch->sock);
+    }
+    if (ch->efd_srv >= 0)
+    {
+        close(ch->efd_srv);
+    }
+    if (ch->efd_cli >= 0)
+    {
+        close(ch->efd_cli);
+    }
+    delete ch;
+}
+
+/**
+ * @brief the client broke the indices of a ring, the conn is closed
+ * like on any other read or write error
+ */
+static ssize_t shm_proto_error()
+{
+    msg("shm ring indices are inconsistent");
+    errno = EPROTO;
+    return -1;
+}
+
+/**
+ * @brief read() for a shared memory connection
+ *
+ * spins on an empty ring before going to sleep, see shm_spin_limit(), a
+ * client sending its next request right away is then served without
+ * going through the event loop
+ *
+ * @return bytes read, -1 with errno EAGAIN if nothing came, efd_srv is
+ * rung once there is something, -1 with errno EPROTO if the client broke
+ * the ring
+ */
+ssize_t shm_recv(ShmChannel *ch, void *dst, size_t n)
+{
+    ShmRing *ring = &ch->region->req;
+    uint32_t spin = ch->closed ? 1 : shm_spin_limit();
+    n = (n < k_shm_ring_size) ? n : k_shm_ring_size;
+    while (true)
+    {
+        ssize_t got = shm_ring_read(ring, dst, n);
+        if (got < 0)
+        {
+            return shm_proto_error();
+        }
+        if (got)
+        {
+            shm_ring_wake(ring, false, ch->efd_cli);
+            return got;
+        }
+        if (ch->closed)
+        {
+            return 0;
+        }
+        if (--spin)
+        {
+            cpu_relax();
+            continue;
+        }
+
+        // drain the counter so poll() stops reporting it, then sleep
+        uint64_t rung = 0;
+        (void)read(ch->efd_srv, &rung, sizeof(rung));
+        if (shm_ring_wait(ring, false))
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+        spin = 1;
+    }
+}
+
+/**
+ * @brief writev() for a shared memory connection
+ *
+ * @return bytes written, -1 with errno EAGAIN if the ring is full,
+ * efd_srv is rung once the client made room, -1 with errno EPROTO if the
+ * client broke the ring
+ */
+ssize_t shm_sendv(ShmChannel *ch, const struct iovec *iov, int cnt)
+{
+    ShmRing *ring = &ch->region->res;
+    if (ch->closed)
+    {
+        errno = EPIPE;
+        return -1;
+    }
+    while (true)
+    {
+        size_t total = 0;
+        for (int i = 0; i < cnt && total < k_shm_ring_size; i++)
+        {
+            ssize_t k = shm_ring_write(ring, iov[i].iov_base, iov[i].iov_len);
+            if (k < 0)
+            {
+                return shm_proto_error();
+            }
+            total += (size_t)k;
+            if ((size_t)k < iov[i].iov_len)
+            {
+                break;
+            }
+        }
+        if (total)
+        {
+            shm_ring_wake(ring, true, ch->efd_cli);
+            return (ssize_t)total;
+        }
+        uint64_t rung = 0;
+        (void)read(ch->efd_srv, &rung, sizeof(rung));
+        if (shm_ring_wait(ring, true))
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+    }
+}
+
+/**
+ * @brief checks the handshake socket once it is reported readable
+ *
+ * the client never sends anything on it after connecting
+ *
+ * @return true if the client closed its socket or sent garbage on it
+ */
+bool shm_peer_closed(ShmChannel *ch)
+{
+    char buf[64];
+    ssize_t rv = recv(ch->sock, buf, sizeof(buf), MSG_DONTWAIT);
+    return rv >= 0 || (errno != EAGAIN && errno != EINTR);
+}
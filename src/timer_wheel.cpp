@@ -0,0 +1,224 @@
+#include <assert.h>
+#include <time.h>
+
+#include "../include/timer_wheel.h"
+
+const uint64_t k_wheel_mask = (1 << k_wheel_bits) - 1;
+
+/**
+ * @return milliseconds of the monotonic clock
+ */
+uint64_t monotonic_ms()
+{
+    struct timespec tv = {0, 0};
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+    return (uint64_t)tv.tv_sec * 1000 + (uint64_t)tv.tv_nsec / 1000000;
+}
+
+/**
+ * @return microseconds of the monotonic clock
+ */
+uint64_t monotonic_us()
+{
+    struct timespec tv = {0, 0};
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+    return (uint64_t)tv.tv_sec * 1000000 + (uint64_t)tv.tv_nsec / 1000;
+}
+
+TimerWheel::TimerWheel(uint64_t now) : cur(now)
+{
+    for (uint32_t l = 0; l < k_wheel_levels; l++)
+    {
+        for (Timer &head : slots[l])
+        {
+            head.prev = head.next = &head;
+        }
+    }
+}
+
+/**
+ * @brief puts the timer in the slot matching how far its deadline is
+ */
+void TimerWheel::link(Timer *t)
+{
+    uint64_t delta = (t->expire > cur) ? t->expire - cur : 0;
+    uint32_t level = 0;
+    while (level + 1 < k_wheel_levels && delta >> (k_wheel_bits * (level + 1)))
+    {
+        level++;
+    }
+
+    uint64_t expire = t->expire;
+    uint64_t span = (uint64_t)1 << (k_wheel_bits * (level + 1));
+    if (expire < cur)
+    {
+        expire = cur;
+    }
+    else if (delta >= span)
+    {
+        // beyond the last level, parked as far as it goes and moved down later
+        expire = cur + span - 1;
+    }
+
+    t->level = (uint8_t)level;
+    t->slot = (uint8_t)((expire >> (k_wheel_bits * level)) & k_wheel_mask);
+    Timer *head = &slots[level][t->slot];
+    t->prev = head->prev;
+    t->next = head;
+    head->prev->next = t;
+    head->prev = t;
+    occupied[level] |= (uint64_t)1 << t->slot;
+}
+
+void TimerWheel::unlink(Timer *t)
+{
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    Timer *head = &slots[t->level][t->slot];
+    if (head->next == head)
+    {
+        occupied[t->level] &= ~((uint64_t)1 << t->slot);
+    }
+    t->prev = t->next = NULL;
+}
+
+/**
+ * @brief (re)arms the timer, it is moved if it was already armed
+ *
+ * @param expire: deadline in ms of monotonic_ms()
+ * @param fn: called with the timer once the deadline passed
+ */
+void TimerWheel::add(Timer *t, uint64_t expire, timer_fn fn)
+{
+    if (t->linked())
+    {
+        unlink(t);
+        count--;
+    }
+    t->expire = expire;
+    t->fn = fn;
+    link(t);
+    count++;
+}
+
+void TimerWheel::del(Timer *t)
+{
+    if (t->linked())
+    {
+        unlink(t);
+        count--;
+    }
+}
+
+/**
+ * @brief moves the timers of the current slot of a level one level down
+ */
+void TimerWheel::cascade(uint32_t level)
+{
+    Timer *head = &slots[level][(cur >> (k_wheel_bits * level)) & k_wheel_mask];
+    while (head->next != head)
+    {
+        Timer *t = head->next;
+        unlink(t);
+        link(t);
+    }
+}
+
+/**
+ * @brief runs every timer whose deadline is not after now
+ *
+ * a timer is unlinked before its callback runs, the callback may add or
+ * delete any timer, including the one that fired
+ *
+ * @param ctx: passed to the callbacks
+ */
+void TimerWheel::advance(uint64_t now, void *ctx)
+{
+    while (cur <= now)
+    {
+        if (count == 0)
+        {
+            cur = now + 1;
+            break;
+        }
+
+        uint64_t idx = cur & k_wheel_mask;
+        if (idx != 0 && occupied[0] == 0)
+        {
+            // nothing on the first level, skip to its next wrap
+            uint64_t wrap = (cur | k_wheel_mask) + 1;
+            cur = (wrap < now + 1) ? wrap : now + 1;
+            continue;
+        }
+        if (idx == 0)
+        {
+            // the levels above go down whenever the one below wrapped
+            for (uint32_t l = 1; l < k_wheel_levels; l++)
+            {
+                cascade(l);
+                if ((cur >> (k_wheel_bits * l)) & k_wheel_mask)
+                {
+                    break;
+                }
+            }
+        }
+
+        Timer *head = &slots[0][idx];
+        while (head->next != head)
+        {
+            Timer *t = head->next;
+            unlink(t);
+            count--;
+            t->fn(t, ctx);
+        }
+        cur++;
+    }
+}
+
+/**
+ * @brief time the event loop may sleep before the wheel needs to run
+ *
+ * exact for deadlines on the first level, the higher levels only tell
+ * when their timers go down a level
+ *
+ * @param max_ms: returned when no timer is pending, -1 sleeps forever
+ *
+ * @return milliseconds until the next deadline
+ */
+int TimerWheel::timeout_ms(uint64_t now, int max_ms) const
+{
+    if (count == 0)
+    {
+        return max_ms;
+    }
+
+    uint64_t next = UINT64_MAX;
+    for (uint32_t l = 0; l < k_wheel_levels; l++)
+    {
+        if (!occupied[l])
+        {
+            continue;
+        }
+        uint32_t shift = k_wheel_bits * l;
+        // first time at or after cur where a slot of this level is run
+        uint64_t start = (cur + ((uint64_t)1 << shift) - 1) >> shift;
+        uint32_t rot = (uint32_t)(start & k_wheel_mask);
+        uint64_t bits = (occupied[l] >> rot) | (rot ? occupied[l] << (64 - rot) : 0);
+        uint64_t at = (start + (uint64_t)__builtin_ctzll(bits)) << shift;
+        if (at < next)
+        {
+            next = at;
+        }
+    }
+
+    if (next <= now)
+    {
+        return 0;
+    }
+    uint64_t wait = next - now;
+    if (max_ms >= 0 && wait > (uint64_t)max_ms)
+    {
+        return max_ms;
+    }
+    return (wait > (uint64_t)INT32_MAX) ? INT32_MAX : (int)wait;
+}
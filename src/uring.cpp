@@ -0,0 +1,245 @@
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "../include/uring.h"
+#include "../include/utils/stats_utils.h"
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+Uring::~Uring()
+{
+    if (br)
+    {
+        munmap(br, br_len);
+    }
+    free(br_mem);
+    if (sqes)
+    {
+        munmap(sqes, sqes_len);
+    }
+    if (cq_ptr && cq_ptr != sq_ptr)
+    {
+        munmap(cq_ptr, cq_len);
+    }
+    if (sq_ptr)
+    {
+        munmap(sq_ptr, sq_len);
+    }
+    if (ring_fd >= 0)
+    {
+        close(ring_fd);
+    }
+}
+
+/**
+ * @brief creates the ring and maps the SQ, CQ and SQE arrays
+ *
+ * @param entries: number of SQEs, the CQ gets twice as many
+ *
+ * @return 0 if successful, -1 otherwise (e.g. io_uring is not available)
+ */
+int Uring::init(unsigned entries)
+{
+    struct io_uring_params p = {};
+    ring_fd = io_uring_setup(entries, &p);
+    if (ring_fd < 0)
+    {
+        return -1;
+    }
+
+    sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        sq_len = cq_len = (sq_len > cq_len) ? sq_len : cq_len;
+    }
+
+    sq_ptr = mmap(NULL, sq_len, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED)
+    {
+        sq_ptr = NULL;
+        return -1;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        cq_ptr = sq_ptr;
+    }
+    else
+    {
+        cq_ptr = mmap(NULL, cq_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ptr == MAP_FAILED)
+        {
+            cq_ptr = NULL;
+            return -1;
+        }
+    }
+
+    sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    void *ptr = mmap(NULL, sqes_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (ptr == MAP_FAILED)
+    {
+        return -1;
+    }
+    sqes = (struct io_uring_sqe *)ptr;
+
+    uint8_t *sq = (uint8_t *)sq_ptr;
+    sq_head = (unsigned *)(sq + p.sq_off.head);
+    sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    sq_array = (unsigned *)(sq + p.sq_off.array);
+    sq_local_tail = *sq_tail;
+
+    uint8_t *cq = (uint8_t *)cq_ptr;
+    cq_head = (unsigned *)(cq + p.cq_off.head);
+    cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 0;
+}
+
+/**
+ * @brief registers a ring of provided buffers for IOSQE_BUFFER_SELECT reads
+ *
+ * the kernel picks a free buffer for every completed recv, which means
+ * idle connections do not pin any read memory
+ *
+ * @param bgid: buffer group id used in sqe->buf_group
+ * @param entries: number of buffers, must be a power of 2
+ * @param buf_size: size of each buffer
+ *
+ * @return 0 if successful, -1 otherwise
+ */
+int Uring::setup_buf_ring(uint16_t bgid, uint32_t entries, uint32_t buf_size)
+{
+    br_len = entries * sizeof(struct io_uring_buf);
+    void *ptr = mmap(NULL, br_len, PROT_READ | PROT_WRITE,
+                     MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (ptr == MAP_FAILED)
+    {
+        return -1;
+    }
+    br = (struct io_uring_buf_ring *)ptr;
+
+    struct io_uring_buf_reg reg = {};
+    reg.ring_addr = (uint64_t)(uintptr_t)br;
+    reg.ring_entries = entries;
+    reg.bgid = bgid;
+    if (io_uring_register(ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        return -1;
+    }
+
+    br_mem = (uint8_t *)malloc((size_t)entries * buf_size);
+    if (!br_mem)
+    {
+        return -1;
+    }
+    br_entries = entries;
+    br_buf_size = buf_size;
+    br_tail = 0;
+    for (uint32_t i = 0; i < entries; i++)
+    {
+        buf_recycle((uint16_t)i);
+    }
+    return 0;
+}
+
+uint8_t *Uring::buf_addr(uint16_t bid)
+{
+    return &br_mem[(size_t)bid * br_buf_size];
+}
+
+/**
+ * @brief hands a provided buffer back to the kernel
+ */
+void Uring::buf_recycle(uint16_t bid)
+{
+    // not br->bufs, in C++ the empty struct in __DECLARE_FLEX_ARRAY shifts it
+    struct io_uring_buf *buf = (struct io_uring_buf *)br + (br_tail & (br_entries - 1));
+    buf->addr = (uint64_t)(uintptr_t)buf_addr(bid);
+    buf->len = br_buf_size;
+    buf->bid = bid;
+    br_tail++;
+    __atomic_store_n(&br->tail, br_tail, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief returns the next free SQE, or NULL if the SQ is full
+ *
+ * the SQE is only queued, it is handed to the kernel by submit_and_wait()
+ */
+struct io_uring_sqe *Uring::get_sqe()
+{
+    unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    if (sq_local_tail - head > *sq_mask)
+    {
+        return NULL;
+    }
+
+    unsigned idx = sq_local_tail & *sq_mask;
+    struct io_uring_sqe *sqe = &sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array[idx] = idx;
+    sq_local_tail++;
+    sq_pending++;
+    return sqe;
+}
+
+/**
+ * @brief submits every queued SQE with a single io_uring_enter()
+ *
+ * @param wait_nr: number of completions to wait for
+ *
+ * @return number of SQEs submitted, -1 on error
+ */
+int Uring::submit_and_wait(unsigned wait_nr)
+{
+    __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+
+    unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+    count_syscall();
+    int rv = io_uring_enter(ring_fd, sq_pending, wait_nr, flags);
+    if (rv < 0)
+    {
+        return (errno == EINTR) ? 0 : -1;
+    }
+    sq_pending -= (unsigned)rv;
+    return rv;
+}
+
+struct io_uring_cqe *Uring::peek_cqe()
+{
+    unsigned head = *cq_head;
+    if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+    {
+        return NULL;
+    }
+    return &cqes[head & *cq_mask];
+}
+
+void Uring::cqe_seen()
+{
+    __atomic_store_n(cq_head, *cq_head + 1, __ATOMIC_RELEASE);
+}
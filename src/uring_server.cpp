@@ -0,0 +1,561 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/io_uring.h>
+#include <vector>
+#include <deque>
+#include <memory>
+
+#include "../include/server.h"
+#include "../include/conn.h"
+#include "../include/uring.h"
+#include "../include/constants.h"
+#include "../include/utils/print_utils.h"
+#include "../include/enums/state_enum.h"
+#include "../include/timer_wheel.h"
+
+#define container_of(ptr, type, member) ({                  \
+    const typeof( ((type *)0)->member ) *__mptr = (ptr);    \
+    (type *)( (char *)__mptr - offsetof(type, member) ); })
+
+// operation encoded in the upper half of sqe->user_data, fd in the lower
+enum
+{
+    OP_ACCEPT = 1,
+    OP_RECV = 2,
+    OP_SEND = 3,
+    OP_TIMEOUT = 4,
+};
+
+const uint16_t k_uring_bgid = 0;
+
+// a provided buffer holding received bytes not moved to rbuf yet
+struct PendingBuf
+{
+    uint16_t bid = 0;
+    uint32_t len = 0;
+};
+
+// iovecs of the send in flight, read by the kernel until it completes
+struct SendMsg
+{
+    struct msghdr mh;
+    struct iovec iov[k_max_iov];
+};
+
+// per connection state of the io_uring backend
+struct UringConn
+{
+    std::deque<PendingBuf> pending;
+    std::unique_ptr<SendMsg> send; // heap allocated, uconns may move
+    bool recv_armed = false;
+    bool send_inflight = false;
+    bool closing = false;
+    bool starved = false; // recv stopped on ENOBUFS, see uring_retry_starved()
+    uint64_t pass = 0;    // loop pass of the last turn, see uring_serve()
+};
+
+struct UringCtx
+{
+    Uring ring;
+    std::vector<Conn *> *fd2conn = NULL;
+    size_t max_client_buf = k_max_client_buf;
+    size_t turn_requests = k_turn_requests;
+    size_t turn_bytes = k_turn_bytes;
+    std::vector<UringConn> uconns;
+    std::vector<int> starved; // conns whose recv ran out of provided buffers
+    uint32_t bufs_held = 0;   // provided buffers in the pending queues
+    std::vector<int> runq;    // conns out of budget, continued next pass
+    uint64_t pass = 0;
+
+    TimerWheel *timers = NULL;
+    Timeouts timeouts;
+    uint64_t now = 0;
+    uint64_t timeout_at = UINT64_MAX; // wake up of the latest timeout SQE
+    uint32_t timeout_gen = 0;
+    struct __kernel_timespec ts;
+};
+
+static uint64_t pack(uint32_t op, int fd)
+{
+    return ((uint64_t)op << 32) | (uint32_t)fd;
+}
+
+static struct io_uring_sqe *get_sqe(UringCtx &ctx)
+{
+    struct io_uring_sqe *sqe = ctx.ring.get_sqe();
+    if (!sqe)
+    {
+        // SQ is full, flush what we have and try again
+        if (ctx.ring.submit_and_wait(0) < 0)
+        {
+            die("io_uring_enter()");
+        }
+        sqe = ctx.ring.get_sqe();
+    }
+    assert(sqe);
+    return sqe;
+}
+
+/**
+ * @brief hands a buffer taken from a pending queue back to the kernel
+ */
+static void buf_put(UringCtx &ctx, uint16_t bid)
+{
+    ctx.ring.buf_recycle(bid);
+    ctx.bufs_held--;
+}
+
+/**
+ * @brief multishot accept, one SQE keeps producing a CQE per new connection
+ */
+static void arm_accept(UringCtx &ctx, int listen_fd)
+{
+    struct io_uring_sqe *sqe = get_sqe(ctx);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = pack(OP_ACCEPT, listen_fd);
+}
+
+/**
+ * @brief multishot recv into buffers picked by the kernel from the buffer ring
+ */
+static void arm_recv(UringCtx &ctx, int fd)
+{
+    struct io_uring_sqe *sqe = get_sqe(ctx);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = k_uring_bgid;
+    sqe->user_data = pack(OP_RECV, fd);
+    ctx.uconns[fd].recv_armed = true;
+}
+
+/**
+ * @brief sends the unsent part of wbuf with one sendmsg, large values go
+ * out of their own storage
+ */
+static void arm_send(UringCtx &ctx, Conn *conn)
+{
+    UringConn &uc = ctx.uconns[conn->fd];
+    if (!uc.send)
+    {
+        uc.send.reset(new SendMsg());
+    }
+    memset(&uc.send->mh, 0, sizeof(uc.send->mh));
+    uc.send->mh.msg_iov = uc.send->iov;
+    uc.send->mh.msg_iovlen = conn->wbuf.iov(uc.send->iov, k_max_iov);
+
+    struct io_uring_sqe *sqe = get_sqe(ctx);
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = conn->fd;
+    sqe->addr = (uint64_t)(uintptr_t)&uc.send->mh;
+    sqe->len = 1;
+    sqe->user_data = pack(OP_SEND, conn->fd);
+    uc.send_inflight = true;
+}
+
+/**
+ * @brief wakes the loop up at `at` with a timeout SQE
+ *
+ * a timeout armed earlier still completes, only the latest one counts
+ */
+static void arm_timeout(UringCtx &ctx, int timeout_ms)
+{
+    ctx.ts.tv_sec = timeout_ms / 1000;
+    ctx.ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+    ctx.timeout_at = ctx.now + (uint64_t)timeout_ms;
+    ctx.timeout_gen++;
+
+    struct io_uring_sqe *sqe = get_sqe(ctx);
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)(uintptr_t)&ctx.ts;
+    sqe->len = 1;
+    sqe->user_data = pack(OP_TIMEOUT, (int)ctx.timeout_gen);
+}
+
+static void uring_close(UringCtx &ctx, Conn *conn);
+
+/**
+ * @brief closes a connection whose client did not keep up
+ */
+static void on_conn_timer(Timer *timer, void *ctx)
+{
+    Conn *conn = container_of(timer, Conn, timer);
+    msg("timeout, closing conn");
+    conn->state = STATE_END;
+    uring_close(*(UringCtx *)ctx, conn);
+}
+
+/**
+ * @brief restarts the deadline of the conn, from ctx.now
+ */
+static void uring_arm_timer(UringCtx &ctx, Conn *conn)
+{
+    UringConn &uc = ctx.uconns[conn->fd];
+    // a send in flight counts as blocked on the client
+    uint64_t timeout = uc.send_inflight ? ctx.timeouts.write_ms
+                                        : conn_timeout(conn, ctx.timeouts);
+    if (!timeout || uc.closing)
+    {
+        ctx.timers->del(&conn->timer);
+        return;
+    }
+    ctx.timers->add(&conn->timer, ctx.now + timeout, &on_conn_timer);
+}
+
+/**
+ * @brief closes the connection once no operation refers to it anymore
+ *
+ * shutdown() makes the armed recv complete, the fd is only closed and
+ * reused after its last CQE was reaped
+ */
+static void uring_close(UringCtx &ctx, Conn *conn)
+{
+    UringConn &uc = ctx.uconns[conn->fd];
+    if (!uc.closing)
+    {
+        uc.closing = true;
+        (void)shutdown(conn->fd, SHUT_RDWR);
+    }
+    if (uc.recv_armed || uc.send_inflight)
+    {
+        return;
+    }
+
+    print("STATE_END reached, freeing conn", conn->fd);
+    ctx.timers->del(&conn->timer);
+    for (const PendingBuf &pb : uc.pending)
+    {
+        buf_put(ctx, pb.bid);
+    }
+    uc = UringConn{};
+    (*ctx.fd2conn)[conn->fd] = NULL;
+    (void)close(conn->fd);
+    delete conn;
+}
+
+/**
+ * @brief moves received bytes into rbuf and runs the buffered requests
+ *
+ * the responses of everything received so far are sent with one send.
+ * wbuf must not move while the kernel reads it, so processing stops while
+ * a send is in flight and the remaining bytes stay in their provided buffers.
+ * like on the other loops the conn stops once its turn budget is spent,
+ * the run queue continues it on the next pass
+ */
+static void uring_pump(UringCtx &ctx, Conn *conn)
+{
+    UringConn &uc = ctx.uconns[conn->fd];
+    while (!uc.send_inflight && conn->state == STATE_REQ &&
+           conn->wbuf.size() < k_wbuf_flush)
+    {
+        bool progress = false;
+        // rbuf grows as needed, parse_request bounds it to max_buf
+        while (!uc.pending.empty() && conn->budget_bytes)
+        {
+            PendingBuf &pb = uc.pending.front();
+            conn->rbuf_room(pb.len);
+            conn->rbuf.append(ctx.ring.buf_addr(pb.bid), pb.len);
+            conn->budget_bytes -= (conn->budget_bytes < pb.len) ? conn->budget_bytes : pb.len;
+            buf_put(ctx, pb.bid);
+            uc.pending.pop_front();
+            progress = true;
+        }
+
+        while (conn->state == STATE_REQ && conn->budget && conn->handle_request())
+        {
+            conn->budget--;
+            progress = true;
+        }
+        if (!progress)
+        {
+            break;
+        }
+    }
+
+    if (conn->state == STATE_END)
+    {
+        uring_close(ctx, conn);
+        return;
+    }
+
+    if (!uc.send_inflight && !conn->wbuf.empty())
+    {
+        arm_send(ctx, conn);
+    }
+    if (!uc.send_inflight)
+    {
+        conn->release_buffers();
+    }
+    uring_arm_timer(ctx, conn);
+
+    if (!uc.recv_armed && !uc.closing && !uc.starved && uc.pending.empty())
+    {
+        arm_recv(ctx, conn->fd);
+    }
+    if (conn->yielded() && !conn->queued)
+    {
+        conn->queued = true;
+        ctx.runq.push_back(conn->fd);
+    }
+}
+
+/**
+ * @brief gives the conn its turn of this loop pass
+ *
+ * a multishot recv may complete several times in one pass, the CQEs
+ * share one budget. a conn in the run queue only collects them, it is
+ * pumped when its turn comes
+ */
+static void uring_serve(UringCtx &ctx, Conn *conn)
+{
+    UringConn &uc = ctx.uconns[conn->fd];
+    if (conn->queued)
+    {
+        return;
+    }
+    if (uc.pass != ctx.pass)
+    {
+        uc.pass = ctx.pass;
+        conn->new_turn();
+    }
+    uring_pump(ctx, conn);
+}
+
+static void on_accept(UringCtx &ctx, struct io_uring_cqe *cqe)
+{
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+    {
+        arm_accept(ctx, (int)(uint32_t)cqe->user_data);
+    }
+    if (cqe->res < 0)
+    {
+        msg("accept() error");
+        return;
+    }
+
+    int connfd = cqe->res;
+    set_no_delay(connfd);
+    Conn *conn = conn_new(connfd, ctx.max_client_buf);
+    if (!conn)
+    {
+        close(connfd);
+        return;
+    }
+    conn->turn_requests = ctx.turn_requests;
+    conn->turn_bytes = ctx.turn_bytes;
+    conn_put(*ctx.fd2conn, conn);
+    if (ctx.uconns.size() <= (size_t)connfd)
+    {
+        ctx.uconns.resize(connfd + 1);
+    }
+    ctx.uconns[connfd] = UringConn{};
+    arm_recv(ctx, connfd);
+    uring_arm_timer(ctx, conn);
+}
+
+static void on_recv(UringCtx &ctx, Conn *conn, struct io_uring_cqe *cqe)
+{
+    UringConn &uc = ctx.uconns[conn->fd];
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+    {
+        uc.recv_armed = false;
+    }
+
+    if (cqe->res == -ENOBUFS)
+    {
+        // re-armed once buffers are handed back, see uring_retry_starved()
+        if (!uc.starved)
+        {
+            uc.starved = true;
+            ctx.starved.push_back(conn->fd);
+        }
+        return;
+    }
+    if (cqe->res <= 0)
+    {
+        msg(cqe->res == 0 ? "EOF" : "read() error");
+        conn->state = STATE_END;
+        uring_close(ctx, conn);
+        return;
+    }
+
+    assert(cqe->flags & IORING_CQE_F_BUFFER);
+    PendingBuf pb;
+    pb.bid = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+    pb.len = (uint32_t)cqe->res;
+    if (uc.closing)
+    {
+        ctx.ring.buf_recycle(pb.bid);
+        uring_close(ctx, conn);
+        return;
+    }
+    uc.pending.push_back(pb);
+    ctx.bufs_held++;
+    uring_serve(ctx, conn);
+}
+
+static void on_send(UringCtx &ctx, Conn *conn, struct io_uring_cqe *cqe)
+{
+    UringConn &uc = ctx.uconns[conn->fd];
+    uc.send_inflight = false;
+    if (cqe->res < 0 || uc.closing)
+    {
+        if (!uc.closing)
+        {
+            msg("write() error");
+        }
+        conn->state = STATE_END;
+        uring_close(ctx, conn);
+        return;
+    }
+
+    conn->wbuf.consume((size_t)cqe->res);
+    if (!conn->wbuf.all_sent())
+    {
+        arm_send(ctx, conn);
+        return;
+    }
+
+    // responses were fully sent
+    conn->wbuf.clear();
+    uring_serve(ctx, conn);
+}
+
+/**
+ * @brief re-arms the recvs stopped on ENOBUFS once buffers are back
+ *
+ * re-arming them while the ring is still empty only gets ENOBUFS again,
+ * the loop would spin on it. the buffers held in the pending queues come
+ * back as their conns are pumped, or closed
+ */
+static void uring_retry_starved(UringCtx &ctx)
+{
+    if (ctx.starved.empty() || ctx.bufs_held >= k_uring_bufs)
+    {
+        return;
+    }
+    std::vector<int> starved;
+    starved.swap(ctx.starved);
+    for (int cfd : starved)
+    {
+        if ((size_t)cfd < ctx.fd2conn->size() && (*ctx.fd2conn)[cfd])
+        {
+            ctx.uconns[cfd].starved = false;
+            uring_serve(ctx, (*ctx.fd2conn)[cfd]);
+        }
+    }
+}
+
+/**
+ * @brief completion based loop on top of io_uring
+ *
+ * accepts come from one multishot accept per listener, reads from
+ * multishot recvs into provided buffers, and every SQE queued while
+ * handling a batch of CQEs is submitted together by the next io_uring_enter()
+ *
+ * @param fd: listening socket
+ *
+ * @return false if io_uring could not be set up, does not return otherwise
+ */
+bool Server::run_uring(int fd)
+{
+    UringCtx ctx;
+    if (ctx.ring.init(k_uring_entries) ||
+        ctx.ring.setup_buf_ring(k_uring_bgid, k_uring_bufs, k_uring_buf_size))
+    {
+        return false;
+    }
+    ctx.fd2conn = &fd2conn;
+    ctx.max_client_buf = max_client_buf;
+    ctx.turn_requests = turn_requests;
+    ctx.turn_bytes = turn_bytes;
+    ctx.timers = &timers;
+    ctx.timeouts = timeouts;
+    arm_accept(ctx, fd);
+    if (unix_fd >= 0)
+    {
+        arm_accept(ctx, unix_fd);
+    }
+
+    std::vector<int> turn;
+    while (true)
+    {
+        // sleeps until the next deadline, the completions wake it up earlier
+        ctx.now = monotonic_ms();
+        bool busy = !ctx.runq.empty();
+        int timeout = timers.timeout_ms(ctx.now, -1);
+        if (!busy && timeout >= 0 && ctx.now + (uint64_t)timeout < ctx.timeout_at)
+        {
+            arm_timeout(ctx, timeout);
+        }
+        if (ctx.ring.submit_and_wait(busy ? 0 : 1) < 0)
+        {
+            die("io_uring_enter()");
+        }
+        ctx.now = monotonic_ms();
+        ctx.pass++;
+        served += ctx.runq.size();
+
+        // the conns queued so far get one more turn at the end of this pass
+        turn.swap(ctx.runq);
+
+        struct io_uring_cqe *cqe;
+        while ((cqe = ctx.ring.peek_cqe()) != NULL)
+        {
+            uint32_t op = (uint32_t)(cqe->user_data >> 32);
+            int cfd = (int)(uint32_t)cqe->user_data;
+
+            if (op == OP_ACCEPT)
+            {
+                on_accept(ctx, cqe);
+            }
+            else if (op == OP_TIMEOUT)
+            {
+                if ((uint32_t)cfd == ctx.timeout_gen)
+                {
+                    ctx.timeout_at = UINT64_MAX;
+                }
+            }
+            else if ((size_t)cfd < fd2conn.size() && fd2conn[cfd])
+            {
+                if (op == OP_RECV)
+                {
+                    on_recv(ctx, fd2conn[cfd], cqe);
+                }
+                else if (op == OP_SEND)
+                {
+                    on_send(ctx, fd2conn[cfd], cqe);
+                }
+            }
+            ctx.ring.cqe_seen();
+            served += (op != OP_TIMEOUT);
+        }
+
+        for (int cfd : turn)
+        {
+            Conn *conn = ((size_t)cfd < fd2conn.size()) ? fd2conn[cfd] : NULL;
+            if (!conn || !conn->queued)
+            {
+                continue; // closed meanwhile, the fd may be reused
+            }
+            conn->queued = false;
+            uring_serve(ctx, conn);
+        }
+        turn.clear();
+
+        uring_retry_starved(ctx);
+
+        timers.advance(ctx.now, &ctx);
+    }
+    return true;
+}
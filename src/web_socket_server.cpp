@@ -1,12 +1,10 @@
 #include "../include/web_socket_server.h"
 
 crow::SimpleApp *WebSocketServer::app;
-Connect *WebSocketServer::connect;
 std::unordered_set<crow::websocket::connection *> WebSocketServer::users;
 
 void WebSocketServer::init()
 {
-    connect = new Connect();
     app = new crow::SimpleApp();
 
     CROW_WEBSOCKET_ROUTE((*app), "/ws")
@@ -14,9 +12,11 @@ void WebSocketServer::init()
         .onclose([&](crow::websocket::connection &conn, const std::string &reason) {})
         .onmessage([&](crow::websocket::connection &conn, const std::string &data, bool is_binary)
                    {
-                       connect->do_request(data);
-                       std::string rescode = "[" + std::to_string(connect->rescode) + "]: ";
-                       std::string text = connect->wbuf_size != 0 ? connect->wbuf : "";
+                       // the handlers run on several threads, only the keyspace is shared
+                       Connect connect;
+                       connect.do_request(data);
+                       std::string rescode = "[" + std::to_string(connect.rescode) + "]: ";
+                       std::string text = connect.wbuf_size != 0 ? *connect.wbuf : "";
                        conn.send_text(rescode + text);
                        Logger::sendMessage("Success"); });
 
@@ -36,5 +36,4 @@ std::unordered_set<crow::websocket::connection *> WebSocketServer::getUsers()
 
 WebSocketServer::~WebSocketServer()
 {
-    delete connect;
 }
\ No newline at end of file
@@ -0,0 +1,412 @@
+#ifndef KV_CLIENT_H
+#define KV_CLIENT_H
+
+/**
+ * blocking RESP client and server launcher shared by tests/ and bench/
+ *
+ * the servers run in a child process with their output thrown away, they
+ * listen on port 1234 like the real binary, so one runs at a time
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#define CHECK(cond)                                                         \
+    do                                                                      \
+    {                                                                       \
+        if (!(cond))                                                        \
+        {                                                                   \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+                    #cond);                                                 \
+            exit(1);                                                        \
+        }                                                                   \
+    } while (0)
+
+static inline double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static inline int kv_connect_once()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(fd >= 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(1234);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (const sockaddr *)&addr, sizeof(addr)))
+    {
+        close(fd);
+        return -1;
+    }
+    int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    return fd;
+}
+
+/**
+ * @brief runs fn() in a child process, its stdout goes to /dev/null. the
+ * child is killed with the test, a failed check leaves no server behind
+ *
+ * a server killed just before may take a while to let go of the port,
+ * the new one would fail to bind and the test talk to the old one
+ *
+ * @return pid of the child, see stop_server()
+ */
+template <typename F>
+static inline pid_t spawn_server(F fn)
+{
+    for (int tries = 0;; tries++)
+    {
+        int fd = kv_connect_once();
+        if (fd < 0)
+        {
+            break;
+        }
+        close(fd);
+        CHECK(tries < 500);
+        usleep(10 * 1000);
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    CHECK(pid >= 0);
+    if (pid == 0)
+    {
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, 1);
+        dup2(null_fd, 2);
+        fn();
+        _exit(0);
+    }
+    return pid;
+}
+
+static inline void stop_server(pid_t pid)
+{
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+}
+
+/**
+ * @return cpu time used so far by the process, user and system, in seconds
+ */
+static inline double cpu_sec(pid_t pid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    FILE *f = fopen(path, "r");
+    CHECK(f);
+    char buf[1024];
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = 0;
+    // the fields after the command name, which may hold spaces
+    const char *p = strrchr(buf, ')');
+    CHECK(p);
+    unsigned long utime = 0, stime = 0;
+    CHECK(sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+                 &utime, &stime) == 2);
+    return (double)(utime + stime) / (double)sysconf(_SC_CLK_TCK);
+}
+
+/**
+ * @brief connects to the server on port 1234, waiting for it to listen
+ */
+static inline int kv_connect()
+{
+    for (int tries = 0; tries < 500; tries++)
+    {
+        int fd = kv_connect_once();
+        if (fd >= 0)
+        {
+            return fd;
+        }
+        usleep(10 * 1000);
+    }
+    fprintf(stderr, "cannot connect to the server\n");
+    exit(1);
+}
+
+static inline void kv_send(int fd, std::string_view data)
+{
+    while (!data.empty())
+    {
+        ssize_t rv = write(fd, data.data(), data.size());
+        if (rv < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        CHECK(rv > 0);
+        data.remove_prefix((size_t)rv);
+    }
+}
+
+/**
+ * @brief appends a RESP array of bulk strings to out
+ */
+static inline void resp_cmd(std::string &out, std::initializer_list<std::string_view> args)
+{
+    out += "*" + std::to_string(args.size()) + "\r\n";
+    for (std::string_view a : args)
+    {
+        out += "$" + std::to_string(a.size()) + "\r\n";
+        out.append(a.data(), a.size());
+        out += "\r\n";
+    }
+}
+
+/**
+ * @brief appends a request of the binary protocol to out, a u32 length
+ * and a u32 count of args, each arg a u32 length and its bytes
+ */
+static inline void bin_cmd(std::string &out, std::initializer_list<std::string_view> args)
+{
+    uint32_t len = 4;
+    for (std::string_view a : args)
+    {
+        len += 4 + (uint32_t)a.size();
+    }
+    uint32_t nargs = (uint32_t)args.size();
+    out.append((const char *)&len, 4);
+    out.append((const char *)&nargs, 4);
+    for (std::string_view a : args)
+    {
+        uint32_t n = (uint32_t)a.size();
+        out.append((const char *)&n, 4);
+        out.append(a.data(), a.size());
+    }
+}
+
+// reads the replies of one connection
+struct KvReader
+{
+    int fd = -1;
+    std::string buf;
+    size_t pos = 0;
+
+    explicit KvReader(int fd) : fd(fd) {}
+
+    // makes sure n bytes from pos are buffered
+    void need(size_t n)
+    {
+        while (buf.size() - pos < n)
+        {
+            if (pos > 0 && pos == buf.size())
+            {
+                buf.clear();
+                pos = 0;
+            }
+            char tmp[64 * 1024];
+            ssize_t rv = read(fd, tmp, sizeof(tmp));
+            if (rv < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            CHECK(rv > 0);
+            buf.append(tmp, (size_t)rv);
+        }
+    }
+
+    std::string line()
+    {
+        size_t scanned = 0;
+        while (true)
+        {
+            size_t eol = buf.find("\r\n", pos + scanned);
+            if (eol != std::string::npos)
+            {
+                std::string l = buf.substr(pos, eol - pos);
+                pos = eol + 2;
+                return l;
+            }
+            // the \r may be the last byte read so far
+            size_t have = buf.size() - pos;
+            scanned = have ? have - 1 : 0;
+            need(have + 1);
+        }
+    }
+
+    /**
+     * @brief reads one reply, a bulk string is returned as is, anything
+     * else as its first line with the type byte, "$-1" or "_" for nil.
+     * arrays and maps are read in full and returned as "*n" or "%n"
+     */
+    std::string reply()
+    {
+        std::string l = line();
+        CHECK(!l.empty());
+        if (l[0] == '$' && l != "$-1")
+        {
+            size_t n = (size_t)atoll(l.c_str() + 1);
+            need(n + 2);
+            std::string v = buf.substr(pos, n);
+            pos += n + 2;
+            return v;
+        }
+        if (l[0] == '*' || l[0] == '%')
+        {
+            long n = atol(l.c_str() + 1) * (l[0] == '%' ? 2 : 1);
+            for (long i = 0; i < n; i++)
+            {
+                reply();
+            }
+        }
+        return l;
+    }
+
+    /**
+     * @brief reads one response of the binary protocol
+     *
+     * @return its payload, *rescode is set to its res_enum code
+     */
+    std::string bin_reply(uint32_t *rescode)
+    {
+        need(8);
+        uint32_t len = 0;
+        memcpy(&len, &buf[pos], 4);
+        memcpy(rescode, &buf[pos + 4], 4);
+        CHECK(len >= 4);
+        need(4 + (size_t)len);
+        std::string v = buf.substr(pos + 8, len - 4);
+        pos += 4 + (size_t)len;
+        return v;
+    }
+};
+
+/**
+ * @return the value of field in an INFO reply
+ */
+static inline long long info_field(const std::string &info, const std::string &field)
+{
+    size_t at = info.find("\n" + field + ":");
+    CHECK(at != std::string::npos);
+    return atoll(info.c_str() + at + field.size() + 2);
+}
+
+/**
+ * @return the value of field in the INFO of the server, asked on a
+ * connection of its own
+ */
+static inline long long kv_info(const std::string &field)
+{
+    int fd = kv_connect();
+    KvReader rd(fd);
+    std::string req;
+    resp_cmd(req, {"INFO"});
+    kv_send(fd, req);
+    long long v = info_field(rd.reply(), field);
+    close(fd);
+    return v;
+}
+
+/**
+ * what run_clients() measured, the latency of a request runs from the
+ * send of its batch to the read of its reply
+ */
+struct LoadStats
+{
+    uint64_t reqs = 0;
+    double secs = 0;
+    std::vector<float> lat_us;
+    bool sorted = false;
+
+    double rps() const
+    {
+        return (double)reqs / secs;
+    }
+
+    // the latency below which a fraction p of the requests fall, in us
+    double pct(double p)
+    {
+        if (lat_us.empty())
+        {
+            return 0;
+        }
+        if (!sorted)
+        {
+            std::sort(lat_us.begin(), lat_us.end());
+            sorted = true;
+        }
+        size_t i = (size_t)(p * (double)lat_us.size());
+        return lat_us[std::min(i, lat_us.size() - 1)];
+    }
+};
+
+/**
+ * @brief n_conns clients, a thread and a connection each, send their
+ * batch over and over for secs, reading every reply before the next send
+ *
+ * @param make_batch: make_batch(c, batch) appends the RESP requests of
+ * client c to batch and returns how many there are
+ * @param connect_fn: opens the connection of a client
+ */
+template <typename F>
+static inline LoadStats run_clients(int n_conns, double secs, F make_batch,
+                                    int (*connect_fn)() = kv_connect)
+{
+    std::vector<std::thread> threads;
+    std::vector<LoadStats> stats(n_conns);
+    double start = now_sec();
+    double until = start + secs;
+    for (int c = 0; c < n_conns; c++)
+    {
+        threads.emplace_back([c, until, connect_fn, &make_batch, &stats]()
+                             {
+                                 int fd = connect_fn();
+                                 KvReader rd(fd);
+                                 std::string batch;
+                                 int depth = make_batch(c, batch);
+                                 LoadStats &st = stats[c];
+                                 while (now_sec() < until)
+                                 {
+                                     double sent = now_sec();
+                                     kv_send(fd, batch);
+                                     for (int i = 0; i < depth; i++)
+                                     {
+                                         rd.reply();
+                                         st.lat_us.push_back((float)((now_sec() - sent) * 1e6));
+                                     }
+                                     st.reqs += depth;
+                                 }
+                                 close(fd); });
+    }
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+
+    LoadStats total;
+    total.secs = now_sec() - start;
+    for (LoadStats &st : stats)
+    {
+        total.reqs += st.reqs;
+        total.lat_us.insert(total.lat_us.end(), st.lat_us.begin(), st.lat_us.end());
+    }
+    return total;
+}
+
+#endif
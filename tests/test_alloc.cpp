@@ -0,0 +1,114 @@
+#include <new>
+#include <iostream>
+
+#include "../include/conn.h"
+#include "../include/server.h"
+#include "kv_client.h"
+
+/**
+ * heap allocations of pipelined GET, SET and DEL, end to end through a
+ * Conn on a socketpair: the args are views into rbuf and the replies go
+ * into pooled buffers, so once the buffers are warm only the new values
+ * of the SETs are allocated
+ */
+
+static bool counting = false;
+static size_t n_allocs = 0;
+
+void *operator new(size_t n)
+{
+    if (counting)
+    {
+        n_allocs++;
+    }
+    void *p = malloc(n ? n : 1);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+/**
+ * @brief sends batch to the conn and serves it
+ *
+ * @return heap allocations made meanwhile
+ */
+static size_t serve(Conn *conn, int cli, const std::string &batch)
+{
+    std::cout.setstate(std::ios::badbit); // the conn logs its steps
+    n_allocs = 0;
+    counting = true;
+    kv_send(cli, batch);
+    do
+    {
+        conn->new_turn();
+        conn->connection_io();
+    } while (conn->mid_request() || !conn->wbuf.all_sent());
+    counting = false;
+    std::cout.clear();
+    CHECK(conn->state != STATE_END);
+    return n_allocs;
+}
+
+int main()
+{
+    int sv[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+    Conn *conn = conn_new(sv[0]);
+    KvReader rd(sv[1]);
+
+    const int n = 100;
+    std::string sets, gets, dels;
+    for (int i = 0; i < n; i++)
+    {
+        std::string key = "key:" + std::to_string(i);
+        resp_cmd(sets, {"SET", key, "value:" + std::to_string(i)});
+        resp_cmd(gets, {"GET", key});
+        resp_cmd(dels, {"DEL", key, "missing"});
+    }
+
+    for (int round = 0; round < 3; round++)
+    {
+        size_t set_allocs = serve(conn, sv[1], sets);
+        for (int i = 0; i < n; i++)
+        {
+            CHECK(rd.reply() == "+OK");
+        }
+        size_t get_allocs = serve(conn, sv[1], gets);
+        for (int i = 0; i < n; i++)
+        {
+            CHECK(rd.reply() == "value:" + std::to_string(i));
+        }
+        size_t del_allocs = serve(conn, sv[1], dels);
+        for (int i = 0; i < n; i++)
+        {
+            CHECK(rd.reply() == ":1");
+        }
+        printf("alloc: round %d, %d SET %zu, GET %zu, DEL %zu allocations\n",
+               round, n, set_allocs, get_allocs, del_allocs);
+        if (round == 0)
+        {
+            continue; // buffers and tables warming up
+        }
+        CHECK(get_allocs == 0);
+        CHECK(del_allocs == 0);
+        CHECK(set_allocs <= 2 * n); // the value and the entry of each key
+    }
+
+    close(sv[1]);
+    close(sv[0]);
+    printf("alloc: ok\n");
+    return 0;
+}
@@ -0,0 +1,180 @@
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../include/cmap.h"
+#include "../include/epoch.h"
+#include "../include/hash.h"
+#include "kv_client.h"
+
+/**
+ * threads hammering one CMap while its buckets double: every thread
+ * checks its private keys exactly against a model of its own, and all of
+ * them churn a few shared keys, whose nodes are retired under the feet
+ * of the others
+ */
+
+struct TestEntry
+{
+    CNode node;
+    uint64_t key = 0;
+    std::atomic<uint64_t> val{0};
+};
+
+static const uint64_t k_private = 2000;
+static const uint64_t k_shared = 64;
+static const uint64_t k_freed = 0xdead;
+
+static std::atomic<int> g_bad;
+
+static bool entry_eq(CNode *a, CNode *b)
+{
+    return ((TestEntry *)a)->key == ((TestEntry *)b)->key;
+}
+
+// a reader still holding the node would see the key change
+static void entry_free(void *p)
+{
+    TestEntry *e = (TestEntry *)p;
+    e->key = k_freed;
+    delete e;
+}
+
+static uint64_t key_hash(uint64_t key)
+{
+    return str_hash((const uint8_t *)&key, 8);
+}
+
+static uint64_t private_key(int t, uint64_t i)
+{
+    return (uint64_t)(t + 1) * 1000000 + i;
+}
+
+static void bad_if(bool cond)
+{
+    if (cond)
+    {
+        g_bad++;
+    }
+}
+
+static void worker(CMap *cmap, int t, long ops, std::vector<char> *model)
+{
+    std::mt19937_64 rng(t * 7 + 1);
+    for (long i = 0; i < ops; i++)
+    {
+        EpochGuard guard;
+        bool shared = rng() % 4 == 0;
+        uint64_t j = rng() % k_private;
+        TestEntry key;
+        key.key = shared ? 1 + rng() % k_shared : private_key(t, j);
+        key.node.hcode = key_hash(key.key);
+        char *has = shared ? NULL : &(*model)[j];
+
+        switch (rng() % 3)
+        {
+        case 0:
+        {
+            CNode *node = cm_lookup(cmap, &key.node, entry_eq);
+            bad_if(node && ((TestEntry *)node)->key != key.key);
+            bad_if(has && (node != NULL) != (bool)*has);
+            break;
+        }
+        case 1:
+        {
+            TestEntry *e = new TestEntry();
+            e->key = key.key;
+            e->node.hcode = key.node.hcode;
+            CNode *node = cm_insert(cmap, &e->node, entry_eq);
+            if (node)
+            {
+                // already there, the insert left the map alone
+                bad_if(((TestEntry *)node)->key != key.key);
+                ((TestEntry *)node)->val.store((uint64_t)i);
+                delete e;
+            }
+            bad_if(has && (node != NULL) != (bool)*has);
+            if (has)
+            {
+                *has = 1;
+            }
+            break;
+        }
+        default:
+        {
+            CNode *node = cm_pop(cmap, &key.node, entry_eq);
+            if (node)
+            {
+                bad_if(((TestEntry *)node)->key != key.key);
+                epoch_retire(node, entry_free);
+            }
+            bad_if(has && (node != NULL) != (bool)*has);
+            if (has)
+            {
+                *has = 0;
+            }
+            break;
+        }
+        }
+    }
+}
+
+static void stress(int n_threads, long ops)
+{
+    CMap cmap;
+    std::vector<std::vector<char>> models(n_threads, std::vector<char>(k_private));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < n_threads; t++)
+    {
+        threads.emplace_back(worker, &cmap, t, ops, &models[t]);
+    }
+    for (std::thread &th : threads)
+    {
+        th.join();
+    }
+
+    // every key is popped, whatever was left must be counted
+    size_t size = cm_size(&cmap);
+    size_t expect = 0;
+    {
+        EpochGuard guard;
+        for (int t = 0; t < n_threads; t++)
+        {
+            for (uint64_t j = 0; j < k_private; j++)
+            {
+                TestEntry key;
+                key.key = private_key(t, j);
+                key.node.hcode = key_hash(key.key);
+                CNode *node = cm_pop(&cmap, &key.node, entry_eq);
+                bad_if((node != NULL) != (bool)models[t][j]);
+                expect += node != NULL;
+                delete (TestEntry *)node;
+            }
+        }
+        for (uint64_t k = 1; k <= k_shared; k++)
+        {
+            TestEntry key;
+            key.key = k;
+            key.node.hcode = key_hash(k);
+            CNode *node = cm_pop(&cmap, &key.node, entry_eq);
+            expect += node != NULL;
+            delete (TestEntry *)node;
+        }
+    }
+    CHECK(g_bad == 0);
+    CHECK(expect == size);
+    CHECK(cm_size(&cmap) == 0);
+    CHECK(cmap.buckets.load() > k_cmap_min_buckets);
+    cm_destroy(&cmap);
+}
+
+int main()
+{
+    for (int n_threads : {1, 4, 16, 32})
+    {
+        stress(n_threads, 400000 / n_threads + 20000);
+    }
+    printf("cmap: ok\n");
+    return 0;
+}
@@ -0,0 +1,176 @@
+#include <vector>
+
+#include "../include/cmd_table.h"
+#include "../include/server.h"
+#include "../include/enums/loop_enum.h"
+#include "../include/enums/res_enum.h"
+#include "../include/enums/serial_enum.h"
+#include "kv_client.h"
+
+/**
+ * @brief names match whole and in any case, never a prefix either way
+ */
+static void test_cmd_find()
+{
+    CHECK(cmd_find("get") && cmd_find("get")->id == CMD_GET);
+    CHECK(cmd_find("GeT") && cmd_find("GeT")->id == CMD_GET);
+    CHECK(cmd_find("EXISTS") && cmd_find("EXISTS")->id == CMD_EXISTS);
+    CHECK(cmd_find("mget") && cmd_find("mget")->combine == COMBINE_ARRAY);
+    CHECK(!cmd_find("ge"));
+    CHECK(!cmd_find("gets"));
+    CHECK(!cmd_find(""));
+    CHECK(!cmd_find(std::string_view("get\0", 4)));
+
+    CHECK(cmd_is("DEL", "del"));
+    CHECK(!cmd_is("de", "del"));
+    CHECK(!cmd_is("dell", "del"));
+    CHECK(!cmd_is(std::string_view("delete", 3).substr(0, 2), "del"));
+}
+
+/**
+ * @brief multi-key commands whose keys are spread over stripes or
+ * shards, every key runs where it lives and the results are combined
+ */
+static void test_multikey(const char *name)
+{
+    int fd = kv_connect();
+    KvReader rd(fd);
+
+    const int n = 64;
+    std::string req;
+    for (int i = 0; i < n; i++)
+    {
+        resp_cmd(req, {"SET", "mk" + std::to_string(i), "v"});
+    }
+    kv_send(fd, req);
+    for (int i = 0; i < n; i++)
+    {
+        CHECK(rd.reply() == "+OK");
+    }
+
+    std::vector<std::string> keys;
+    for (int i = 0; i < n; i += 2)
+    {
+        keys.push_back("mk" + std::to_string(i));
+        keys.push_back("missing" + std::to_string(i));
+    }
+    // the same key twice counts twice, like redis
+    keys.push_back("mk0");
+
+    req.clear();
+    req += "*" + std::to_string(keys.size() + 1) + "\r\n$6\r\nEXISTS\r\n";
+    for (const std::string &k : keys)
+    {
+        req += "$" + std::to_string(k.size()) + "\r\n" + k + "\r\n";
+    }
+    std::string del = req;
+    del.replace(del.find("$6\r\nEXISTS"), 10, "$3\r\nDEL");
+    kv_send(fd, req + del + req);
+    CHECK(rd.reply() == ":" + std::to_string(n / 2 + 1));
+    CHECK(rd.reply() == ":" + std::to_string(n / 2));
+    CHECK(rd.reply() == ":0");
+
+    req.clear();
+    resp_cmd(req, {"EXISTS", "mk1", "mk3", "mk0"});
+    resp_cmd(req, {"exists"});
+    kv_send(fd, req);
+    CHECK(rd.reply() == ":2");
+    CHECK(rd.reply()[0] == '-');
+
+    // the values come back in the order of the keys, wherever they live
+    std::string big(2000, 'b');
+    req.clear();
+    resp_cmd(req, {"SET", "mk5", big});
+    resp_cmd(req, {"MGET", "mk1", "mk0", "mk5", "mk3", "mk1"});
+    kv_send(fd, req);
+    CHECK(rd.reply() == "+OK");
+    CHECK(rd.line() == "*5");
+    CHECK(rd.reply() == "v");
+    CHECK(rd.reply() == "$-1");
+    CHECK(rd.reply() == big);
+    CHECK(rd.reply() == "v");
+    CHECK(rd.reply() == "v");
+    close(fd);
+
+    // the tagged array of the binary protocol
+    fd = kv_connect();
+    KvReader brd(fd);
+    req.clear();
+    bin_cmd(req, {"mget", "mk5", "mk0", "mk3"});
+    kv_send(fd, req);
+    uint32_t rescode = 0;
+    uint32_t three = 3, one = 1, len = (uint32_t)big.size();
+    std::string expect = std::string(1, SER_ARR) + std::string((const char *)&three, 4) +
+                         std::string(1, SER_STR) + std::string((const char *)&len, 4) + big +
+                         std::string(1, SER_NIL) +
+                         std::string(1, SER_STR) + std::string((const char *)&one, 4) + "v";
+    CHECK(brd.bin_reply(&rescode) == expect);
+    CHECK(rescode == RES_OK);
+    close(fd);
+
+    printf("cmds %s: ok\n", name);
+}
+
+/**
+ * @brief clients resetting their connection with multi-key commands still
+ * running on the other shards, the server goes on serving the others
+ */
+static void test_abort(const char *name)
+{
+    int fd = kv_connect();
+    KvReader rd(fd);
+    std::string req;
+    for (int i = 0; i < 200; i++)
+    {
+        resp_cmd(req, {"SET", "ab" + std::to_string(i), std::string(1000, 'a')});
+    }
+    kv_send(fd, req);
+    for (int i = 0; i < 200; i++)
+    {
+        CHECK(rd.reply() == "+OK");
+    }
+
+    // each request may or may not have run when the reset comes in
+    for (int i = 0; i < 200; i++)
+    {
+        resp_cmd(req, {"MGET", "ab" + std::to_string(i), "mk0", "mk2", "mk4", "mk6"});
+    }
+    for (int round = 0; round < 200; round++)
+    {
+        int cfd = kv_connect();
+        kv_send(cfd, req);
+        struct linger lg = {1, 0};
+        setsockopt(cfd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+        close(cfd);
+    }
+
+    std::string get;
+    resp_cmd(get, {"MGET", "ab0", "ab199"});
+    kv_send(fd, get);
+    CHECK(rd.line() == "*2");
+    CHECK(rd.reply() == std::string(1000, 'a'));
+    CHECK(rd.reply() == std::string(1000, 'a'));
+    close(fd);
+
+    printf("cmds %s abort: ok\n", name);
+}
+
+int main()
+{
+    test_cmd_find();
+
+    pid_t pid = spawn_server([]()
+                             {
+                                 Server server(LOOP_EPOLL);
+                                 server.run_server(server.init()); });
+    test_multikey("stripes");
+    test_abort("stripes");
+    stop_server(pid);
+
+    pid = spawn_server([]()
+                       { Server::run_shards(4, LOOP_EPOLL); });
+    test_multikey("shards");
+    test_abort("shards");
+    stop_server(pid);
+    return 0;
+}
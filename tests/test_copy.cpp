@@ -0,0 +1,130 @@
+#include <new>
+#include <iostream>
+
+#include "../include/conn.h"
+#include "../include/constants.h"
+#include "../include/server.h"
+#include "kv_client.h"
+
+/**
+ * bytes copied into the write-buffer and heap allocations per GET, for
+ * values on both sides of k_zero_copy_min. the requests are put straight
+ * in rbuf and run by handle_request(), so the replies are still in wbuf to
+ * be looked at: the small values are copied, the large ones referenced
+ * with nothing but their header copied
+ */
+
+static bool counting = false;
+static size_t n_allocs = 0;
+
+void *operator new(size_t n)
+{
+    if (counting)
+    {
+        n_allocs++;
+    }
+    void *p = malloc(n ? n : 1);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+/**
+ * @brief runs every request of batch on the conn, the replies are left
+ * in wbuf
+ */
+static void run(Conn *conn, const std::string &batch)
+{
+    conn->wbuf.clear();
+    conn->rbuf.append(batch.data(), batch.size());
+    while (conn->handle_request())
+    {
+    }
+    CHECK(conn->state == STATE_REQ && !conn->mid_request());
+}
+
+// the bytes wbuf would send, in order
+static std::string unsent(const OutBuf &out)
+{
+    std::vector<struct iovec> iov(2 * out.refs.size() + 2);
+    size_t cnt = out.iov(iov.data(), iov.size());
+    std::string s;
+    for (size_t i = 0; i < cnt; i++)
+    {
+        s.append((const char *)iov[i].iov_base, iov[i].iov_len);
+    }
+    CHECK(s.size() == out.size());
+    return s;
+}
+
+static void test_get(size_t len)
+{
+    Conn *conn = conn_new(-1);
+    const int n = 64;
+    std::string prefix = "copy" + std::to_string(len) + ":";
+    std::string val(len, 'c');
+    std::string sets, gets, expect;
+    for (int i = 0; i < n; i++)
+    {
+        resp_cmd(sets, {"SET", prefix + std::to_string(i), val});
+        resp_cmd(gets, {"GET", prefix + std::to_string(i)});
+        expect += "$" + std::to_string(len) + "\r\n" + val + "\r\n";
+    }
+    run(conn, sets);
+
+    for (int round = 0; round < 2; round++)
+    {
+        std::cout.setstate(std::ios::badbit); // the conn logs its steps
+        n_allocs = 0;
+        counting = true;
+        run(conn, gets);
+        counting = false;
+        std::cout.clear();
+        CHECK(unsent(conn->wbuf) == expect);
+        if (round == 0)
+        {
+            continue; // buffers warming up
+        }
+
+        double copied = (double)conn->wbuf.buf.size / n;
+        double referenced = (double)conn->wbuf.refs_len / n;
+        printf("copy: %5zu B values, per GET %7.1f bytes copied, %7.1f referenced, %.1f allocations\n",
+               len, copied, referenced, (double)n_allocs / n);
+        CHECK(n_allocs == 0);
+        if (len >= k_zero_copy_min)
+        {
+            // the $<len>\r\n header and the \r\n after the value
+            CHECK(copied <= 16);
+            CHECK(referenced == len);
+        }
+        else
+        {
+            CHECK(copied >= len && referenced == 0);
+        }
+    }
+
+    conn->wbuf.clear();
+    delete conn;
+}
+
+int main()
+{
+    for (size_t len : {16, 256, 1023, 1024, 4096, 32768})
+    {
+        test_get(len);
+    }
+    printf("copy: ok\n");
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "../include/hash.h"
+#include "kv_client.h"
+
+/**
+ * str_hash() in both modes: SipHash against its reference vectors, then
+ * the bits each mode spreads, for keys of the sizes the server sees
+ */
+
+static uint64_t hash(const std::string &s)
+{
+    return str_hash((const uint8_t *)s.data(), s.size());
+}
+
+/**
+ * @brief the vectors of the SipHash paper, key 00..0f and message 00..len-1
+ */
+static void test_sip_vectors()
+{
+    uint64_t key[2] = {0x0706050403020100ull, 0x0f0e0d0c0b0a0908ull};
+    hash_set_seeds(1, key);
+    hash_set_mode(HASH_SIP);
+
+    std::string msg;
+    for (int i = 0; i < 64; i++)
+    {
+        msg.push_back((char)i);
+    }
+    CHECK(hash(msg.substr(0, 0)) == 0x726fdb47dd0e0e31ull);
+    CHECK(hash(msg.substr(0, 15)) == 0xa129ca6149be45e5ull);
+    CHECK(hash(msg.substr(0, 63)) == 0x958a324ceb064572ull);
+}
+
+/**
+ * @brief flipping any input bit flips every output bit half of the time
+ */
+static void test_avalanche(size_t len)
+{
+    const int trials = 300;
+    std::vector<double> flips(64, 0);
+    double total = 0;
+    std::string buf(len, 0);
+    for (int t = 0; t < trials; t++)
+    {
+        for (char &c : buf)
+        {
+            c = (char)rand();
+        }
+        uint64_t h = hash(buf);
+        for (size_t bit = 0; bit < len * 8; bit++)
+        {
+            buf[bit / 8] ^= (char)(1 << (bit % 8));
+            uint64_t d = h ^ hash(buf);
+            buf[bit / 8] ^= (char)(1 << (bit % 8));
+            total += __builtin_popcountll(d);
+            for (int o = 0; o < 64; o++)
+            {
+                flips[o] += (d >> o) & 1;
+            }
+        }
+    }
+    double n = trials * len * 8.0;
+    CHECK(fabs(total / n - 32) < 0.5);
+    for (double f : flips)
+    {
+        CHECK(fabs(f / n - 0.5) < 0.05);
+    }
+}
+
+/**
+ * @brief "key:N" keys land in the low bits like random numbers would
+ */
+static void test_collisions()
+{
+    const size_t keys = 1000000;
+    const size_t buckets = 1 << 20;
+    std::vector<uint8_t> used(buckets);
+    size_t collisions = 0;
+    for (size_t i = 0; i < keys; i++)
+    {
+        uint64_t h = hash("key:" + std::to_string(i));
+        collisions += used[h & (buckets - 1)]++ ? 1 : 0;
+    }
+    double ideal = keys - buckets * (1 - exp(-(double)keys / buckets));
+    CHECK(fabs(collisions - ideal) < ideal * 0.02);
+}
+
+int main()
+{
+    test_sip_vectors();
+
+    uint64_t key[2] = {0x9E3779B97F4A7C15ull, 0xBF58476D1CE4E5B9ull};
+    hash_set_seeds(0x94D049BB133111EBull, key);
+    for (uint32_t mode : {HASH_FAST, HASH_SIP})
+    {
+        hash_set_mode(mode);
+        for (size_t len : {3, 8, 16, 40})
+        {
+            test_avalanche(len);
+        }
+        test_collisions();
+    }
+    printf("hash: ok\n");
+    return 0;
+}
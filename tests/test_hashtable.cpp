@@ -0,0 +1,110 @@
+#include <random>
+#include <unordered_map>
+
+#include "../include/hashtable.h"
+#include "kv_client.h"
+
+/**
+ * random lookups, inserts and pops on an HMap checked against an
+ * unordered_map, with hm_rehash() steps of random budgets in between so
+ * that resizes are caught at every stage of moving the nodes
+ */
+
+struct TestEntry
+{
+    HNode node;
+    uint64_t key = 0;
+};
+
+static bool entry_eq(HNode *a, HNode *b)
+{
+    return ((TestEntry *)a)->key == ((TestEntry *)b)->key;
+}
+
+/**
+ * @brief ops random operations on keys below range
+ *
+ * @param collide hash every key to one of 256 values, the probes then
+ * run over long stretches of matching tags
+ */
+static void fuzz(uint64_t seed, uint64_t range, size_t ops, bool collide)
+{
+    std::mt19937_64 rng(seed);
+    HMap hmap;
+    std::unordered_map<uint64_t, TestEntry *> ref;
+    size_t resizes = 0;
+
+    for (size_t i = 0; i < ops; i++)
+    {
+        TestEntry key;
+        key.key = rng() % range;
+        key.node.hcode = collide ? (key.key & 0xff) : key.key * 0x9E3779B97F4A7C15ull;
+        auto it = ref.find(key.key);
+
+        switch (rng() % 3)
+        {
+        case 0:
+        {
+            HNode *node = hm_lookup(&hmap, &key.node, entry_eq);
+            CHECK((node != NULL) == (it != ref.end()));
+            CHECK(!node || node == &it->second->node);
+            break;
+        }
+        case 1:
+            if (it == ref.end())
+            {
+                TestEntry *e = new TestEntry(key);
+                hm_insert(&hmap, &e->node);
+                ref[key.key] = e;
+            }
+            break;
+        default:
+        {
+            HNode *node = hm_pop(&hmap, &key.node, entry_eq);
+            CHECK((node != NULL) == (it != ref.end()));
+            if (node)
+            {
+                CHECK(node == &it->second->node);
+                delete it->second;
+                ref.erase(it);
+            }
+            break;
+        }
+        }
+
+        CHECK(hm_size(&hmap) == ref.size());
+        if (rng() % 64 == 0)
+        {
+            hm_rehash(&hmap, rng() % 3);
+        }
+        resizes = hm_stats(&hmap).resizes;
+    }
+
+    // every node is still there once the resize is done
+    while (hm_rehash(&hmap, 1000))
+    {
+    }
+    for (auto &[k, e] : ref)
+    {
+        CHECK(hm_lookup(&hmap, &e->node, entry_eq) == &e->node);
+    }
+    CHECK(resizes > 0);
+
+    hm_destroy(&hmap);
+    for (auto &[k, e] : ref)
+    {
+        delete e;
+    }
+}
+
+int main()
+{
+    for (uint64_t seed = 0; seed < 2; seed++)
+    {
+        fuzz(seed, 300000, 1000000, false); // grows, rarely shrinks
+        fuzz(seed, 5000, 1000000, false);   // tombstones, shrinks
+        fuzz(seed, 5000, 300000, true);
+    }
+    printf("hashtable: ok\n");
+    return 0;
+}
@@ -0,0 +1,141 @@
+#include <vector>
+
+#include "../include/server.h"
+#include "../include/enums/loop_enum.h"
+#include "kv_client.h"
+
+static const char *k_loop_names[] = {"epoll", "poll", "uring"};
+
+/**
+ * @brief SET, GET and DEL one at a time, then pipelined, on every backend
+ */
+static void test_basic(uint32_t loop_type)
+{
+    pid_t pid = spawn_server([loop_type]()
+                             {
+                                 Server server(loop_type);
+                                 server.run_server(server.init()); });
+    int fd = kv_connect();
+    KvReader rd(fd);
+
+    std::string req;
+    resp_cmd(req, {"SET", "k", "v"});
+    resp_cmd(req, {"GET", "k"});
+    resp_cmd(req, {"DEL", "k", "nope"});
+    resp_cmd(req, {"GET", "k"});
+    kv_send(fd, req);
+    CHECK(rd.reply() == "+OK");
+    CHECK(rd.reply() == "v");
+    CHECK(rd.reply() == ":1");
+    CHECK(rd.reply() == "$-1");
+
+    // more than a turn budget of requests in one go
+    const int n = 20000;
+    req.clear();
+    for (int i = 0; i < n; i++)
+    {
+        resp_cmd(req, {"SET", "k" + std::to_string(i), "v" + std::to_string(i)});
+    }
+    for (int i = 0; i < n; i++)
+    {
+        resp_cmd(req, {"GET", "k" + std::to_string(i)});
+    }
+    kv_send(fd, req);
+    for (int i = 0; i < n; i++)
+    {
+        CHECK(rd.reply() == "+OK");
+    }
+    for (int i = 0; i < n; i++)
+    {
+        CHECK(rd.reply() == "v" + std::to_string(i));
+    }
+
+    close(fd);
+    stop_server(pid);
+    printf("%s: ok\n", k_loop_names[loop_type]);
+}
+
+/**
+ * @brief the io_uring loop runs out of provided buffers, it must sleep
+ * until they come back and then serve everyone again
+ *
+ * the clients keep sending GETs of a large value and never read, so the
+ * sends never complete and the received bytes pile up in the pending
+ * queues until the buffer ring is empty
+ */
+static void test_uring_starved()
+{
+    pid_t pid = spawn_server([]()
+                             {
+                                 Server server(LOOP_URING);
+                                 server.run_server(server.init()); });
+    int fd = kv_connect();
+    KvReader rd(fd);
+    std::string req;
+    resp_cmd(req, {"SET", "big", std::string(64 * 1024, 'x')});
+    kv_send(fd, req);
+    CHECK(rd.reply() == "+OK");
+
+    std::string gets;
+    for (int i = 0; i < 4096; i++)
+    {
+        resp_cmd(gets, {"GET", "big"});
+    }
+
+    std::vector<int> clients;
+    for (int i = 0; i < 16; i++)
+    {
+        int cfd = kv_connect();
+        fcntl(cfd, F_SETFL, fcntl(cfd, F_GETFL) | O_NONBLOCK);
+        clients.push_back(cfd);
+    }
+    // until the server stops taking any more
+    double until = now_sec() + 2;
+    while (now_sec() < until)
+    {
+        for (int cfd : clients)
+        {
+            ssize_t rv = write(cfd, gets.data(), gets.size());
+            (void)rv;
+        }
+        usleep(1000);
+    }
+
+    // one more request, it waits for buffers
+    int late = kv_connect();
+    KvReader late_rd(late);
+    req.clear();
+    resp_cmd(req, {"GET", "nope"});
+    kv_send(late, req);
+
+    double cpu = cpu_sec(pid);
+    usleep(1000 * 1000);
+    cpu = cpu_sec(pid) - cpu;
+    printf("uring starved: %.2fs cpu in 1s\n", cpu);
+    CHECK(cpu < 0.2);
+
+    // closing the clients hands the buffers back
+    for (int cfd : clients)
+    {
+        close(cfd);
+    }
+    CHECK(late_rd.reply() == "$-1");
+    req.clear();
+    resp_cmd(req, {"DEL", "big"});
+    kv_send(fd, req);
+    CHECK(rd.reply() == ":1");
+
+    close(late);
+    close(fd);
+    stop_server(pid);
+    printf("uring starved: ok\n");
+}
+
+int main()
+{
+    test_basic(LOOP_EPOLL);
+    test_basic(LOOP_POLL);
+    test_basic(LOOP_URING);
+    test_uring_starved();
+    return 0;
+}
@@ -0,0 +1,127 @@
+#include <memory>
+
+#include "../include/out_buf.h"
+#include "../include/enums/error_enum.h"
+#include "../include/enums/proto_enum.h"
+#include "../include/enums/serial_enum.h"
+#include "kv_client.h"
+
+/**
+ * the bytes every reply_*() call produces, in each protocol. the binary
+ * protocol tags a value with its serial_enum type only inside an array,
+ * a single reply gets its type from the rescode of the response header
+ */
+
+// the unsent bytes of out, the referenced values included
+static std::string bytes(const OutBuf &out)
+{
+    struct iovec iov[64];
+    size_t cnt = out.iov(iov, 64);
+    std::string s;
+    for (size_t i = 0; i < cnt; i++)
+    {
+        s.append((const char *)iov[i].iov_base, iov[i].iov_len);
+    }
+    CHECK(s.size() == out.unsent());
+    return s;
+}
+
+static std::string u32(uint32_t n)
+{
+    return std::string((const char *)&n, 4);
+}
+
+static std::string i64(int64_t n)
+{
+    return std::string((const char *)&n, 8);
+}
+
+static std::string tag(uint8_t t)
+{
+    return std::string(1, (char)t);
+}
+
+/**
+ * @brief one element of every type in an array, then the same replies
+ * one at a time
+ */
+static void test_types(uint32_t proto, const std::string &arr, const std::string &single)
+{
+    Value big = std::make_shared<const std::string>(4096, 'b');
+    OutBuf out;
+    out.proto = proto;
+    out.reply_arr(6);
+    out.reply_nil();
+    out.reply_err(ERR_UNKNOWN, "bad");
+    out.reply_str("ab", 2);
+    out.reply_int(-7);
+    out.reply_value(big);
+    out.reply_status("OK");
+    CHECK(out.arr_left.empty());
+    CHECK(bytes(out) == arr);
+
+    OutBuf one;
+    one.proto = proto;
+    one.reply_nil();
+    one.reply_err(ERR_UNKNOWN, "bad");
+    one.reply_str("ab", 2);
+    one.reply_int(-7);
+    one.reply_value(big);
+    one.reply_status("OK");
+    CHECK(bytes(one) == single);
+}
+
+/**
+ * @brief arrays in arrays, the empty one closes right away and the outer
+ * array counts it as one element
+ */
+static void test_nested(uint32_t proto, const std::string &expect)
+{
+    OutBuf out;
+    out.proto = proto;
+    out.reply_arr(3);
+    out.reply_arr(0);
+    out.reply_arr(2);
+    out.reply_int(1);
+    out.reply_nil();
+    out.reply_map(1);
+    out.reply_str("k", 1);
+    out.reply_str("v", 1);
+    CHECK(out.arr_left.empty());
+    // after the array, replies are untagged again
+    out.reply_int(5);
+    CHECK(bytes(out) == expect);
+}
+
+int main()
+{
+    std::string big(4096, 'b');
+
+    test_types(PROTO_BIN,
+               tag(SER_ARR) + u32(6) +
+                   tag(SER_NIL) +
+                   tag(SER_ERR) + u32(ERR_UNKNOWN) + u32(3) + "bad" +
+                   tag(SER_STR) + u32(2) + "ab" +
+                   tag(SER_INT) + i64(-7) +
+                   tag(SER_STR) + u32(4096) + big +
+                   tag(SER_STR) + u32(2) + "OK",
+               "bad" "ab" + big);
+    test_types(PROTO_RESP2,
+               "*6\r\n$-1\r\n-ERR bad\r\n$2\r\nab\r\n:-7\r\n$4096\r\n" + big + "\r\n+OK\r\n",
+               "$-1\r\n-ERR bad\r\n$2\r\nab\r\n:-7\r\n$4096\r\n" + big + "\r\n+OK\r\n");
+    test_types(PROTO_RESP3,
+               "*6\r\n_\r\n-ERR bad\r\n$2\r\nab\r\n:-7\r\n$4096\r\n" + big + "\r\n+OK\r\n",
+               "_\r\n-ERR bad\r\n$2\r\nab\r\n:-7\r\n$4096\r\n" + big + "\r\n+OK\r\n");
+
+    test_nested(PROTO_BIN,
+                tag(SER_ARR) + u32(3) +
+                    tag(SER_ARR) + u32(0) +
+                    tag(SER_ARR) + u32(2) + tag(SER_INT) + i64(1) + tag(SER_NIL) +
+                    tag(SER_ARR) + u32(2) + tag(SER_STR) + u32(1) + "k" +
+                    tag(SER_STR) + u32(1) + "v");
+    test_nested(PROTO_RESP2, "*3\r\n*0\r\n*2\r\n:1\r\n$-1\r\n*2\r\n$1\r\nk\r\n$1\r\nv\r\n:5\r\n");
+    test_nested(PROTO_RESP3, "*3\r\n*0\r\n*2\r\n:1\r\n_\r\n%1\r\n$1\r\nk\r\n$1\r\nv\r\n:5\r\n");
+
+    printf("out_buf: ok\n");
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include "../include/resp.h"
+#include "../include/server.h"
+#include "../include/enums/loop_enum.h"
+#include "../include/enums/proto_enum.h"
+#include "../include/enums/res_enum.h"
+#include "kv_client.h"
+
+/**
+ * @return the protocol resp_detect() settles on for the first avail
+ * bytes of s, PROTO_NONE if it waits for more
+ */
+static uint32_t detect(std::string_view s, size_t avail)
+{
+    uint32_t proto = PROTO_NONE;
+    if (!resp_detect((const uint8_t *)s.data(), avail, &proto))
+    {
+        return PROTO_NONE;
+    }
+    return proto;
+}
+
+/**
+ * @brief header of a binary SET whose u32 length is len, the value is
+ * len - 22 bytes long
+ */
+static std::string bin_set_header(uint32_t len)
+{
+    std::string req;
+    uint32_t nargs = 3;
+    uint32_t three = 3;
+    uint32_t vlen = len - 4 - (4 + 3) - (4 + 3) - 4;
+    req.append((const char *)&len, 4);
+    req.append((const char *)&nargs, 4);
+    req.append((const char *)&three, 4);
+    req.append("set");
+    req.append((const char *)&three, 4);
+    req.append("big");
+    req.append((const char *)&vlen, 4);
+    return req;
+}
+
+static void test_detect()
+{
+    std::string resp;
+    resp_cmd(resp, {"GET", "k"});
+    CHECK(detect(resp, 1) == PROTO_NONE);
+    CHECK(detect(resp, 3) == PROTO_NONE);
+    CHECK(detect(resp, 4) == PROTO_RESP2);
+    CHECK(detect(resp, resp.size()) == PROTO_RESP2);
+    CHECK(detect("*0\r\n", 4) == PROTO_RESP2);
+    CHECK(detect("x\r\n", 3) == PROTO_RESP2);
+    CHECK(detect("PING\r\n", 6) == PROTO_RESP2);
+    CHECK(detect("GET key\r\n", 9) == PROTO_RESP2);
+    CHECK(detect("a\r\nb\r\n", 6) == PROTO_RESP2);
+
+    std::string bin;
+    bin_cmd(bin, {"get", "k"});
+    CHECK(detect(bin, 1) == PROTO_BIN);
+
+    // 16 MB and more, the first byte looks like RESP
+    for (uint32_t len : {0x0100002Au, 0x01000061u, 0x1F000A47u, 0x1F0D0A2Au})
+    {
+        std::string big = bin_set_header(len);
+        CHECK(detect(big, 1) == PROTO_NONE);
+        CHECK(detect(big, 4) == PROTO_NONE);
+        CHECK(detect(big, 8) == PROTO_BIN);
+        CHECK(detect(big, big.size()) == PROTO_BIN);
+    }
+}
+
+/**
+ * @brief a server sees binary requests of 16 MB and more, starting with
+ * '*' and with a letter, as such
+ */
+static void test_server()
+{
+    pid_t pid = spawn_server([]()
+                             {
+                                 Server server(LOOP_EPOLL);
+                                 server.run_server(server.init()); });
+    for (uint32_t len : {0x0100002Au, 0x01000061u})
+    {
+        int fd = kv_connect();
+        KvReader rd(fd);
+        std::string req = bin_set_header(len);
+        size_t vlen = len - (req.size() - 4);
+        req.append(vlen, 'v');
+        bin_cmd(req, {"get", "big"});
+        kv_send(fd, req);
+
+        uint32_t rescode = 0;
+        rd.bin_reply(&rescode);
+        CHECK(rescode == RES_OK);
+        CHECK(rd.bin_reply(&rescode).size() == vlen);
+        CHECK(rescode == RES_OK);
+        close(fd);
+    }
+
+    int fd = kv_connect();
+    KvReader rd(fd);
+    kv_send(fd, "PING\r\n");
+    CHECK(rd.reply() == "+PONG");
+    close(fd);
+    stop_server(pid);
+}
+
+int main()
+{
+    test_detect();
+    test_server();
+    printf("proto: ok\n");
+    return 0;
+}
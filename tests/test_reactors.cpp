@@ -0,0 +1,75 @@
+#include <thread>
+#include <vector>
+
+#include "../include/server.h"
+#include "../include/enums/loop_enum.h"
+#include "kv_client.h"
+
+/**
+ * several reactors share the striped keyspace, every client works on its
+ * own keys so whatever reactor serves it, it must read back its writes
+ */
+
+static void client_run(int c, int n)
+{
+    int fd = kv_connect();
+    KvReader rd(fd);
+    std::string prefix = "c" + std::to_string(c) + ":";
+
+    std::string req;
+    for (int i = 0; i < n; i++)
+    {
+        resp_cmd(req, {"SET", prefix + std::to_string(i), "v" + std::to_string(i)});
+    }
+    for (int i = 0; i < n; i++)
+    {
+        resp_cmd(req, {"GET", prefix + std::to_string(i)});
+    }
+    kv_send(fd, req);
+    for (int i = 0; i < n; i++)
+    {
+        CHECK(rd.reply() == "+OK");
+    }
+    for (int i = 0; i < n; i++)
+    {
+        CHECK(rd.reply() == "v" + std::to_string(i));
+    }
+
+    // the keys of one DEL land in different stripes
+    for (int i = 0; i + 10 <= n; i += 10)
+    {
+        req.clear();
+        std::vector<std::string> keys;
+        for (int j = i; j < i + 10; j++)
+        {
+            keys.push_back(prefix + std::to_string(j));
+        }
+        resp_cmd(req, {"DEL", keys[0], keys[1], keys[2], keys[3], keys[4],
+                       keys[5], keys[6], keys[7], keys[8], keys[9], "missing"});
+        resp_cmd(req, {"GET", keys[0]});
+        kv_send(fd, req);
+        CHECK(rd.reply() == ":10");
+        CHECK(rd.reply() == "$-1");
+    }
+    close(fd);
+}
+
+int main()
+{
+    pid_t pid = spawn_server([]()
+                             { Server::run_reactors(4, LOOP_EPOLL); });
+
+    std::vector<std::thread> threads;
+    for (int c = 0; c < 8; c++)
+    {
+        threads.emplace_back(client_run, c, 5000);
+    }
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+
+    stop_server(pid);
+    printf("reactors: ok\n");
+    return 0;
+}
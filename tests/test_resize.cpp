@@ -0,0 +1,192 @@
+#include <atomic>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "../include/server.h"
+#include "../include/enums/loop_enum.h"
+#include "kv_client.h"
+
+/**
+ * SET, GET and DEL from many clients while the tables of the keyspace
+ * are resizing, every client on its own keys checks each reply against
+ * what it wrote. a monitor polls INFO so the run is known to overlap
+ * resizes
+ */
+
+static std::atomic<bool> g_done;
+
+/**
+ * @brief batches of random commands on keys of c, growing the keyspace
+ * first and churning it after
+ */
+static void client_run(int c, int keys, int batches)
+{
+    int fd = kv_connect();
+    KvReader rd(fd);
+    std::mt19937 rng(c);
+    std::string prefix = "c" + std::to_string(c) + ":";
+    std::unordered_map<int, std::string> model;
+
+    for (int b = 0; b < batches; b++)
+    {
+        // ops: 0 SET, 1 GET, 2 DEL
+        std::vector<std::pair<int, int>> ops;
+        std::string req;
+        int set_pct = (b < batches / 2) ? 70 : 40;
+        for (int i = 0; i < 500; i++)
+        {
+            int k = (int)(rng() % (uint32_t)keys);
+            int r = (int)(rng() % 100);
+            std::string key = prefix + std::to_string(k);
+            if (r < set_pct)
+            {
+                resp_cmd(req, {"SET", key, key + ":" + std::to_string(b)});
+                ops.push_back({0, k});
+            }
+            else if (r < set_pct + 20)
+            {
+                resp_cmd(req, {"GET", key});
+                ops.push_back({1, k});
+            }
+            else
+            {
+                resp_cmd(req, {"DEL", key});
+                ops.push_back({2, k});
+            }
+        }
+        kv_send(fd, req);
+
+        for (auto [op, k] : ops)
+        {
+            std::string key = prefix + std::to_string(k);
+            auto it = model.find(k);
+            if (op == 0)
+            {
+                CHECK(rd.reply() == "+OK");
+                model[k] = key + ":" + std::to_string(b);
+            }
+            else if (op == 1)
+            {
+                CHECK(rd.reply() == (it == model.end() ? "$-1" : it->second));
+            }
+            else
+            {
+                CHECK(rd.reply() == (it == model.end() ? ":0" : ":1"));
+                if (it != model.end())
+                {
+                    model.erase(it);
+                }
+            }
+        }
+    }
+
+    std::string req;
+    for (int k = 0; k < keys; k++)
+    {
+        resp_cmd(req, {"GET", prefix + std::to_string(k)});
+    }
+    kv_send(fd, req);
+    for (int k = 0; k < keys; k++)
+    {
+        auto it = model.find(k);
+        CHECK(rd.reply() == (it == model.end() ? "$-1" : it->second));
+    }
+    close(fd);
+}
+
+/**
+ * @brief polls INFO until the clients are done
+ *
+ * @return INFO replies that showed a resize in progress
+ */
+static int monitor_run()
+{
+    int fd = kv_connect();
+    KvReader rd(fd);
+    int resizing = 0;
+    while (!g_done.load())
+    {
+        std::string req;
+        resp_cmd(req, {"INFO"});
+        kv_send(fd, req);
+        resizing += info_field(rd.reply(), "resizing") ? 1 : 0;
+        usleep(200);
+    }
+    close(fd);
+    return resizing;
+}
+
+static void stress(const char *name)
+{
+    g_done = false;
+    int resizing = 0;
+    std::thread monitor([&resizing]()
+                        { resizing = monitor_run(); });
+
+    std::vector<std::thread> threads;
+    for (int c = 0; c < 8; c++)
+    {
+        threads.emplace_back(client_run, c, 10000, 60);
+    }
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+    g_done = true;
+    monitor.join();
+
+    printf("resize %s: INFO showed a resize %d times\n", name, resizing);
+    CHECK(resizing > 0);
+}
+
+/**
+ * @brief a second server with SO_REUSEPORT listeners refuses to start
+ * while the first runs, instead of taking half of its connections
+ */
+static void second_server_dies()
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    CHECK(pid >= 0);
+    if (pid == 0)
+    {
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, 1);
+        dup2(null_fd, 2);
+        Server::run_reactors(2, LOOP_EPOLL);
+        _exit(0);
+    }
+
+    int status = 0;
+    for (int tries = 0; waitpid(pid, &status, WNOHANG) == 0; tries++)
+    {
+        if (tries == 300)
+        {
+            stop_server(pid);
+            CHECK(!"the second server is still running");
+        }
+        usleep(10 * 1000);
+    }
+    CHECK(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+}
+
+int main()
+{
+    pid_t pid = spawn_server([]()
+                             { Server::run_reactors(4, LOOP_EPOLL); });
+    stress("reactors");
+    second_server_dies();
+    stop_server(pid);
+
+    pid = spawn_server([]()
+                       { Server::run_shards(4, LOOP_EPOLL); });
+    stress("shards");
+    second_server_dies();
+    stop_server(pid);
+
+    printf("resize: ok\n");
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include <memory>
+
+#include "../include/server.h"
+#include "../include/shm_client.h"
+#include "../include/shm_ring.h"
+#include "../include/enums/loop_enum.h"
+#include "../include/enums/res_enum.h"
+#include "kv_client.h"
+
+static const char *k_shm_path = "/tmp/kv-test-shm.sock";
+
+/**
+ * @brief bytes go around the end of the ring, a full ring takes nothing
+ * and an empty one gives nothing
+ */
+static void test_ring()
+{
+    std::unique_ptr<ShmRing> ring(new ShmRing());
+    ring->head = ring->tail = k_shm_ring_size - 3;
+
+    std::string out(k_shm_ring_size + 10, 0);
+    for (size_t i = 0; i < out.size(); i++)
+    {
+        out[i] = (char)(i * 7);
+    }
+    CHECK(shm_ring_write(ring.get(), out.data(), out.size()) == (ssize_t)k_shm_ring_size);
+    CHECK(shm_ring_write(ring.get(), out.data(), 1) == 0);
+
+    std::string in(out.size(), 0);
+    CHECK(shm_ring_read(ring.get(), &in[0], in.size()) == (ssize_t)k_shm_ring_size);
+    CHECK(in.compare(0, k_shm_ring_size, out, 0, k_shm_ring_size) == 0);
+    CHECK(shm_ring_read(ring.get(), &in[0], 1) == 0);
+}
+
+/**
+ * @brief indices that no longer bound a valid count are refused on both
+ * sides, whether tail ran ahead or head went past it
+ */
+static void test_ring_corrupt()
+{
+    std::unique_ptr<ShmRing> ring(new ShmRing());
+    char buf[16] = {};
+    for (uint64_t tail : {(uint64_t)k_shm_ring_size + 1, (uint64_t)0 - 1})
+    {
+        ring->head = 0;
+        ring->tail = tail;
+        CHECK(shm_ring_read(ring.get(), buf, sizeof(buf)) == -1);
+        CHECK(shm_ring_write(ring.get(), buf, sizeof(buf)) == -1);
+        CHECK(ring->head == 0 && ring->tail == tail);
+    }
+}
+
+/**
+ * @brief a client moving the indices of the request ring gets its
+ * channel closed, the server does not read past the ring
+ */
+static void test_channel_corrupt()
+{
+    int sv[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    ShmChannel *ch = shm_channel_new(sv[0]);
+    CHECK(ch);
+
+    std::vector<char> buf(2 * k_shm_ring_size);
+    ch->region->req.tail = 5 * k_shm_ring_size;
+    errno = 0;
+    CHECK(shm_recv(ch, buf.data(), buf.size()) == -1);
+    CHECK(errno == EPROTO);
+
+    ch->region->res.head = 1;
+    struct iovec iov = {buf.data(), 16};
+    errno = 0;
+    CHECK(shm_sendv(ch, &iov, 1) == -1);
+    CHECK(errno == EPROTO);
+
+    shm_channel_free(ch);
+    close(sv[1]);
+}
+
+/**
+ * @brief requests and responses over the rings of a running server, more
+ * than a ring of them in flight
+ */
+static void test_server()
+{
+    pid_t pid = spawn_server([]()
+                             {
+                                 Server server(LOOP_EPOLL);
+                                 int fd = server.init();
+                                 server.init_shm(k_shm_path);
+                                 server.run_server(fd); });
+    close(kv_connect());
+
+    ShmClient cli;
+    CHECK(cli.connect(k_shm_path) == 0);
+    std::string res;
+    std::string big(3 * k_shm_ring_size / 2, 'v');
+    CHECK(cli.request({"set", "big", big}, res) == RES_OK);
+    CHECK(cli.request({"get", "big"}, res) == RES_OK);
+    CHECK(res == big);
+
+    const int n = 50000;
+    for (int i = 0; i < n; i++)
+    {
+        cli.send({"set", "k" + std::to_string(i), "v" + std::to_string(i)});
+        if (i % 1000 == 999)
+        {
+            for (int j = 0; j < 1000; j++)
+            {
+                CHECK(cli.recv(res) == RES_OK);
+            }
+        }
+    }
+    for (int i = 0; i < n; i++)
+    {
+        CHECK(cli.request({"get", "k" + std::to_string(i)}, res) == RES_OK);
+        CHECK(res == "v" + std::to_string(i));
+    }
+    stop_server(pid);
+    unlink(k_shm_path);
+}
+
+int main()
+{
+    test_ring();
+    test_ring_corrupt();
+    test_channel_corrupt();
+    test_server();
+    printf("shm: ok\n");
+    return 0;
+}
@@ -0,0 +1,163 @@
+#include <malloc.h>
+#include <vector>
+
+#include "../include/constants.h"
+#include "../include/hash.h"
+#include "../include/hashtable.h"
+#include "kv_client.h"
+
+/**
+ * an HMap that lost most of its keys gives the memory back, and churn
+ * around either load limit does not start resize after resize
+ */
+
+struct TestEntry
+{
+    HNode node;
+    uint64_t key = 0;
+};
+
+static bool entry_eq(HNode *a, HNode *b)
+{
+    return ((TestEntry *)a)->key == ((TestEntry *)b)->key;
+}
+
+static size_t heap_bytes()
+{
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+}
+
+// control byte and node pointer of every slot, of both tables
+static size_t table_bytes(HMap *hmap)
+{
+    size_t n = 0;
+    for (HTable *ht : {&hmap->ht_primary, &hmap->ht_secondary})
+    {
+        if (ht->ctrl)
+        {
+            n += (ht->mask + 1) * (1 + sizeof(HNode *));
+        }
+    }
+    return n;
+}
+
+static HNode *pop(HMap *hmap, TestEntry *e)
+{
+    TestEntry key = *e;
+    return hm_pop(hmap, &key.node, entry_eq);
+}
+
+/**
+ * @brief inserts and pops the same count nodes, rounds times
+ *
+ * @return resizes started meanwhile
+ */
+static uint64_t churn(HMap *hmap, TestEntry *es, size_t count, int rounds)
+{
+    uint64_t before = hm_stats(hmap).resizes;
+    for (int r = 0; r < rounds; r++)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            hm_insert(hmap, &es[i].node);
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            CHECK(pop(hmap, &es[i]) == &es[i].node);
+        }
+    }
+    return hm_stats(hmap).resizes - before;
+}
+
+int main()
+{
+    const size_t n = 10000000;
+    std::vector<TestEntry> es(n);
+    HMap hmap;
+    for (size_t i = 0; i < n; i++)
+    {
+        es[i].key = i;
+        es[i].node.hcode = str_hash((const uint8_t *)&es[i].key, 8);
+        hm_insert(&hmap, &es[i].node);
+    }
+    while (hm_rehash(&hmap, 1000))
+    {
+    }
+    size_t full_table = table_bytes(&hmap);
+    size_t full_heap = heap_bytes();
+
+    // keeps every tenth key, the cron runs now and then
+    for (size_t i = 0; i < n; i++)
+    {
+        if (i % 10)
+        {
+            CHECK(pop(&hmap, &es[i]) == &es[i].node);
+        }
+        if (i % 100000 == 0)
+        {
+            hm_rehash(&hmap, 250);
+        }
+    }
+    CHECK(hm_stats(&hmap).resizing);
+    while (hm_rehash(&hmap, 1000))
+    {
+    }
+    CHECK(hm_size(&hmap) == n / 10);
+
+    size_t table = table_bytes(&hmap);
+    size_t heap = heap_bytes();
+    printf("shrink: %zu keys, table %zu MB -> %zu MB, heap %zu MB -> %zu MB\n",
+           hm_size(&hmap), full_table >> 20, table >> 20, full_heap >> 20, heap >> 20);
+    CHECK(table * 4 <= full_table);
+    CHECK(full_heap - heap >= (full_table - table) * 9 / 10);
+
+    for (size_t i = 0; i < n; i += 10)
+    {
+        CHECK(hm_lookup(&hmap, &es[i].node, entry_eq) == &es[i].node);
+    }
+    for (size_t i = 1; i < 10; i++)
+    {
+        CHECK(!hm_lookup(&hmap, &es[i].node, entry_eq));
+    }
+
+    // the keys still deleted, below the live ones, are free to churn
+    std::vector<TestEntry> spare;
+    for (size_t i = 0; i < n / 10; i++)
+    {
+        if (i % 10)
+        {
+            spare.push_back(es[i]);
+        }
+    }
+
+    // one key in and out, right after the shrink
+    CHECK(churn(&hmap, spare.data(), 1, 100000) == 0);
+    // thousands, well inside the band
+    CHECK(churn(&hmap, spare.data(), 1800, 1000) == 0);
+
+    // popping down to the shrink limit starts a shrink. the smaller table
+    // has room to spare, the popped keys go back without a grow and one
+    // key in and out at the limit starts nothing either
+    uint64_t resizes = hm_stats(&hmap).resizes;
+    std::vector<TestEntry> popped;
+    for (size_t i = 0; hm_stats(&hmap).resizes == resizes; i += 10)
+    {
+        CHECK(pop(&hmap, &es[i]) == &es[i].node);
+        popped.push_back(es[i]);
+    }
+    CHECK(hm_size(&hmap) * 8 < (size_t)(hmap.ht_secondary.mask + 1) * k_min_load_eighths);
+    while (hm_rehash(&hmap, 1000))
+    {
+    }
+    CHECK(churn(&hmap, &popped.back(), 1, 100000) == 0);
+    for (TestEntry &e : popped)
+    {
+        hm_insert(&hmap, &e.node);
+    }
+    CHECK(hm_stats(&hmap).resizes == resizes + 1);
+
+    hm_destroy(&hmap);
+    printf("shrink: ok\n");
+    return 0;
+}
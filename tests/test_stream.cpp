@@ -0,0 +1,143 @@
+#include <vector>
+
+#include "../include/server.h"
+#include "../include/enums/loop_enum.h"
+#include "../include/enums/res_enum.h"
+#include "kv_client.h"
+
+/**
+ * @return data segment of the process in MB, what it allocated whether
+ * it touched the pages or not
+ */
+static double data_mb(pid_t pid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+    FILE *f = fopen(path, "r");
+    CHECK(f);
+    char line[256];
+    long kb = -1;
+    while (fgets(line, sizeof(line), f))
+    {
+        if (sscanf(line, "VmData: %ld kB", &kb) == 1)
+        {
+            break;
+        }
+    }
+    fclose(f);
+    CHECK(kb >= 0);
+    return (double)kb / 1024;
+}
+
+/**
+ * @brief a large value sent in small slices is streamed into the arg, or
+ * buffered as it comes for RESP, and read back whole
+ */
+static void test_sliced(bool resp)
+{
+    int fd = kv_connect();
+    KvReader rd(fd);
+    std::string val(3 * 1024 * 1024 + 7, 0);
+    for (size_t i = 0; i < val.size(); i++)
+    {
+        val[i] = (char)(i * 131);
+    }
+    std::string req;
+    if (resp)
+    {
+        resp_cmd(req, {"SET", "big", val});
+    }
+    else
+    {
+        bin_cmd(req, {"set", "big", val});
+    }
+    for (size_t off = 0; off < req.size(); off += 100 * 1000)
+    {
+        size_t n = (req.size() - off < 100 * 1000) ? req.size() - off : 100 * 1000;
+        kv_send(fd, std::string_view(req).substr(off, n));
+        usleep(1000);
+    }
+    if (resp)
+    {
+        CHECK(rd.reply() == "+OK");
+        req.clear();
+        resp_cmd(req, {"GET", "big"});
+        kv_send(fd, req);
+        CHECK(rd.reply() == val);
+        close(fd);
+        return;
+    }
+    uint32_t rescode = 0;
+    rd.bin_reply(&rescode);
+    CHECK(rescode == RES_OK);
+
+    req.clear();
+    bin_cmd(req, {"get", "big"});
+    kv_send(fd, req);
+    CHECK(rd.bin_reply(&rescode) == val);
+    CHECK(rescode == RES_OK);
+    close(fd);
+}
+
+/**
+ * @brief the clients declare 256 MB args and send only a few bytes of
+ * them, the server must not reserve what it was only promised. the
+ * binary protocol streams the arg, RESP buffers the request whole
+ */
+static void test_declared(pid_t pid, bool resp)
+{
+    double before = data_mb(pid);
+    std::vector<int> fds;
+    for (int i = 0; i < 4; i++)
+    {
+        int fd = kv_connect();
+        std::string req;
+        if (resp)
+        {
+            req = "*3\r\n$3\r\nset\r\n$3\r\nkey\r\n$" + std::to_string(256u << 20) + "\r\n";
+            req.append(std::string(100 * 1000, 'x'));
+            kv_send(fd, req);
+            fds.push_back(fd);
+            continue;
+        }
+        uint32_t len = 256u << 20;
+        uint32_t nargs = 3;
+        uint32_t arg_len = 3;
+        uint32_t big_len = len - 4 - (4 + 3) - (4 + 3) - 4;
+        req.append((const char *)&len, 4);
+        req.append((const char *)&nargs, 4);
+        req.append((const char *)&arg_len, 4);
+        req.append("set");
+        req.append((const char *)&arg_len, 4);
+        req.append("key");
+        req.append((const char *)&big_len, 4);
+        req.append(std::string(100 * 1000, 'x'));
+        kv_send(fd, req);
+        fds.push_back(fd);
+    }
+    usleep(200 * 1000);
+    double after = data_mb(pid);
+    printf("stream: %.0f MB -> %.0f MB with 4 x 256 MB declared, %s\n", before, after,
+           resp ? "resp" : "binary");
+    CHECK(after - before < 16);
+    for (int fd : fds)
+    {
+        close(fd);
+    }
+}
+
+int main()
+{
+    pid_t pid = spawn_server([]()
+                             {
+                                 Server server(LOOP_EPOLL);
+                                 server.run_server(server.init()); });
+    test_sliced(false);
+    test_sliced(true);
+    test_declared(pid, false);
+    test_declared(pid, true);
+
+    stop_server(pid);
+    printf("stream: ok\n");
+    return 0;
+}